@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE           // splice()
+#endif
 #include <rbus.h>
 #include <cJSON.h>
 #include <stdio.h>
@@ -8,6 +11,23 @@
 #include <signal.h>
 #include <time.h>
 #include <stdint.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <math.h>
+#include <float.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
 
 #ifdef __APPLE__
 #include <sys/sysctl.h>
@@ -21,11 +41,120 @@
 #include <unistd.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <linux/net_tstamp.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <sys/timex.h>
+#include <dirent.h>
+#include <limits.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+#if defined(HAVE_ETHTOOL_NETLINK) || defined(HAVE_NL80211)
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#endif
+#ifdef HAVE_ETHTOOL_NETLINK
+#include <linux/rtnetlink.h>
+#include <linux/ethtool.h>
+#include <linux/ethtool_netlink.h>
+#endif
+#ifdef HAVE_NL80211
+#include <linux/nl80211.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #endif
 
 #define MAX_NAME_LEN 256
 #define JSON_FILE "datamodels.json"
 #define MEMORY_CACHE_TIMEOUT 5
+#define GETPAGE_DEFAULT_SIZE 100
+#define GETPAGE_MAX_SIZE 1000
+#define NAME_DICT_BUCKET_SIZE 16
+#define CAS_MAX_ENTRIES 256
+#define ATOMIC_MAX_ENTRIES 256
+#define SET_MAX_ENTRIES 256
+#define TIMER_TICK_MS 100
+#define TIMER_WHEEL_SLOTS 512
+#define SCHED_MAX_WORKERS 16
+#define SCHED_DEFAULT_WORKERS 4
+#define SCHED_QUEUE_SIZE 64
+#define SCHED_OBJECT "Device.X_RDK_DataModels.Stats.Scheduler."
+#define SCHED_STATS_INTERVAL_MS 1000
+#define FLIGHT_RECORDS 4096
+#define FLIGHT_REQUESTER_LEN 28
+#define FLIGHT_DEFAULT_PATH "/tmp/rbus-datamodels.flight"
+#define FLIGHT_DEFAULT_SLO_MS 100
+#define FLIGHT_SLO_DUMP_INTERVAL_MS 60000
+#define FAULT_MAX_RULES 16
+#define FAULT_MAX_LATENCY_MS 3600000
+#define FAULT_MAX_BLOCKING_MS 5000    // Gets and sets, well below the rbus call timeout
+#define PROXY_PREFIX "Device.X_RDK_Cache."
+#define PROXY_MAX_SUBTREES 16
+#define PROXY_DEFAULT_TTL 30
+#define REACTOR_MAX_FDS 4096
+#define HTTP_MAX_CONNECTIONS 64
+#define HTTP_MAX_HEADER 8192
+#define HTTP_MAX_BODY (4 * 1024 * 1024)
+#define HTTP_MAX_INPUT (HTTP_MAX_HEADER + HTTP_MAX_BODY + 4096 + 1)
+#define HTTP_REQUESTER "http"     // Requesting component in flight records
+#define HTTP_BUFFER_KEEP (256 * 1024)
+#define HTTP_BENCH_DEPTH 8
+#define REPORT_MAX_PROFILES 16
+#define REPORT_MAX_NAME 64
+#define PROM_MAX_SUBTREES 16
+#define PROM_DEFAULT_INTERVAL 15
+#define PROM_VALUE_WIDTH 24
+#define DIAG_IPPING_OBJECT "Device.IP.Diagnostics.IPPing."
+#define DIAG_UDPECHO_OBJECT "Device.IP.Diagnostics.UDPEchoDiagnostics."
+#define DIAG_MAX_TESTS 64
+#define DIAG_MAX_BLOCK 8192
+#define DIAG_PROBE_INTERVAL_MS 1000
+#define DIAG_PROBE_MAGIC 0x52424450u
+#define DIAG_DEFAULT_REPETITIONS 3
+#define DIAG_DEFAULT_TIMEOUT_MS 1000
+#define DIAG_DEFAULT_BLOCK 64
+#define DIAG_MAX_RESULTS 16
+#define DIAG_UNKNOWN_TIME "0001-01-01T00:00:00Z"
+#define DIAG_DOWNLOAD_OBJECT "Device.IP.Diagnostics.DownloadDiagnostics."
+#define DIAG_UPLOAD_OBJECT "Device.IP.Diagnostics.UploadDiagnostics."
+#define XFER_MAX_TESTS 8
+#define XFER_CHUNK (1024 * 1024)
+#define XFER_MAX_HEADER 4096
+#define XFER_MAX_SAMPLES 3600
+#define XFER_IDLE_TIMEOUT_MS 30000
+#define XFER_SERVER_MAX_CONNECTIONS 16
+#define STORE_BATCH_SIZE 256
+#define NL_BUFFER_SIZE 65536
+#define ETH_MAX_ROWS 64
+#define ETH_MAX_LINKS 256
+#define ETH_DUMP_DELAY_MS 100
+#define WIFI_MAX_INTERFACES 4
+#define WIFI_MAX_STATIONS 32
+#define WIFI_DEFAULT_INTERVAL 10
+#define CGROUP_OBJECT "Device.DeviceInfo.X_RDK_ServiceStatus."
+#define CGROUP_MAX_SERVICES 64
+#define CGROUP_DEFAULT_INTERVAL 5
+#define CGROUP_PROBE_SWEEPS 8
+#define SWEEP_MAX_READS (CGROUP_MAX_SERVICES * 3)
+#define SWEEP_READ_SIZE 1024
+#define TIME_OBJECT "Device.Time."
+#define TIME_SAMPLE_INTERVAL_MS 1000
+#define DNS_OBJECT "Device.DNS.Client."
+#define DNS_DEFAULT_RESOLV_CONF "/etc/resolv.conf"
+#define DNS_MAX_SERVERS 8
+#define DNS_MAX_ADDRESS 64
+#define SOAK_DEFAULT_RATE 1000
+#define SOAK_DEFAULT_MAX_GROWTH 10
+#define SOAK_DEFAULT_MAX_DRIFT 50
+#define SOAK_MIN_DRIFT_US 100
+#define SOAK_SAMPLES 20
+#define SOAK_MAX_STRING 256
+#define SOAK_BUCKETS 1024
 
 typedef enum {
    TYPE_STRING = 0,
@@ -41,30 +170,190 @@ typedef enum {
    TYPE_BYTE = 10
 } ValueType;
 
+typedef union {
+   char *strVal;             // TYPE_STRING, TYPE_DATETIME, TYPE_BASE64
+   int32_t intVal;           // TYPE_INT
+   uint32_t uintVal;         // TYPE_UINT
+   bool boolVal;             // TYPE_BOOL
+   int64_t longVal;          // TYPE_LONG
+   uint64_t ulongVal;        // TYPE_ULONG
+   float floatVal;           // TYPE_FLOAT
+   double doubleVal;         // TYPE_DOUBLE
+   uint8_t byteVal;          // TYPE_BYTE
+} DataValue;
+
+// Timer on the hashed timer wheel; starting, cancelling and expiring are O(1)
+typedef struct Timer {
+   struct Timer *prev;
+   struct Timer *next;
+   uint32_t rounds;          // Full turns of the wheel left before expiry
+   bool armed;
+   void (*callback)(void *arg);
+   void *arg;
+} Timer;
+
+// Stackless coroutine resumed by the reactor and the timer wheel. Its locals
+// do not survive a wait, so state lives in the structure that embeds it.
+typedef struct Coroutine Coroutine;
+struct Coroutine {
+   bool (*run)(Coroutine *co);    // Returns true once the body has finished
+   void (*done)(Coroutine *co);   // Called after run returns true
+   void *arg;
+   int line;                 // Resume point, 0 before the first run
+   int fd;                   // Descriptor being waited on, or -1
+   short revents;            // Events that ended the last wait, 0 on timeout
+   Timer timer;
+};
+
+// Priority classes of scheduled work, highest first
+typedef enum {
+   SCHED_INTERACTIVE,        // Work a client is waiting on, like refetching a stale cached value
+   SCHED_PERIODIC,           // Samplers
+   SCHED_BACKGROUND,         // Exports and report snapshots
+   NUM_SCHED_CLASSES
+} SchedClass;
+
+// Unit of work run on a scheduler worker. Owners keep one per job; a task is
+// queued at most once and never runs on two workers at the same time.
 typedef struct {
-   char name[MAX_NAME_LEN];
+   void (*run)(void *arg);
+   void *arg;
+   SchedClass priority;
+   int state;                // SCHED_TASK_IDLE, SCHED_TASK_QUEUED, SCHED_TASK_RUNNING or SCHED_TASK_RERUN
+   uint64_t queuedNs;
+   Timer timer;              // Delay of schedAfter()
+} SchedTask;
+
+typedef enum {
+   FLIGHT_GET,               // Store value read by getHandler() or the HTTP gateway
+   FLIGHT_LIVE_GET,          // Value read by a live handler
+   FLIGHT_SET,
+   FLIGHT_PUBLISH,           // Value-change event
+   NUM_FLIGHT_OPS
+} FlightOp;
+
+// Flight recorder entry, one cache line. Phase ends are nanoseconds after
+// startNs: the store lock taken, the store lock released, and the operation
+// finished.
+typedef struct {
+   uint64_t seq;             // Claim number + 1, or 0 while being written
+   uint64_t startNs;
+   uint32_t lockedNs;
+   uint32_t storedNs;
+   uint32_t doneNs;
+   int32_t model;            // g_dataModels index, or -1 for an unknown name
+   int16_t result;           // rbusError_t
+   uint8_t op;               // FlightOp
+   bool injected;            // Includes a latency injected by a fault rule
+   char requester[FLIGHT_REQUESTER_LEN];
+} __attribute__((aligned(64))) FlightRecord;
+
+// Operations a fault injection rule applies to
+enum {
+   FAULT_GET = 1,
+   FAULT_SET = 2,
+   FAULT_EVENT = 4,
+   FAULT_METHOD = 8,
+   FAULT_ALL = 15
+};
+
+typedef enum {
+   FAULT_FIXED,              // latencyMs
+   FAULT_UNIFORM,            // Between latencyMs and latencyMaxMs
+   FAULT_EXPONENTIAL         // Mean latencyMs, capped at latencyMaxMs unless it is 0
+} FaultLatency;
+
+// Fault injection rule for the parameters, events and methods matching pattern
+typedef struct {
+   uint32_t id;
+   char pattern[MAX_NAME_LEN]; // Name, with "*" for any one segment, or prefix ending in "."
+   uint32_t ops;             // FAULT_GET, FAULT_SET, FAULT_EVENT and FAULT_METHOD bits
+   FaultLatency latency;
+   uint32_t latencyMs;
+   uint32_t latencyMaxMs;
+   rbusError_t error;        // Answer to gets, sets and methods, or RBUS_ERROR_SUCCESS
+   uint32_t errorPercent;
+   uint32_t dropPercent;     // Events discarded
+} FaultRule;
+
+// Method response or event held back by an injected latency
+typedef struct FaultDeferred {
+   Timer timer;
+   struct FaultDeferred *prev;
+   struct FaultDeferred *next;
+   rbusMethodAsyncHandle_t asyncHandle; // Method response, or NULL for an event
+   rbusError_t error;
+   rbusObject_t results;
+   char *name;               // Event
+   rbusValue_t newValue;
+   rbusValue_t oldValue;
+   char *by;
+} FaultDeferred;
+
+// Expiry state of a value written with a TTL
+typedef struct {
+   Timer timer;
+   DataValue defaultValue;   // Value restored on expiry
+   bool pending;             // A TTL value is in place and has not yet expired
+} TtlState;
+
+// Cache state of a value proxied from another component
+typedef struct {
+   uint64_t refreshedMs;     // When the value was last fetched or updated by an event
+   bool refreshQueued;       // A get found the value stale; a scheduler task refetches it
+   bool subscribed;          // Value-change events of the owner keep the value fresh
+} ProxyState;
+
+typedef struct {
+   const char *name;         // Only set while loading; use dataModelName() afterwards
    ValueType type;
-   union {
-      char *strVal;          // TYPE_STRING, TYPE_DATETIME, TYPE_BASE64
-      int32_t intVal;        // TYPE_INT
-      uint32_t uintVal;      // TYPE_UINT
-      bool boolVal;          // TYPE_BOOL
-      int64_t longVal;       // TYPE_LONG
-      uint64_t ulongVal;     // TYPE_ULONG
-      float floatVal;        // TYPE_FLOAT
-      double doubleVal;      // TYPE_DOUBLE
-      uint8_t byteVal;       // TYPE_BYTE
-   } value;
+   DataValue value;
    rbusGetHandler_t getHandler;
    rbusSetHandler_t setHandler;
+   uint32_t version;         // Incremented on every write to value
+   bool highRate;            // Also published as raw-data events
+   TtlState *ttl;            // Allocated while a value set with a TTL is in place
+   ProxyState *proxy;        // Set for values cached from a remote subtree
 } DataModel;
 
+typedef enum {
+   NAME_DICT_PLAIN = 0,      // Sorted array of pointers into a single string arena
+   NAME_DICT_FRONT_CODED = 1 // Front-coded buckets, names decoded on demand
+} NameDictMode;
+
+// Maps parameter names to dense ids (their rank in sorted order) and back
+typedef struct {
+   NameDictMode mode;
+   int count;
+   // NAME_DICT_PLAIN
+   char *arena;
+   const char **names;
+   // NAME_DICT_FRONT_CODED: each bucket holds a full header name followed by
+   // (shared prefix length, suffix length, suffix) entries for the rest of the bucket
+   uint8_t *data;
+   size_t dataLen;
+   uint32_t *bucketOffsets;
+   int numBuckets;
+} NameDict;
+
+// Subscription trie keyed by path segment. A "*" segment matches any single
+// segment and sorts before every other child; a pattern ending in "." covers
+// the whole subtree below it.
+typedef struct SubTrieNode {
+   struct SubTrieNode **children; // Sorted by segment
+   uint32_t numChildren;
+   uint32_t capacity;
+   uint32_t exactRefs;   // Subscriptions ending at this node
+   uint32_t subtreeRefs; // Prefix subscriptions covering everything below this node
+   char segment[];
+} SubTrieNode;
+
 // Memory cache for optimization
 typedef struct {
    uint64_t total;  // Total memory in kB
    uint64_t free;   // Free memory in kB
    uint64_t used;   // Used memory in kB
-   time_t last_updated; // Last update timestamp
+   uint64_t last_updated; // monotonicMs() of the last update, 0 before the first
 } MemoryCache;
 
 static DataModel *g_dataModels = NULL;
@@ -72,14 +361,164 @@ static int g_numDataModels = 0;
 static int g_totalDataModels = 0;
 static rbusHandle_t g_rbusHandle = NULL;
 static rbusDataElement_t *g_dataElements = NULL;
+static NameDict g_nameDict = {0};
+static NameDictMode g_nameDictMode = NAME_DICT_PLAIN;
 volatile sig_atomic_t g_running = 1;
 static MemoryCache g_mem_cache = {0};
+static SubTrieNode *g_subTrie = NULL;
+static pthread_mutex_t g_subTrieLock = PTHREAD_MUTEX_INITIALIZER;
+// Guards the values and versions in g_dataModels: gets take it shared, sets exclusive
+static pthread_rwlock_t g_storeLock = PTHREAD_RWLOCK_INITIALIZER;
+// Timer wheel slots are list sentinels; expired timers wait on g_timerExpired
+// until their callback runs. g_timerLock is always taken after g_storeLock.
+static Timer g_timerWheel[TIMER_WHEEL_SLOTS];
+static Timer g_timerExpired;
+static uint64_t g_timerTick = 0;
+static uint64_t g_timerLastMs = 0;
+static pthread_mutex_t g_timerLock = PTHREAD_MUTEX_INITIALIZER;
+// Descriptors watched by the main loop; only touched from the main thread.
+// Removed entries keep fd -1 until the end of the current dispatch.
+typedef void (*ReactorCallback)(int fd, short revents, void *arg);
+static struct pollfd g_reactorFds[REACTOR_MAX_FDS];
+static ReactorCallback g_reactorCallbacks[REACTOR_MAX_FDS];
+static void *g_reactorArgs[REACTOR_MAX_FDS];
+static int g_reactorNumFds = 0;
+// Scheduler workers. Each has a queue per class that others steal from when
+// their own are empty; g_schedGeneration changes on every submission and
+// completion so that idle workers know when to look again.
+typedef struct {
+   pthread_t thread;
+   pthread_mutex_t lock;
+   SchedTask *queue[NUM_SCHED_CLASSES][SCHED_QUEUE_SIZE];
+   uint32_t head[NUM_SCHED_CLASSES];
+   uint32_t tail[NUM_SCHED_CLASSES];
+} SchedWorker;
+static SchedWorker g_schedWorkers[SCHED_MAX_WORKERS];
+static int g_schedNumWorkers = 0;
+static int g_schedNumThreads = 0;
+static int g_schedWorkerCount = SCHED_DEFAULT_WORKERS;  // --workers
+static int g_schedClassLimit[NUM_SCHED_CLASSES];        // Workers a class may occupy at once
+static int g_schedClassRunning[NUM_SCHED_CLASSES];
+static uint32_t g_schedNextWorker = 0;
+static uint64_t g_schedGeneration = 0;
+static bool g_schedStopping = false;
+static pthread_mutex_t g_schedLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_schedCond = PTHREAD_COND_INITIALIZER;
+// Queue latency per class, gathered by workers and published every second
+typedef struct {
+   uint64_t tasks;
+   uint64_t latencyNs;
+   uint64_t maxLatencyNs;
+} SchedStats;
+static SchedStats g_schedStats[NUM_SCHED_CLASSES];
+// Remote subtrees cached under PROXY_PREFIX, and the range of their entries
+static const char *g_proxySubtrees[PROXY_MAX_SUBTREES];
+static int g_numProxySubtrees = 0;
+static uint64_t g_proxyTtlMs = PROXY_DEFAULT_TTL * 1000ULL;
+static int g_proxyFirst = 0;
+static int g_proxyEnd = 0;
+static SchedTask g_proxyRefreshTask;
+// Flight recorder ring of the last FLIGHT_RECORDS gets, sets and publishes.
+// Writers claim a slot with one atomic add and never wait; a dump skips slots
+// whose seq shows they are being rewritten.
+static FlightRecord g_flightRing[FLIGHT_RECORDS];
+static uint64_t g_flightNext = 0;
+static uint64_t g_flightSloNs = FLIGHT_DEFAULT_SLO_MS * 1000000ULL;  // --slo-ms, 0 disables
+// A breach of the SLO copies the ring at once, before the records leading up
+// to it are overwritten, and leaves writing the copy to the dump task
+enum { FLIGHT_SNAPSHOT_FREE, FLIGHT_SNAPSHOT_FILLING, FLIGHT_SNAPSHOT_READY };
+static FlightRecord g_flightSnapshot[FLIGHT_RECORDS];
+static int g_flightSnapshotCount = 0;
+static int g_flightSnapshotState = FLIGHT_SNAPSHOT_FREE;
+static uint64_t g_flightBreachSeq = 0;  // Record that took longer than the SLO
+static uint64_t g_flightLastSloDumpNs = 0;
+static const char *g_flightPath = FLIGHT_DEFAULT_PATH;  // --flight-dump
+static volatile sig_atomic_t g_flightDumpRequested = 0;
+static SchedTask g_flightDumpTask;
+// Fault injection rules added through InjectFault(), in the order they are
+// checked; the first that matches applies. Deferred responses and events wait
+// on the timer wheel in the g_faultDeferred list.
+static bool g_faultEnabled = false;  // --fault-injection
+static FaultRule g_faultRules[FAULT_MAX_RULES];
+static int g_faultNumRules = 0;
+static uint32_t g_faultNextId = 1;
+static FaultDeferred g_faultDeferred = {.prev = &g_faultDeferred, .next = &g_faultDeferred};
+static bool g_faultStopping = false;  // Set by faultStop(); nothing more is held back
+static pthread_mutex_t g_faultLock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef SIMULATED_CLOCK
+// Simulated clocks (--simulated-clock): both stand still until clockAdvance()
+// moves them. An AdvanceClock() call waits in g_clockAdvance* for the main loop.
+static bool g_clockSimulated = false;
+static uint64_t g_clockNs = 0;
+static uint64_t g_clockWallOffsetUs = 0;
+static uint64_t g_clockAdvanceMs = 0;
+static rbusMethodAsyncHandle_t g_clockAdvanceHandle = NULL;
+static int g_clockWakeFds[2] = {-1, -1};  // AdvanceClock() wakes the main loop through this pipe
+static pthread_mutex_t g_clockLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 // Signal handler for SIGINT and SIGTERM
 static void signal_handler(int sig) {
    g_running = 0;
 }
 
+// Signal handler for SIGUSR1; the main loop queues the dump
+static void flightSignalHandler(int sig) {
+   g_flightDumpRequested = 1;
+}
+
+// Every time the provider reads, from cache ages to timer expiry, comes from
+// these clocks. SIMULATED_CLOCK builds can replace them with simulated ones.
+static bool clockSimulated(void) {
+#ifdef SIMULATED_CLOCK
+   return g_clockSimulated;
+#else
+   return false;
+#endif
+}
+
+// Benchmarks and soak latencies are timed on the real clock even when the
+// provider runs on the simulated one
+static uint64_t realMonotonicNs(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t monotonicNs(void) {
+#ifdef SIMULATED_CLOCK
+   if (g_clockSimulated) {
+      return __atomic_load_n(&g_clockNs, __ATOMIC_RELAXED);
+   }
+#endif
+   return realMonotonicNs();
+}
+
+static uint64_t monotonicMs(void) {
+   return monotonicNs() / 1000000ULL;
+}
+
+static uint64_t wallclockUs(void) {
+#ifdef SIMULATED_CLOCK
+   if (g_clockSimulated) {
+      return __atomic_load_n(&g_clockNs, __ATOMIC_RELAXED) / 1000 + g_clockWallOffsetUs;
+   }
+#endif
+   struct timespec ts;
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef SIMULATED_CLOCK
+// Switch to the simulated clocks, starting from the real time. Must run before
+// timerWheelInit().
+static void clockSimulate(void) {
+   g_clockNs = monotonicNs();
+   g_clockWallOffsetUs = wallclockUs() - g_clockNs / 1000;
+   g_clockSimulated = true;
+}
+#endif
+
 static rbusError_t get_system_serial_number(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t *options) {
    rbusValue_t value;
    rbusValue_Init(&value);
@@ -190,14 +629,10 @@ static rbusError_t get_system_time(rbusHandle_t handle, rbusProperty_t property,
    rbusValue_Init(&value);
 
    // Get current time with microsecond precision
-   struct timeval tv;
-   if (gettimeofday(&tv, NULL) != 0) {
-      rbusValue_Release(value);
-      return RBUS_ERROR_BUS_ERROR;
-   }
+   uint64_t us = wallclockUs();
 
    char time_str[32];
-   snprintf(time_str, sizeof(time_str), "%ld.%06ld", (long)tv.tv_sec, (long)tv.tv_usec);
+   snprintf(time_str, sizeof(time_str), "%" PRIu64 ".%06u", us / 1000000, (unsigned)(us % 1000000));
 
    // Set the rbus value to the formatted time string
    rbusValue_SetString(value, time_str);
@@ -380,8 +815,8 @@ static rbusError_t get_mac_address(rbusHandle_t handle, rbusProperty_t property,
 
 // Helper function to update memory cache
 static bool update_memory_cache(void) {
-   time_t now = time(NULL);
-   if (g_mem_cache.last_updated + MEMORY_CACHE_TIMEOUT > now) {
+   uint64_t now = monotonicMs();
+   if (g_mem_cache.last_updated && g_mem_cache.last_updated + MEMORY_CACHE_TIMEOUT * 1000 > now) {
       return true; // Cache is still valid
    }
 
@@ -491,11 +926,7 @@ static rbusError_t get_local_time(rbusHandle_t handle, rbusProperty_t property,
    rbusValue_Init(&value);
 
    // Get current time
-   time_t rawtime;
-   if (time(&rawtime) == (time_t)-1) {
-      rbusValue_Release(value);
-      return RBUS_ERROR_BUS_ERROR;
-   }
+   time_t rawtime = (time_t)(wallclockUs() / 1000000);
 
    // Convert to local time
    struct tm time_struct;
@@ -691,6 +1122,7 @@ bool loadDataModelsFromJson(const char *json_path) {
       cJSON *name_obj = cJSON_GetObjectItem(item, "name");
       cJSON *type_obj = cJSON_GetObjectItem(item, "type");
       cJSON *value_obj = cJSON_GetObjectItem(item, "value");
+      cJSON *highRate_obj = cJSON_GetObjectItem(item, "highRate");
 
       if (!cJSON_IsString(name_obj) || !cJSON_IsNumber(type_obj) ||
          type_obj->valuedouble < 0 || type_obj->valuedouble > TYPE_BYTE) {
@@ -703,11 +1135,21 @@ bool loadDataModelsFromJson(const char *json_path) {
 
       const char *name = cJSON_GetStringValue(name_obj);
       int type = (int)cJSON_GetNumberValue(type_obj);
-      strncpy(g_dataModels[i].name, name, MAX_NAME_LEN - 1);
-      g_dataModels[i].name[MAX_NAME_LEN - 1] = '\0';
+      g_dataModels[i].name = strndup(name, MAX_NAME_LEN - 1);
+      if (!g_dataModels[i].name) {
+         fprintf(stderr, "Failed to allocate memory for name at item %d\n", i);
+         free(g_dataModels);
+         g_dataModels = NULL;
+         cJSON_Delete(root);
+         return false;
+      }
       g_dataModels[i].type = (ValueType)type;
       g_dataModels[i].getHandler = NULL;
       g_dataModels[i].setHandler = NULL;
+      g_dataModels[i].version = 1;
+      g_dataModels[i].highRate = highRate_obj && cJSON_IsTrue(highRate_obj);
+      g_dataModels[i].ttl = NULL;
+      g_dataModels[i].proxy = NULL;
 
       switch (type) {
       case TYPE_STRING:
@@ -816,11 +1258,21 @@ bool loadDataModelsFromJson(const char *json_path) {
 
    for (int j = 0; i < g_totalDataModels; i++, j++) {
       int type = gDataModels[j].type;
-      strncpy(g_dataModels[i].name, gDataModels[j].name, MAX_NAME_LEN - 1);
-      g_dataModels[i].name[MAX_NAME_LEN - 1] = '\0';
+      g_dataModels[i].name = strndup(gDataModels[j].name, MAX_NAME_LEN - 1);
+      if (!g_dataModels[i].name) {
+         fprintf(stderr, "Failed to allocate memory for global data model name\n");
+         free(g_dataModels);
+         g_dataModels = NULL;
+         cJSON_Delete(root);
+         return false;
+      }
       g_dataModels[i].type = (ValueType)type;
       g_dataModels[i].getHandler = gDataModels[j].getHandler;
       g_dataModels[i].setHandler = gDataModels[j].setHandler;
+      g_dataModels[i].version = 1;
+      g_dataModels[i].highRate = gDataModels[j].highRate;
+      g_dataModels[i].ttl = NULL;
+      g_dataModels[i].proxy = NULL;
 
       switch (type) {
       case TYPE_STRING:
@@ -846,235 +1298,9175 @@ bool loadDataModelsFromJson(const char *json_path) {
    return true;
 }
 
-// Callback for handling get requests
-rbusError_t getHandler(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t *options) {
-   char const *name = rbusProperty_GetName(property);
-   for (int i = 0; i < g_numDataModels; i++) {
-      if (strcmp(name, g_dataModels[i].name) == 0) {
-         rbusValue_t value;
-         rbusValue_Init(&value);
-         switch (g_dataModels[i].type) {
-         case TYPE_STRING:
-         case TYPE_DATETIME:
-         case TYPE_BASE64:
-            rbusValue_SetString(value, g_dataModels[i].value.strVal);
-            break;
-         case TYPE_INT:
-            rbusValue_SetInt32(value, g_dataModels[i].value.intVal);
-            break;
-         case TYPE_UINT:
-            rbusValue_SetUInt32(value, g_dataModels[i].value.uintVal);
-            break;
-         case TYPE_BOOL:
-            rbusValue_SetBoolean(value, g_dataModels[i].value.boolVal);
-            break;
-         case TYPE_LONG:
-            rbusValue_SetInt64(value, g_dataModels[i].value.longVal);
-            break;
-         case TYPE_ULONG:
-            rbusValue_SetUInt64(value, g_dataModels[i].value.ulongVal);
-            break;
-         case TYPE_FLOAT:
-            rbusValue_SetSingle(value, g_dataModels[i].value.floatVal);
-            break;
-         case TYPE_DOUBLE:
-            rbusValue_SetDouble(value, g_dataModels[i].value.doubleVal);
-            break;
-         case TYPE_BYTE:
-            rbusValue_SetByte(value, g_dataModels[i].value.byteVal);
-            break;
-         }
-         rbusProperty_SetValue(property, value);
-         rbusValue_Release(value);
-         return RBUS_ERROR_SUCCESS;
+static size_t putVarint(uint8_t *out, uint32_t v) {
+   size_t n = 0;
+   while (v >= 0x80) {
+      out[n++] = (uint8_t)(v | 0x80);
+      v >>= 7;
+   }
+   out[n++] = (uint8_t)v;
+   return n;
+}
+
+static uint32_t getVarint(const uint8_t **p) {
+   uint32_t v = 0;
+   int shift = 0;
+   while (**p & 0x80) {
+      v |= (uint32_t)(*(*p)++ & 0x7F) << shift;
+      shift += 7;
+   }
+   v |= (uint32_t)(*(*p)++) << shift;
+   return v;
+}
+
+static size_t varintLen(uint32_t v) {
+   size_t n = 1;
+   while (v >= 0x80) {
+      v >>= 7;
+      n++;
+   }
+   return n;
+}
+
+static size_t commonPrefixLen(const char *a, const char *b) {
+   size_t n = 0;
+   while (a[n] && a[n] == b[n]) {
+      n++;
+   }
+   return n;
+}
+
+static void nameDictFree(NameDict *dict) {
+   free(dict->arena);
+   free((void *)dict->names);
+   free(dict->data);
+   free(dict->bucketOffsets);
+   memset(dict, 0, sizeof(*dict));
+}
+
+// Build a dictionary over names, which must already be sorted with strcmp
+static bool nameDictBuild(NameDict *dict, NameDictMode mode, const char *const *names, int count) {
+   memset(dict, 0, sizeof(*dict));
+   dict->mode = mode;
+   dict->count = count;
+
+   if (mode == NAME_DICT_PLAIN) {
+      size_t arenaLen = 0;
+      for (int i = 0; i < count; i++) {
+         arenaLen += strlen(names[i]) + 1;
+      }
+      dict->arena = (char *)malloc(arenaLen ? arenaLen : 1);
+      dict->names = (const char **)malloc((count ? count : 1) * sizeof(char *));
+      if (!dict->arena || !dict->names) {
+         nameDictFree(dict);
+         return false;
+      }
+      char *p = dict->arena;
+      for (int i = 0; i < count; i++) {
+         size_t len = strlen(names[i]) + 1;
+         memcpy(p, names[i], len);
+         dict->names[i] = p;
+         p += len;
+      }
+      return true;
+   }
+
+   dict->numBuckets = (count + NAME_DICT_BUCKET_SIZE - 1) / NAME_DICT_BUCKET_SIZE;
+   size_t dataLen = 0;
+   for (int i = 0; i < count; i++) {
+      size_t len = strlen(names[i]);
+      if (i % NAME_DICT_BUCKET_SIZE == 0) {
+         dataLen += len + 1;
+      } else {
+         size_t lcp = commonPrefixLen(names[i - 1], names[i]);
+         dataLen += varintLen(lcp) + varintLen(len - lcp) + (len - lcp);
       }
    }
-   return RBUS_ERROR_INVALID_INPUT;
+
+   dict->data = (uint8_t *)malloc(dataLen ? dataLen : 1);
+   dict->bucketOffsets = (uint32_t *)malloc((dict->numBuckets ? dict->numBuckets : 1) * sizeof(uint32_t));
+   if (!dict->data || !dict->bucketOffsets || dataLen > UINT32_MAX) {
+      nameDictFree(dict);
+      return false;
+   }
+
+   uint8_t *p = dict->data;
+   for (int i = 0; i < count; i++) {
+      size_t len = strlen(names[i]);
+      if (i % NAME_DICT_BUCKET_SIZE == 0) {
+         dict->bucketOffsets[i / NAME_DICT_BUCKET_SIZE] = (uint32_t)(p - dict->data);
+         memcpy(p, names[i], len + 1);
+         p += len + 1;
+      } else {
+         size_t lcp = commonPrefixLen(names[i - 1], names[i]);
+         p += putVarint(p, (uint32_t)lcp);
+         p += putVarint(p, (uint32_t)(len - lcp));
+         memcpy(p, names[i] + lcp, len - lcp);
+         p += len - lcp;
+      }
+   }
+   dict->dataLen = dataLen;
+   return true;
 }
 
-// Callback for handling set requests
-rbusError_t setHandler(rbusHandle_t handle, rbusProperty_t property, rbusSetHandlerOptions_t *options) {
-   char const *name = rbusProperty_GetName(property);
-   rbusValue_t value = rbusProperty_GetValue(property);
-   for (int i = 0; i < g_totalDataModels; i++) {
-      if (strcmp(name, g_dataModels[i].name) == 0) {
-         switch (g_dataModels[i].type) {
-         case TYPE_STRING:
-         case TYPE_DATETIME:
-         case TYPE_BASE64: {
-            char *str = rbusValue_ToString(value, NULL, 0);
-            if (str) {
-               free(g_dataModels[i].value.strVal);
-               g_dataModels[i].value.strVal = strdup(str);
-               free(str);
-               if (!g_dataModels[i].value.strVal) {
-                  return RBUS_ERROR_OUT_OF_RESOURCES;
-               }
-            }
-            break;
-         }
-         case TYPE_INT:
-            g_dataModels[i].value.intVal = rbusValue_GetInt32(value);
-            break;
-         case TYPE_UINT:
-            g_dataModels[i].value.uintVal = rbusValue_GetUInt32(value);
-            break;
-         case TYPE_BOOL:
-            g_dataModels[i].value.boolVal = rbusValue_GetBoolean(value);
-            break;
-         case TYPE_LONG:
-            g_dataModels[i].value.longVal = rbusValue_GetInt64(value);
-            break;
-         case TYPE_ULONG:
-            g_dataModels[i].value.ulongVal = rbusValue_GetUInt64(value);
-            break;
-         case TYPE_FLOAT:
-            g_dataModels[i].value.floatVal = rbusValue_GetSingle(value);
-            break;
-         case TYPE_DOUBLE:
-            g_dataModels[i].value.doubleVal = rbusValue_GetDouble(value);
-            break;
-         case TYPE_BYTE:
-            g_dataModels[i].value.byteVal = rbusValue_GetByte(value);
-            break;
-         }
-         return RBUS_ERROR_SUCCESS;
+// Bytes used by the dictionary itself (excluding the NameDict struct)
+static size_t nameDictBytes(const NameDict *dict) {
+   if (dict->mode == NAME_DICT_PLAIN) {
+      size_t arenaLen = 0;
+      for (int i = 0; i < dict->count; i++) {
+         arenaLen += strlen(dict->names[i]) + 1;
       }
+      return arenaLen + dict->count * sizeof(char *);
    }
-   return RBUS_ERROR_INVALID_INPUT;
+   return dict->dataLen + dict->numBuckets * sizeof(uint32_t);
 }
 
-rbusError_t eventSubHandler(rbusHandle_t handle, rbusEventSubAction_t action, const char *eventName, rbusFilter_t filter, int32_t interval, bool *autoPublish) {
-   (void)handle;
-   (void)filter;
-   (void)autoPublish;
-   (void)interval;
-   printf("Subscribe handler called for %s, action: %s\n", eventName,
-      action == RBUS_EVENT_ACTION_SUBSCRIBE ? "subscribe" : "unsubscribe");
-   return RBUS_ERROR_SUCCESS;
+// Select: returns the name with the given id. Front-coded names are decoded
+// into buf, which must hold MAX_NAME_LEN bytes.
+static const char *nameDictGet(const NameDict *dict, int id, char *buf) {
+   if (dict->mode == NAME_DICT_PLAIN) {
+      return dict->names[id];
+   }
+
+   const uint8_t *p = dict->data + dict->bucketOffsets[id / NAME_DICT_BUCKET_SIZE];
+   size_t len = strlen((const char *)p);
+   memcpy(buf, p, len + 1);
+   p += len + 1;
+   for (int k = id % NAME_DICT_BUCKET_SIZE; k > 0; k--) {
+      uint32_t lcp = getVarint(&p);
+      uint32_t suffixLen = getVarint(&p);
+      memcpy(buf + lcp, p, suffixLen);
+      buf[lcp + suffixLen] = '\0';
+      p += suffixLen;
+   }
+   return buf;
 }
 
-// Cleanup function to free resources
-static void cleanup(void) {
-   if (g_rbusHandle && g_dataElements && g_dataModels) {
-      rbus_unregDataElements(g_rbusHandle, g_totalDataModels, g_dataElements);
-      for (int i = 0; i < g_totalDataModels; i++) {
-         rbusEvent_Unsubscribe(g_rbusHandle, g_dataModels[i].name);
-         if (g_dataModels[i].type == TYPE_STRING ||
-            g_dataModels[i].type == TYPE_DATETIME ||
-            g_dataModels[i].type == TYPE_BASE64) {
-            free(g_dataModels[i].value.strVal);
+// Rank: returns the number of names that sort before name, i.e. the id of the
+// first name >= name
+static int nameDictLowerBound(const NameDict *dict, const char *name) {
+   if (dict->mode == NAME_DICT_PLAIN) {
+      int lo = 0, hi = dict->count;
+      while (lo < hi) {
+         int mid = lo + (hi - lo) / 2;
+         if (strcmp(dict->names[mid], name) < 0) {
+            lo = mid + 1;
+         } else {
+            hi = mid;
          }
-         free(g_dataElements[i].name);
       }
-      free(g_dataElements);
-      g_dataElements = NULL;
+      return lo;
    }
-   if (g_dataModels) {
-      free(g_dataModels);
-      g_dataModels = NULL;
+
+   // Find the first bucket whose header sorts after name; the answer lies in
+   // the bucket before it or at its start.
+   int lo = 0, hi = dict->numBuckets;
+   while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (strcmp((const char *)dict->data + dict->bucketOffsets[mid], name) <= 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
    }
-   if (g_rbusHandle) {
-      rbus_close(g_rbusHandle);
-      g_rbusHandle = NULL;
+   if (lo == 0) {
+      return 0;
+   }
+
+   int bucket = lo - 1;
+   int id = bucket * NAME_DICT_BUCKET_SIZE;
+   int end = id + NAME_DICT_BUCKET_SIZE < dict->count ? id + NAME_DICT_BUCKET_SIZE : dict->count;
+   char buf[MAX_NAME_LEN];
+   const uint8_t *p = dict->data + dict->bucketOffsets[bucket];
+   size_t len = strlen((const char *)p);
+   memcpy(buf, p, len + 1);
+   p += len + 1;
+   for (;;) {
+      if (strcmp(buf, name) >= 0) {
+         return id;
+      }
+      if (++id >= end) {
+         return id;
+      }
+      uint32_t lcp = getVarint(&p);
+      uint32_t suffixLen = getVarint(&p);
+      memcpy(buf + lcp, p, suffixLen);
+      buf[lcp + suffixLen] = '\0';
+      p += suffixLen;
    }
 }
 
-int main(int argc, char *argv[]) {
+// Returns the id of name, or -1 if it is not in the dictionary
+static int nameDictFind(const NameDict *dict, const char *name) {
+   int id = nameDictLowerBound(dict, name);
+   if (id < dict->count) {
+      char buf[MAX_NAME_LEN];
+      if (strcmp(nameDictGet(dict, id, buf), name) == 0) {
+         return id;
+      }
+   }
+   return -1;
+}
 
-   // Set up signal handlers
-   signal(SIGINT, signal_handler);
-   signal(SIGTERM, signal_handler);
+static int compareDataModelNames(const void *a, const void *b) {
+   return strcmp(((const DataModel *)a)->name, ((const DataModel *)b)->name);
+}
 
-   // Load data models from JSON
-   if (!loadDataModelsFromJson((argc == 2)?argv[1]:JSON_FILE)) {
-      fprintf(stderr, "Failed to load data models from %s\n", argv[1]);
-      return 1;
+// Sort the data models by name and move their names into the name dictionary,
+// so a data model's index doubles as its name id
+static bool buildNameDictionary(void) {
+   qsort(g_dataModels, g_totalDataModels, sizeof(DataModel), compareDataModelNames);
+
+   const char **names = (const char **)calloc(g_totalDataModels, sizeof(char *));
+   if (!names) {
+      fprintf(stderr, "Failed to allocate memory for name dictionary\n");
+      return false;
+   }
+   size_t rawLen = 0;
+   for (int i = 0; i < g_totalDataModels; i++) {
+      names[i] = g_dataModels[i].name;
+      rawLen += strlen(names[i]) + 1;
    }
 
-   rbusError_t rc = rbus_open(&g_rbusHandle, "rbus-datamodels");
-   if (rc != RBUS_ERROR_SUCCESS) {
-      fprintf(stderr, "Failed to open rbus: %d\n", rc);
-      cleanup();
-      return 1;
+   if (!nameDictBuild(&g_nameDict, g_nameDictMode, names, g_totalDataModels)) {
+      fprintf(stderr, "Failed to build name dictionary\n");
+      free(names);
+      return false;
    }
+   free(names);
 
-   // Dynamically allocate memory for dataElements
-   g_dataElements = (rbusDataElement_t *)malloc(g_totalDataModels * sizeof(rbusDataElement_t));
-   if (!g_dataElements) {
-      fprintf(stderr, "Failed to allocate memory for data elements\n");
-      cleanup();
+   for (int i = 0; i < g_totalDataModels; i++) {
+      free((void *)g_dataModels[i].name);
+      g_dataModels[i].name = NULL;
+   }
+
+   printf("Name dictionary (%s): %d names, %zu bytes (%zu bytes raw)\n",
+      g_nameDictMode == NAME_DICT_FRONT_CODED ? "front-coded" : "plain",
+      g_totalDataModels, nameDictBytes(&g_nameDict), rawLen);
+   return true;
+}
+
+// Returns the name of g_dataModels[i]; buf must hold MAX_NAME_LEN bytes
+static const char *dataModelName(int i, char *buf) {
+   return nameDictGet(&g_nameDict, i, buf);
+}
+
+// Returns the first data model index whose name is >= name
+static int lowerBoundName(const char *name) {
+   return nameDictLowerBound(&g_nameDict, name);
+}
+
+// Returns the g_dataModels index for name, or -1 if it is not registered
+static int findDataModel(const char *name) {
+   return nameDictFind(&g_nameDict, name);
+}
+
+static int compareNames(const void *a, const void *b) {
+   return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+// Compare memory and lookup latency of the plain and front-coded dictionaries
+// on count synthetic names, derived from the loaded model by inserting an
+// instance number before the last path segment of each name.
+static int benchNameDictionaries(int count) {
+   char **names = (char **)malloc(count * sizeof(char *));
+   if (!names) {
+      fprintf(stderr, "Failed to allocate memory for benchmark names\n");
       return 1;
    }
 
-   for (int i = 0; i < g_totalDataModels; i++) {
-      g_dataElements[i].name = strdup(g_dataModels[i].name);
-      if (!g_dataElements[i].name) {
-         fprintf(stderr, "Failed to allocate memory for data element name\n");
-         cleanup();
+   size_t rawLen = 0;
+   char buf[MAX_NAME_LEN];
+   for (int n = 0; n < count; n++) {
+      const char *base = dataModelName(n % g_totalDataModels, buf);
+      const char *leaf = strrchr(base, '.');
+      int stem = leaf ? (int)(leaf - base) : (int)strlen(base);
+      char name[MAX_NAME_LEN + 16];
+      snprintf(name, sizeof(name), "%.*s.%d%s", stem, base, n / g_totalDataModels + 1, leaf ? leaf : "");
+      names[n] = strndup(name, MAX_NAME_LEN - 1);
+      if (!names[n]) {
+         fprintf(stderr, "Failed to allocate memory for benchmark names\n");
+         while (n--) {
+            free(names[n]);
+         }
+         free(names);
          return 1;
       }
-      g_dataElements[i].type = RBUS_ELEMENT_TYPE_PROPERTY;
-      g_dataElements[i].cbTable.getHandler = g_dataModels[i].getHandler ? g_dataModels[i].getHandler : getHandler;
-      g_dataElements[i].cbTable.setHandler = g_dataModels[i].setHandler ? g_dataModels[i].setHandler : setHandler;
-      g_dataElements[i].cbTable.eventSubHandler = eventSubHandler;
+      rawLen += strlen(names[n]) + 1;
    }
+   qsort(names, count, sizeof(char *), compareNames);
 
-   rc = rbus_regDataElements(g_rbusHandle, g_totalDataModels, g_dataElements);
-   if (rc != RBUS_ERROR_SUCCESS) {
-      fprintf(stderr, "Failed to register data elements: %d\n", rc);
-      cleanup();
+   // Queries are a fixed pseudo-random permutation so both runs see the same work
+   int numQueries = count < 1000000 ? count : 1000000;
+   int *queries = (int *)malloc(numQueries * sizeof(int));
+   if (!queries) {
+      fprintf(stderr, "Failed to allocate memory for benchmark queries\n");
+      for (int n = 0; n < count; n++) {
+         free(names[n]);
+      }
+      free(names);
       return 1;
    }
+   uint32_t seed = 12345;
+   for (int q = 0; q < numQueries; q++) {
+      seed = seed * 1103515245 + 12345;
+      queries[q] = (int)((seed >> 8) % (uint32_t)count);
+   }
 
-   printf("Successfully registered %d data models\n", g_totalDataModels);
+   printf("%d names, %zu bytes raw\n", count, rawLen);
+   printf("%-12s %12s %8s %10s %10s %10s\n", "dictionary", "bytes", "%raw", "build ms", "find ns", "get ns");
 
-   // Set each data model's value
-   for (int i = 0; i < g_totalDataModels; i++) {
-      rbusValue_t value;
-      rbusValue_Init(&value);
-      switch (g_dataModels[i].type) {
-      case TYPE_STRING:
-      case TYPE_DATETIME:
-      case TYPE_BASE64:
-         rbusValue_SetString(value, g_dataModels[i].value.strVal);
-         break;
-      case TYPE_INT:
-         rbusValue_SetInt32(value, g_dataModels[i].value.intVal);
-         break;
-      case TYPE_UINT:
-         rbusValue_SetUInt32(value, g_dataModels[i].value.uintVal);
-         break;
-      case TYPE_BOOL:
-         rbusValue_SetBoolean(value, g_dataModels[i].value.boolVal);
-         break;
-      case TYPE_LONG:
-         rbusValue_SetInt64(value, g_dataModels[i].value.longVal);
-         break;
-      case TYPE_ULONG:
-         rbusValue_SetUInt64(value, g_dataModels[i].value.ulongVal);
-         break;
-      case TYPE_FLOAT:
-         rbusValue_SetSingle(value, g_dataModels[i].value.floatVal);
-         break;
-      case TYPE_DOUBLE:
-         rbusValue_SetDouble(value, g_dataModels[i].value.doubleVal);
-         break;
-      case TYPE_BYTE:
-         rbusValue_SetByte(value, g_dataModels[i].value.byteVal);
+   const NameDictMode modes[] = {NAME_DICT_PLAIN, NAME_DICT_FRONT_CODED};
+   int rc = 0;
+   for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+      NameDict dict;
+      uint64_t start = realMonotonicNs();
+      if (!nameDictBuild(&dict, modes[m], (const char *const *)names, count)) {
+         fprintf(stderr, "Failed to build name dictionary\n");
+         rc = 1;
          break;
       }
+      uint64_t buildNs = realMonotonicNs() - start;
 
-      rbusSetOptions_t opts = {.commit = true};
-      rc = rbus_set(g_rbusHandle, g_dataModels[i].name, value, &opts);
-      if (rc != RBUS_ERROR_SUCCESS) {
-         fprintf(stderr, "Failed to set %s: %d\n", g_dataModels[i].name, rc);
+      start = realMonotonicNs();
+      for (int q = 0; q < numQueries; q++) {
+         if (nameDictFind(&dict, names[queries[q]]) < 0) {
+            fprintf(stderr, "Lookup failed for %s\n", names[queries[q]]);
+            rc = 1;
+         }
       }
-      rbusValue_Release(value);
+      uint64_t findNs = realMonotonicNs() - start;
+
+      volatile char sink = 0;
+      start = realMonotonicNs();
+      for (int q = 0; q < numQueries; q++) {
+         sink = nameDictGet(&dict, queries[q], buf)[0];
+      }
+      (void)sink;
+      uint64_t getNs = realMonotonicNs() - start;
+
+      size_t bytes = nameDictBytes(&dict);
+      printf("%-12s %12zu %7.1f%% %10.1f %10.1f %10.1f\n",
+         modes[m] == NAME_DICT_FRONT_CODED ? "front-coded" : "plain",
+         bytes, 100.0 * bytes / rawLen, buildNs / 1e6,
+         (double)findNs / numQueries, (double)getNs / numQueries);
+      nameDictFree(&dict);
    }
 
-   while (g_running) {
-      sleep(1);
+   free(queries);
+   for (int n = 0; n < count; n++) {
+      free(names[n]);
+   }
+   free(names);
+   return rc;
+}
+
+static SubTrieNode *subTrieNewNode(const char *segment, size_t len) {
+   SubTrieNode *node = (SubTrieNode *)calloc(1, sizeof(SubTrieNode) + len + 1);
+   if (node) {
+      memcpy(node->segment, segment, len);
+   }
+   return node;
+}
+
+static void subTrieFreeNode(SubTrieNode *node) {
+   for (uint32_t c = 0; c < node->numChildren; c++) {
+      subTrieFreeNode(node->children[c]);
+   }
+   free(node->children);
+   free(node);
+}
+
+// Compare a node's segment against the len-byte segment seg
+static int subTrieCompare(const SubTrieNode *node, const char *seg, size_t len) {
+   int cmp = strncmp(node->segment, seg, len);
+   if (cmp == 0 && node->segment[len] != '\0') {
+      cmp = 1;
+   }
+   return cmp;
+}
+
+// Binary search node's children for seg; *pos receives the insertion point
+static SubTrieNode *subTrieFindChild(const SubTrieNode *node, const char *seg, size_t len, uint32_t *pos) {
+   uint32_t lo = 0, hi = node->numChildren;
+   while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int cmp = subTrieCompare(node->children[mid], seg, len);
+      if (cmp == 0) {
+         if (pos) {
+            *pos = mid;
+         }
+         return node->children[mid];
+      }
+      if (cmp < 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (pos) {
+      *pos = lo;
+   }
+   return NULL;
+}
+
+// Add a subscription for pattern, e.g. "Device.Ethernet.Interface.*.Status",
+// "Device.DeviceInfo." or an exact parameter name
+static bool subTrieAdd(const char *pattern) {
+   if (!g_subTrie && !(g_subTrie = subTrieNewNode("", 0))) {
+      return false;
+   }
+
+   SubTrieNode *node = g_subTrie;
+   const char *seg = pattern;
+   for (;;) {
+      const char *dot = strchr(seg, '.');
+      size_t len = dot ? (size_t)(dot - seg) : strlen(seg);
+      if (len == 0) {
+         // Trailing "." - subscribe to the whole subtree
+         node->subtreeRefs++;
+         break;
+      }
+
+      uint32_t pos;
+      SubTrieNode *child = subTrieFindChild(node, seg, len, &pos);
+      if (!child) {
+         if (node->numChildren == node->capacity) {
+            uint32_t capacity = node->capacity ? node->capacity * 2 : 2;
+            SubTrieNode **children = (SubTrieNode **)realloc(node->children, capacity * sizeof(SubTrieNode *));
+            if (!children) {
+               return false;
+            }
+            node->children = children;
+            node->capacity = capacity;
+         }
+         if (!(child = subTrieNewNode(seg, len))) {
+            return false;
+         }
+         memmove(&node->children[pos + 1], &node->children[pos], (node->numChildren - pos) * sizeof(SubTrieNode *));
+         node->children[pos] = child;
+         node->numChildren++;
+      }
+      node = child;
+
+      if (!dot) {
+         node->exactRefs++;
+         break;
+      }
+      seg = dot + 1;
+   }
+   return true;
+}
+
+// Remove one subscription for pattern from the subtree at node, pruning nodes
+// that no longer carry any subscription. Returns true if a subscription was removed.
+static bool subTrieRemoveFrom(SubTrieNode *node, const char *seg) {
+   const char *dot = strchr(seg, '.');
+   size_t len = dot ? (size_t)(dot - seg) : strlen(seg);
+   if (len == 0) {
+      if (node->subtreeRefs == 0) {
+         return false;
+      }
+      node->subtreeRefs--;
+      return true;
+   }
+
+   uint32_t pos;
+   SubTrieNode *child = subTrieFindChild(node, seg, len, &pos);
+   if (!child) {
+      return false;
+   }
+
+   bool removed;
+   if (!dot) {
+      removed = child->exactRefs > 0;
+      if (removed) {
+         child->exactRefs--;
+      }
+   } else {
+      removed = subTrieRemoveFrom(child, dot + 1);
+   }
+
+   if (removed && child->exactRefs == 0 && child->subtreeRefs == 0 && child->numChildren == 0) {
+      subTrieFreeNode(child);
+      memmove(&node->children[pos], &node->children[pos + 1], (node->numChildren - pos - 1) * sizeof(SubTrieNode *));
+      node->numChildren--;
+   }
+   return removed;
+}
+
+static void subTrieRemove(const char *pattern) {
+   if (g_subTrie) {
+      subTrieRemoveFrom(g_subTrie, pattern);
+   }
+}
+
+// Returns true if any subscription matches the concrete name path. Only the
+// child for each segment of path and the "*" child are visited, so the cost
+// follows the depth of path rather than the number of subscriptions.
+static bool subTrieMatchFrom(const SubTrieNode *node, const char *path) {
+   if (node->subtreeRefs) {
+      return true;
+   }
+   if (*path == '\0') {
+      return node->exactRefs > 0;
+   }
+
+   const char *dot = strchr(path, '.');
+   size_t len = dot ? (size_t)(dot - path) : strlen(path);
+   const char *rest = dot ? dot + 1 : path + len;
+
+   const SubTrieNode *child = subTrieFindChild(node, path, len, NULL);
+   if (child && subTrieMatchFrom(child, rest)) {
+      return true;
+   }
+   if (node->numChildren && strcmp(node->children[0]->segment, "*") == 0 &&
+      node->children[0] != child && subTrieMatchFrom(node->children[0], rest)) {
+      return true;
+   }
+   return false;
+}
+
+static bool subTrieMatch(const char *name) {
+   pthread_mutex_lock(&g_subTrieLock);
+   bool match = g_subTrie && subTrieMatchFrom(g_subTrie, name);
+   pthread_mutex_unlock(&g_subTrieLock);
+   return match;
+}
+
+static void timerListInit(Timer *head) {
+   head->prev = head->next = head;
+}
+
+static void timerUnlink(Timer *timer) {
+   timer->prev->next = timer->next;
+   timer->next->prev = timer->prev;
+   timer->prev = timer->next = NULL;
+}
+
+static void timerWheelInit(void) {
+   for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      timerListInit(&g_timerWheel[slot]);
+   }
+   timerListInit(&g_timerExpired);
+   g_timerLastMs = monotonicMs();
+}
+
+// (Re)arm timer to call callback(arg) on the reactor thread after delayMs
+static void timerStart(Timer *timer, uint64_t delayMs, void (*callback)(void *), void *arg) {
+   uint64_t ticks = (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+   if (ticks == 0) {
+      ticks = 1;
+   }
+
+   pthread_mutex_lock(&g_timerLock);
+   if (timer->armed) {
+      timerUnlink(timer);
+   }
+   Timer *slot = &g_timerWheel[(g_timerTick + ticks) % TIMER_WHEEL_SLOTS];
+   timer->rounds = (uint32_t)((ticks - 1) / TIMER_WHEEL_SLOTS);
+   timer->callback = callback;
+   timer->arg = arg;
+   timer->armed = true;
+   timer->prev = slot->prev;
+   timer->next = slot;
+   slot->prev->next = timer;
+   slot->prev = timer;
+   pthread_mutex_unlock(&g_timerLock);
+}
+
+static void timerCancel(Timer *timer) {
+   pthread_mutex_lock(&g_timerLock);
+   if (timer->armed) {
+      timerUnlink(timer);
+      timer->armed = false;
+   }
+   pthread_mutex_unlock(&g_timerLock);
+}
+
+static bool timerArmed(Timer *timer) {
+   pthread_mutex_lock(&g_timerLock);
+   bool armed = timer->armed;
+   pthread_mutex_unlock(&g_timerLock);
+   return armed;
+}
+
+// Advance the wheel to nowMs and run the callbacks of every timer that expired.
+// Callbacks run without g_timerLock held, so they may start or cancel timers.
+static void timerAdvance(uint64_t nowMs) {
+   pthread_mutex_lock(&g_timerLock);
+   while (g_timerLastMs + TIMER_TICK_MS <= nowMs) {
+      g_timerLastMs += TIMER_TICK_MS;
+      g_timerTick++;
+      Timer *slot = &g_timerWheel[g_timerTick % TIMER_WHEEL_SLOTS];
+      for (Timer *timer = slot->next; timer != slot;) {
+         Timer *next = timer->next;
+         if (timer->rounds > 0) {
+            timer->rounds--;
+         } else {
+            timerUnlink(timer);
+            timer->prev = g_timerExpired.prev;
+            timer->next = &g_timerExpired;
+            g_timerExpired.prev->next = timer;
+            g_timerExpired.prev = timer;
+         }
+         timer = next;
+      }
+   }
+
+   while (g_timerExpired.next != &g_timerExpired) {
+      Timer *timer = g_timerExpired.next;
+      timerUnlink(timer);
+      timer->armed = false;
+      void (*callback)(void *) = timer->callback;
+      void *arg = timer->arg;
+      pthread_mutex_unlock(&g_timerLock);
+      callback(arg);
+      pthread_mutex_lock(&g_timerLock);
+   }
+   pthread_mutex_unlock(&g_timerLock);
+}
+
+#ifdef SIMULATED_CLOCK
+// Move the simulated clocks forward by ms, a timer tick at a time, running the
+// timers that expire on the way. Main thread only.
+static void clockAdvance(uint64_t ms) {
+   uint64_t targetNs = g_clockNs + ms * 1000000ULL;
+   while (g_clockNs < targetNs) {
+      uint64_t stepNs = targetNs - g_clockNs;
+      if (stepNs > TIMER_TICK_MS * 1000000ULL) {
+         stepNs = TIMER_TICK_MS * 1000000ULL;
+      }
+      __atomic_store_n(&g_clockNs, g_clockNs + stepNs, __ATOMIC_RELAXED);
+      timerAdvance(monotonicMs());
+   }
+}
+#endif
+
+static bool reactorAdd(int fd, short events, ReactorCallback callback, void *arg) {
+   if (g_reactorNumFds == REACTOR_MAX_FDS) {
+      return false;
+   }
+   g_reactorFds[g_reactorNumFds].fd = fd;
+   g_reactorFds[g_reactorNumFds].events = events;
+   g_reactorFds[g_reactorNumFds].revents = 0;
+   g_reactorCallbacks[g_reactorNumFds] = callback;
+   g_reactorArgs[g_reactorNumFds] = arg;
+   g_reactorNumFds++;
+   return true;
+}
+
+static void reactorModify(int fd, short events) {
+   for (int n = 0; n < g_reactorNumFds; n++) {
+      if (g_reactorFds[n].fd == fd) {
+         g_reactorFds[n].events = events;
+         return;
+      }
+   }
+}
+
+static void reactorRemove(int fd) {
+   for (int n = 0; n < g_reactorNumFds; n++) {
+      if (g_reactorFds[n].fd == fd) {
+         g_reactorFds[n].fd = -1;
+         g_reactorFds[n].revents = 0;
+         return;
+      }
+   }
+}
+
+// Wait up to timeoutMs for watched descriptors and run their callbacks
+static void reactorRun(int timeoutMs) {
+   int ready = poll(g_reactorFds, g_reactorNumFds, timeoutMs);
+   for (int n = 0; ready > 0 && n < g_reactorNumFds; n++) {
+      short revents = g_reactorFds[n].revents;
+      if (g_reactorFds[n].fd >= 0 && revents) {
+         ready--;
+         g_reactorCallbacks[n](g_reactorFds[n].fd, revents, g_reactorArgs[n]);
+      }
+   }
+
+   int kept = 0;
+   for (int n = 0; n < g_reactorNumFds; n++) {
+      if (g_reactorFds[n].fd >= 0) {
+         g_reactorFds[kept] = g_reactorFds[n];
+         g_reactorCallbacks[kept] = g_reactorCallbacks[n];
+         g_reactorArgs[kept] = g_reactorArgs[n];
+         kept++;
+      }
+   }
+   g_reactorNumFds = kept;
+}
+
+static bool setNonBlocking(int fd) {
+   int flags = fcntl(fd, F_GETFL, 0);
+   return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Coroutine bodies are written sequentially between CO_BEGIN and CO_END and
+// give the main loop back at each CO_WAIT_FD. Resume points are
+// switch cases, so a body must not wait inside a switch statement of its own.
+#define CO_BEGIN(co) switch ((co)->line) { case 0:
+#define CO_END(co) } return true
+#define CO_EXIT(co) return true
+#define CO_WAIT_FD(co, waitFd, events, timeoutMs) \
+   do { \
+      (co)->line = __LINE__; \
+      if (coWaitFd((co), (waitFd), (events), (timeoutMs))) { \
+         return false; \
+      } \
+      case __LINE__:; \
+   } while (0)
+
+// The descriptor a coroutine last waited on stays registered while its body
+// runs, so that waiting on it again only changes the events. It is removed
+// when the body waits on another descriptor or finishes.
+static void coForgetFd(Coroutine *co) {
+   if (co->fd >= 0) {
+      reactorRemove(co->fd);
+      co->fd = -1;
+   }
+}
+
+static void coResume(Coroutine *co) {
+   if (co->run(co)) {
+      coForgetFd(co);
+      if (co->done) {
+         co->done(co);
+      }
+   }
+}
+
+static void coFdReady(int fd, short revents, void *arg) {
+   (void)fd;
+   Coroutine *co = arg;
+   timerCancel(&co->timer);
+   co->revents = revents;
+   coResume(co);
+}
+
+static void coTimeout(void *arg) {
+   Coroutine *co = arg;
+   if (timerArmed(&co->timer)) {
+      return;
+   }
+   co->revents = 0;
+   coResume(co);
+}
+
+// Wait for events on fd, for at most timeoutMs unless it is 0. If the reactor
+// is full the wait ends at once with revents 0, as if it had timed out.
+static bool coWaitFd(Coroutine *co, int fd, short events, uint64_t timeoutMs) {
+   if (co->fd == fd) {
+      reactorModify(fd, events);
+   } else {
+      coForgetFd(co);
+      if (!reactorAdd(fd, events, coFdReady, co)) {
+         co->revents = 0;
+         return false;
+      }
+      co->fd = fd;
+   }
+   if (timeoutMs > 0) {
+      timerStart(&co->timer, timeoutMs, coTimeout, co);
+   }
+   return true;
+}
+
+// Run co until its first wait; done(co) is called once the body finishes.
+// Main thread only, so other threads start coroutines from a timer callback.
+static void coStart(Coroutine *co, bool (*run)(Coroutine *), void (*done)(Coroutine *), void *arg) {
+   co->run = run;
+   co->done = done;
+   co->arg = arg;
+   co->line = 0;
+   co->fd = -1;
+   co->revents = 0;
+   coResume(co);
+}
+
+// Stop a suspended coroutine without resuming it
+static void coCancel(Coroutine *co) {
+   timerCancel(&co->timer);
+   coForgetFd(co);
+}
+
+enum { SCHED_TASK_IDLE, SCHED_TASK_QUEUED, SCHED_TASK_RUNNING, SCHED_TASK_RERUN };
+
+static void schedInit(SchedTask *task, SchedClass priority, void (*run)(void *), void *arg) {
+   memset(task, 0, sizeof(*task));
+   task->run = run;
+   task->arg = arg;
+   task->priority = priority;
+   task->state = SCHED_TASK_IDLE;
+}
+
+// Queue task on the first worker from first on with room in its class
+static bool schedPush(SchedTask *task, uint32_t first) {
+   task->queuedNs = monotonicNs();
+   for (int n = 0; n < g_schedNumWorkers; n++) {
+      SchedWorker *worker = &g_schedWorkers[(first + n) % g_schedNumWorkers];
+      pthread_mutex_lock(&worker->lock);
+      bool queued = worker->tail[task->priority] - worker->head[task->priority] < SCHED_QUEUE_SIZE;
+      if (queued) {
+         worker->queue[task->priority][worker->tail[task->priority]++ % SCHED_QUEUE_SIZE] = task;
+      }
+      pthread_mutex_unlock(&worker->lock);
+      if (queued) {
+         pthread_mutex_lock(&g_schedLock);
+         g_schedGeneration++;
+         pthread_cond_signal(&g_schedCond);
+         pthread_mutex_unlock(&g_schedLock);
+         return true;
+      }
+   }
+   return false;
+}
+
+// Run task on the calling thread, RUNNING throughout so that submitting it
+// meanwhile queues one more run rather than a concurrent one
+static void schedRunHere(SchedTask *task) {
+   int state;
+   do {
+      __atomic_store_n(&task->state, SCHED_TASK_RUNNING, __ATOMIC_RELEASE);
+      task->run(task->arg);
+      state = SCHED_TASK_RUNNING;
+   } while (!__atomic_compare_exchange_n(&task->state, &state, SCHED_TASK_IDLE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+// Run task on a worker; callable from any thread. A task submitted while it
+// runs runs once more afterwards. Without workers, before schedStart() or on
+// the simulated clock, or when every queue of its class is full, it runs at
+// once on the calling thread. Once schedStop() has begun, tasks are dropped.
+static void schedSubmit(SchedTask *task) {
+   if (__atomic_load_n(&g_schedStopping, __ATOMIC_ACQUIRE)) {
+      return;
+   }
+   int state = __atomic_load_n(&task->state, __ATOMIC_ACQUIRE);
+   int next;
+   do {
+      next = state == SCHED_TASK_IDLE ? SCHED_TASK_QUEUED : state == SCHED_TASK_RUNNING ? SCHED_TASK_RERUN : state;
+      if (next == state) {
+         return;
+      }
+   } while (!__atomic_compare_exchange_n(&task->state, &state, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+   if (next == SCHED_TASK_QUEUED && !schedPush(task, __atomic_fetch_add(&g_schedNextWorker, 1, __ATOMIC_RELAXED))) {
+      schedRunHere(task);
+   }
+}
+
+static void schedTimerExpired(void *arg) {
+   SchedTask *task = arg;
+   if (!timerArmed(&task->timer)) {
+      schedSubmit(task);
+   }
+}
+
+// Submit task after delayMs on the timer wheel
+static void schedAfter(SchedTask *task, uint64_t delayMs) {
+   timerStart(&task->timer, delayMs, schedTimerExpired, task);
+}
+
+static bool schedClaimClass(SchedClass priority) {
+   int running = __atomic_load_n(&g_schedClassRunning[priority], __ATOMIC_RELAXED);
+   while (running < g_schedClassLimit[priority]) {
+      if (__atomic_compare_exchange_n(&g_schedClassRunning[priority], &running, running + 1, false,
+         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// Take the oldest task of the highest class that has a worker to spare, from
+// the worker's own queue or else by stealing from another's
+static SchedTask *schedTake(int self) {
+   for (int priority = 0; priority < NUM_SCHED_CLASSES; priority++) {
+      if (!schedClaimClass(priority)) {
+         continue;
+      }
+      for (int n = 0; n < g_schedNumWorkers; n++) {
+         SchedWorker *worker = &g_schedWorkers[(self + n) % g_schedNumWorkers];
+         SchedTask *task = NULL;
+         pthread_mutex_lock(&worker->lock);
+         if (worker->head[priority] != worker->tail[priority]) {
+            task = worker->queue[priority][worker->head[priority]++ % SCHED_QUEUE_SIZE];
+         }
+         pthread_mutex_unlock(&worker->lock);
+         if (task) {
+            return task;
+         }
+      }
+      __atomic_fetch_sub(&g_schedClassRunning[priority], 1, __ATOMIC_ACQ_REL);
+   }
+   return NULL;
+}
+
+static void schedRun(SchedTask *task, int self) {
+   SchedStats *stats = &g_schedStats[task->priority];
+   uint64_t latencyNs = monotonicNs() - task->queuedNs;
+   uint64_t maxLatencyNs = __atomic_load_n(&stats->maxLatencyNs, __ATOMIC_RELAXED);
+   while (latencyNs > maxLatencyNs && !__atomic_compare_exchange_n(&stats->maxLatencyNs, &maxLatencyNs, latencyNs,
+      false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+   }
+   __atomic_fetch_add(&stats->latencyNs, latencyNs, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&stats->tasks, 1, __ATOMIC_RELAXED);
+
+   __atomic_store_n(&task->state, SCHED_TASK_RUNNING, __ATOMIC_RELEASE);
+   task->run(task->arg);
+   int state = SCHED_TASK_RUNNING;
+   if (!__atomic_compare_exchange_n(&task->state, &state, SCHED_TASK_IDLE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      // Submitted again while it ran
+      __atomic_store_n(&task->state, SCHED_TASK_QUEUED, __ATOMIC_RELEASE);
+      if (!schedPush(task, (uint32_t)self)) {
+         schedRunHere(task);
+      }
+   }
+}
+
+static void *schedWorker(void *arg) {
+   int self = (int)(intptr_t)arg;
+   for (;;) {
+      pthread_mutex_lock(&g_schedLock);
+      uint64_t generation = g_schedGeneration;
+      bool stopping = g_schedStopping;
+      pthread_mutex_unlock(&g_schedLock);
+      if (stopping) {
+         return NULL;
+      }
+
+      SchedTask *task = schedTake(self);
+      if (task) {
+         SchedClass priority = task->priority;
+         schedRun(task, self);
+         // Wake the workers if tasks of this class were held back by its limit
+         if (__atomic_fetch_sub(&g_schedClassRunning[priority], 1, __ATOMIC_ACQ_REL) == g_schedClassLimit[priority]) {
+            pthread_mutex_lock(&g_schedLock);
+            g_schedGeneration++;
+            pthread_cond_broadcast(&g_schedCond);
+            pthread_mutex_unlock(&g_schedLock);
+         }
+         continue;
+      }
+
+      pthread_mutex_lock(&g_schedLock);
+      while (!g_schedStopping && g_schedGeneration == generation) {
+         pthread_cond_wait(&g_schedCond, &g_schedLock);
+      }
+      pthread_mutex_unlock(&g_schedLock);
+   }
+}
+
+// Numeric values are read atomically because AtomicUpdate() may modify them
+// while the store lock is only held shared
+static void dataModelToValue(const DataModel *dm, rbusValue_t value) {
+   switch (dm->type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      rbusValue_SetString(value, dm->value.strVal);
+      break;
+   case TYPE_INT:
+      rbusValue_SetInt32(value, __atomic_load_n(&dm->value.intVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_UINT:
+      rbusValue_SetUInt32(value, __atomic_load_n(&dm->value.uintVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_BOOL:
+      rbusValue_SetBoolean(value, dm->value.boolVal);
+      break;
+   case TYPE_LONG:
+      rbusValue_SetInt64(value, __atomic_load_n(&dm->value.longVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_ULONG:
+      rbusValue_SetUInt64(value, __atomic_load_n(&dm->value.ulongVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_FLOAT: {
+      float f;
+      __atomic_load(&dm->value.floatVal, &f, __ATOMIC_RELAXED);
+      rbusValue_SetSingle(value, f);
+      break;
+   }
+   case TYPE_DOUBLE: {
+      double d;
+      __atomic_load(&dm->value.doubleVal, &d, __ATOMIC_RELAXED);
+      rbusValue_SetDouble(value, d);
+      break;
+   }
+   case TYPE_BYTE:
+      rbusValue_SetByte(value, __atomic_load_n(&dm->value.byteVal, __ATOMIC_RELAXED));
+      break;
+   }
+}
+
+#ifdef HAVE_RBUS_RAWDATA
+// Publish the new value of a high-rate parameter as its string form to raw-data
+// subscribers, which skips building and encoding an event object
+static void publishRawValue(const char *name, rbusValue_t newValue) {
+   char *str = rbusValue_ToString(newValue, NULL, 0);
+   if (!str) {
+      return;
+   }
+   rbusEventRawData_t event = {0};
+   event.name = name;
+   event.rawData = str;
+   event.rawDataLen = strlen(str);
+   rbusError_t rc = rbusEvent_PublishRawData(g_rbusHandle, &event);
+   if (rc != RBUS_ERROR_SUCCESS && rc != RBUS_ERROR_NOSUBSCRIBERS) {
+      fprintf(stderr, "Failed to publish raw data for %s: %d\n", name, rc);
+   }
+   free(str);
+}
+#endif
+
+static uint32_t flightPhase(uint64_t startNs, uint64_t ns) {
+   if (ns == 0) {
+      return 0;
+   }
+   return ns - startNs > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns - startNs);
+}
+
+// Copy the complete records in the ring to records, oldest first, and return
+// how many there were. Slots being rewritten while they are copied are skipped.
+static int flightCopy(FlightRecord *records) {
+   uint64_t end = __atomic_load_n(&g_flightNext, __ATOMIC_RELAXED);
+   uint64_t first = end > FLIGHT_RECORDS ? end - FLIGHT_RECORDS : 0;
+   int count = 0;
+   for (uint64_t seq = first; seq < end; seq++) {
+      FlightRecord *r = &g_flightRing[seq % FLIGHT_RECORDS];
+      if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+         continue;
+      }
+      records[count] = *r;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq + 1) {
+         count++;
+      }
+   }
+   return count;
+}
+
+// A record took longer than the latency SLO: snapshot the ring and queue a
+// dump, at most one every FLIGHT_SLO_DUMP_INTERVAL_MS so that a slow spell
+// doesn't keep rewriting it
+static void flightSloBreached(uint64_t seq, uint64_t nowNs) {
+   uint64_t last = __atomic_load_n(&g_flightLastSloDumpNs, __ATOMIC_RELAXED);
+   if (last != 0 && nowNs - last < FLIGHT_SLO_DUMP_INTERVAL_MS * 1000000ULL) {
+      return;
+   }
+   int state = FLIGHT_SNAPSHOT_FREE;
+   if (!__atomic_compare_exchange_n(&g_flightSnapshotState, &state, FLIGHT_SNAPSHOT_FILLING, false,
+      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return;
+   }
+   __atomic_store_n(&g_flightLastSloDumpNs, nowNs, __ATOMIC_RELAXED);
+   g_flightBreachSeq = seq;
+   g_flightSnapshotCount = flightCopy(g_flightSnapshot);
+   __atomic_store_n(&g_flightSnapshotState, FLIGHT_SNAPSHOT_READY, __ATOMIC_RELEASE);
+   schedSubmit(&g_flightDumpTask);
+}
+
+// Add an operation on g_dataModels[model] that started at startNs and ends
+// now to the flight recorder. lockedNs and storedNs are when the store lock
+// was taken and released, or 0. injected tells that a fault rule delayed the
+// operation on purpose; such a record cannot breach the SLO, which would
+// otherwise copy the ring on the very thread the rule holds up. Callable from
+// any thread; call it after releasing g_storeLock.
+static void flightRecord(FlightOp op, int model, const char *requester, uint64_t startNs, uint64_t lockedNs,
+   uint64_t storedNs, rbusError_t result, bool injected) {
+   uint64_t doneNs = monotonicNs();
+   uint64_t seq = __atomic_fetch_add(&g_flightNext, 1, __ATOMIC_RELAXED);
+   FlightRecord *r = &g_flightRing[seq % FLIGHT_RECORDS];
+   __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   r->startNs = startNs;
+   r->lockedNs = flightPhase(startNs, lockedNs);
+   r->storedNs = flightPhase(startNs, storedNs);
+   r->doneNs = flightPhase(startNs, doneNs);
+   r->model = model;
+   r->result = (int16_t)result;
+   r->op = (uint8_t)op;
+   r->injected = injected;
+   if (requester) {
+      strncpy(r->requester, requester, FLIGHT_REQUESTER_LEN - 1);
+      r->requester[FLIGHT_REQUESTER_LEN - 1] = '\0';
+   } else {
+      r->requester[0] = '\0';
+   }
+   __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+
+   if (g_flightSloNs && !injected && doneNs - startNs > g_flightSloNs) {
+      flightSloBreached(seq + 1, doneNs);
+   }
+}
+
+static void sendValueChange(const char *name, rbusValue_t newValue, rbusValue_t oldValue, const char *by) {
+   uint64_t startNs = monotonicNs();
+   int i = findDataModel(name);
+#ifdef HAVE_RBUS_RAWDATA
+   if (i >= 0 && g_dataModels[i].highRate) {
+      publishRawValue(name, newValue);
+   }
+#endif
+
+   rbusObject_t data;
+   rbusObject_Init(&data, NULL);
+   rbusObject_SetValue(data, "value", newValue);
+   if (oldValue) {
+      rbusObject_SetValue(data, "oldValue", oldValue);
+   }
+   if (by) {
+      rbusValue_t byValue;
+      rbusValue_Init(&byValue);
+      rbusValue_SetString(byValue, by);
+      rbusObject_SetValue(data, "by", byValue);
+      rbusValue_Release(byValue);
+   }
+
+   rbusEvent_t event = {0};
+   event.name = name;
+   event.type = RBUS_EVENT_VALUE_CHANGED;
+   event.data = data;
+   rbusError_t rc = rbusEvent_Publish(g_rbusHandle, &event);
+   if (rc != RBUS_ERROR_SUCCESS && rc != RBUS_ERROR_NOSUBSCRIBERS) {
+      fprintf(stderr, "Failed to publish value change for %s: %d\n", name, rc);
+   }
+   rbusObject_Release(data);
+   flightRecord(FLIGHT_PUBLISH, i, by, startNs, 0, 0, rc, false);
+}
+
+// Whether name matches a fault rule pattern: "*" matches any one segment, and
+// a pattern ending in "." matches the whole subtree below it
+static bool faultPatternMatch(const char *pattern, const char *name) {
+   while (*pattern) {
+      if (pattern[0] == '*' && (pattern[1] == '.' || pattern[1] == '\0')) {
+         if (*name == '\0' || *name == '.') {
+            return false;
+         }
+         const char *end = strchr(name, '.');
+         name = end ? end : name + strlen(name);
+         pattern++;
+      } else if (*pattern != *name) {
+         return false;
+      } else if (pattern[0] == '.' && pattern[1] == '\0') {
+         return true;
+      } else {
+         pattern++;
+         name++;
+      }
+   }
+   return *name == '\0';
+}
+
+// Uniform in [0, 1), from a per-thread xorshift generator
+static double faultRandom(void) {
+   static __thread uint64_t state = 0;
+   if (state == 0) {
+      state = (monotonicNs() ^ (uint64_t)(uintptr_t)&state) | 1;
+   }
+   state ^= state >> 12;
+   state ^= state << 25;
+   state ^= state >> 27;
+   return (double)((state * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+// Draw the fault for op on name from the first rule that matches it. Returns
+// the error to answer with, or RBUS_ERROR_SUCCESS, and sets *delayMs to the
+// latency to add and *drop if an event is to be discarded.
+static rbusError_t faultCheck(uint32_t op, const char *name, uint32_t *delayMs, bool *drop) {
+   *delayMs = 0;
+   *drop = false;
+   if (!g_faultEnabled || __atomic_load_n(&g_faultNumRules, __ATOMIC_RELAXED) == 0) {
+      return RBUS_ERROR_SUCCESS;
+   }
+
+   FaultRule *rule = NULL;
+   FaultRule copy;
+   pthread_mutex_lock(&g_faultLock);
+   for (int r = 0; r < g_faultNumRules && !rule; r++) {
+      if ((g_faultRules[r].ops & op) && faultPatternMatch(g_faultRules[r].pattern, name)) {
+         copy = g_faultRules[r];
+         rule = &copy;
+      }
+   }
+   pthread_mutex_unlock(&g_faultLock);
+   if (!rule) {
+      return RBUS_ERROR_SUCCESS;
+   }
+
+   double ms = rule->latencyMs;
+   if (rule->latency == FAULT_UNIFORM) {
+      ms += faultRandom() * (rule->latencyMaxMs - rule->latencyMs);
+   } else if (rule->latency == FAULT_EXPONENTIAL) {
+      ms = -log(1.0 - faultRandom()) * rule->latencyMs;
+      if (rule->latencyMaxMs && ms > rule->latencyMaxMs) {
+         ms = rule->latencyMaxMs;
+      }
+   }
+   *delayMs = ms < FAULT_MAX_LATENCY_MS ? (uint32_t)(ms + 0.5) : FAULT_MAX_LATENCY_MS;
+   *drop = faultRandom() * 100 < rule->dropPercent;
+   return faultRandom() * 100 < rule->errorPercent ? rule->error : RBUS_ERROR_SUCCESS;
+}
+
+// Apply the fault rule for a get or set of name: hold the calling thread for
+// its latency and return its error, if any. rbus takes the answer to a get or
+// set from the handler's return, so unlike method responses and events these
+// cannot wait on the timer wheel. The latency is capped at
+// FAULT_MAX_BLOCKING_MS and cut short on shutdown. *delayed tells whether
+// there was one.
+static rbusError_t faultApply(uint32_t op, const char *name, bool *delayed) {
+   *delayed = false;
+   if (!g_faultEnabled) {
+      return RBUS_ERROR_SUCCESS;
+   }
+   uint32_t delayMs;
+   bool drop;
+   rbusError_t rc = faultCheck(op, name, &delayMs, &drop);
+   if (delayMs > FAULT_MAX_BLOCKING_MS) {
+      delayMs = FAULT_MAX_BLOCKING_MS;
+   }
+   *delayed = delayMs > 0;
+   while (delayMs > 0 && g_running) {
+      uint32_t sliceMs = delayMs < TIMER_TICK_MS ? delayMs : TIMER_TICK_MS;
+      struct timespec ts = {0, sliceMs * 1000000L};
+      while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+      }
+      delayMs -= sliceMs;
+   }
+   return rc;
+}
+
+static void faultDeferredFree(FaultDeferred *d) {
+   if (d->results) {
+      rbusObject_Release(d->results);
+   }
+   if (d->newValue) {
+      rbusValue_Release(d->newValue);
+   }
+   if (d->oldValue) {
+      rbusValue_Release(d->oldValue);
+   }
+   free(d->name);
+   free(d->by);
+   free(d);
+}
+
+// Timer callback: send the method response or publish the event
+static void faultDeferredExpired(void *arg) {
+   FaultDeferred *d = arg;
+   pthread_mutex_lock(&g_faultLock);
+   d->prev->next = d->next;
+   d->next->prev = d->prev;
+   pthread_mutex_unlock(&g_faultLock);
+   if (d->asyncHandle) {
+      rbusMethod_SendAsyncResponse(d->asyncHandle, d->error, d->results);
+   } else {
+      sendValueChange(d->name, d->newValue, d->oldValue, d->by);
+   }
+   faultDeferredFree(d);
+}
+
+// Once faultStop() has run, a method response is sent at once and an event dropped
+static void faultDefer(FaultDeferred *d, uint32_t delayMs) {
+   pthread_mutex_lock(&g_faultLock);
+   if (g_faultStopping) {
+      pthread_mutex_unlock(&g_faultLock);
+      if (d->asyncHandle) {
+         rbusMethod_SendAsyncResponse(d->asyncHandle, d->error, d->results);
+      }
+      faultDeferredFree(d);
+      return;
+   }
+   d->prev = g_faultDeferred.prev;
+   d->next = &g_faultDeferred;
+   g_faultDeferred.prev->next = d;
+   g_faultDeferred.prev = d;
+   timerStart(&d->timer, delayMs, faultDeferredExpired, d);
+   pthread_mutex_unlock(&g_faultLock);
+}
+
+// Hold back a value-change event for delayMs, with copies of its values
+static void faultDeferEvent(const char *name, rbusValue_t newValue, rbusValue_t oldValue, const char *by, uint32_t delayMs) {
+   FaultDeferred *d = calloc(1, sizeof(*d));
+   if (!d || !(d->name = strdup(name)) || (by && !(d->by = strdup(by)))) {
+      if (d) {
+         faultDeferredFree(d);
+      }
+      sendValueChange(name, newValue, oldValue, by);
+      return;
+   }
+   rbusValue_Init(&d->newValue);
+   rbusValue_Copy(d->newValue, newValue);
+   if (oldValue) {
+      rbusValue_Init(&d->oldValue);
+      rbusValue_Copy(d->oldValue, oldValue);
+   }
+   faultDefer(d, delayMs);
+}
+
+// Publish a value-change event for name if any subscription in the trie matches it
+static void publishValueChange(const char *name, rbusValue_t newValue, rbusValue_t oldValue, const char *by) {
+   if (!subTrieMatch(name)) {
+      return;
+   }
+
+   uint32_t delayMs;
+   bool drop;
+   faultCheck(FAULT_EVENT, name, &delayMs, &drop);
+   if (drop) {
+      return;
+   }
+   if (delayMs) {
+      faultDeferEvent(name, newValue, oldValue, by, delayMs);
+      return;
+   }
+   sendValueChange(name, newValue, oldValue, by);
+}
+
+// Callback for handling get requests
+rbusError_t getHandler(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t *options) {
+   uint64_t startNs = monotonicNs();
+   const char *requester = options ? options->requestingComponent : NULL;
+   char const *name = rbusProperty_GetName(property);
+   int i = findDataModel(name);
+   if (i < 0) {
+      flightRecord(FLIGHT_GET, -1, requester, startNs, 0, 0, RBUS_ERROR_INVALID_INPUT, false);
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   bool injected;
+   rbusError_t rc = faultApply(FAULT_GET, name, &injected);
+   if (rc != RBUS_ERROR_SUCCESS) {
+      flightRecord(FLIGHT_GET, i, requester, startNs, 0, 0, rc, injected);
+      return rc;
+   }
+
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   pthread_rwlock_rdlock(&g_storeLock);
+   uint64_t lockedNs = monotonicNs();
+   dataModelToValue(&g_dataModels[i], value);
+   pthread_rwlock_unlock(&g_storeLock);
+   rbusProperty_SetValue(property, value);
+   rbusValue_Release(value);
+   flightRecord(FLIGHT_GET, i, requester, startNs, lockedNs, 0, RBUS_ERROR_SUCCESS, injected);
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Registered in place of live handlers other than proxyGetHandler() so that
+// their gets reach the flight recorder and fault injection
+static rbusError_t recordedLiveGetHandler(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t *options) {
+   uint64_t startNs = monotonicNs();
+   const char *requester = options ? options->requestingComponent : NULL;
+   int i = findDataModel(rbusProperty_GetName(property));
+   if (i < 0) {
+      flightRecord(FLIGHT_LIVE_GET, -1, requester, startNs, 0, 0, RBUS_ERROR_INVALID_INPUT, false);
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   bool injected;
+   rbusError_t rc = faultApply(FAULT_GET, rbusProperty_GetName(property), &injected);
+   if (rc == RBUS_ERROR_SUCCESS) {
+      rc = g_dataModels[i].getHandler(handle, property, options);
+   }
+   flightRecord(FLIGHT_LIVE_GET, i, requester, startNs, 0, 0, rc, injected);
+   return rc;
+}
+
+// Convert value ahead of storing it in g_dataModels[i]. String types are
+// converted into a newly allocated *str so that storeValue() cannot fail.
+static rbusError_t prepareStoreValue(int i, rbusValue_t value, char **str) {
+   *str = NULL;
+   switch (g_dataModels[i].type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      *str = rbusValue_ToString(value, NULL, 0);
+      if (!*str) {
+         return RBUS_ERROR_OUT_OF_RESOURCES;
+      }
+      break;
+   default:
+      break;
+   }
+   return RBUS_ERROR_SUCCESS;
+}
+
+static bool isStringType(ValueType type) {
+   return type == TYPE_STRING || type == TYPE_DATETIME || type == TYPE_BASE64;
+}
+
+// Drop any pending TTL on g_dataModels[i] without restoring its default.
+// The caller must hold g_storeLock exclusively.
+static void clearTtl(int i) {
+   TtlState *ttl = g_dataModels[i].ttl;
+   if (ttl) {
+      timerCancel(&ttl->timer);
+      if (isStringType(g_dataModels[i].type)) {
+         free(ttl->defaultValue.strVal);
+      }
+      free(ttl);
+      g_dataModels[i].ttl = NULL;
+   }
+}
+
+// Write a prepared value into g_dataModels[i], taking ownership of str.
+// A plain write replaces any TTL value and becomes the new default.
+// The caller must hold g_storeLock exclusively.
+static void storeValue(int i, rbusValue_t value, char *str) {
+   clearTtl(i);
+   switch (g_dataModels[i].type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      free(g_dataModels[i].value.strVal);
+      g_dataModels[i].value.strVal = str;
+      break;
+   case TYPE_INT:
+      g_dataModels[i].value.intVal = rbusValue_GetInt32(value);
+      break;
+   case TYPE_UINT:
+      g_dataModels[i].value.uintVal = rbusValue_GetUInt32(value);
+      break;
+   case TYPE_BOOL:
+      g_dataModels[i].value.boolVal = rbusValue_GetBoolean(value);
+      break;
+   case TYPE_LONG:
+      g_dataModels[i].value.longVal = rbusValue_GetInt64(value);
+      break;
+   case TYPE_ULONG:
+      g_dataModels[i].value.ulongVal = rbusValue_GetUInt64(value);
+      break;
+   case TYPE_FLOAT:
+      g_dataModels[i].value.floatVal = rbusValue_GetSingle(value);
+      break;
+   case TYPE_DOUBLE:
+      g_dataModels[i].value.doubleVal = rbusValue_GetDouble(value);
+      break;
+   case TYPE_BYTE:
+      g_dataModels[i].value.byteVal = rbusValue_GetByte(value);
+      break;
+   }
+   g_dataModels[i].version++;
+}
+
+// Expiry callback for g_dataModels[(intptr_t)arg]: restore the default value
+static void ttlExpired(void *arg) {
+   int i = (int)(intptr_t)arg;
+   char buf[MAX_NAME_LEN];
+   rbusValue_t oldValue, newValue;
+
+   pthread_rwlock_wrlock(&g_storeLock);
+   TtlState *ttl = g_dataModels[i].ttl;
+   // Skip if a plain write cleared the TTL or a new TTL write re-armed it
+   // after this expiry was dequeued
+   if (!ttl || !ttl->pending || timerArmed(&ttl->timer)) {
+      pthread_rwlock_unlock(&g_storeLock);
+      return;
+   }
+   rbusValue_Init(&oldValue);
+   dataModelToValue(&g_dataModels[i], oldValue);
+   if (isStringType(g_dataModels[i].type)) {
+      free(g_dataModels[i].value.strVal);
+   }
+   g_dataModels[i].value = ttl->defaultValue;
+   free(ttl);
+   g_dataModels[i].ttl = NULL;
+   g_dataModels[i].version++;
+   rbusValue_Init(&newValue);
+   dataModelToValue(&g_dataModels[i], newValue);
+   pthread_rwlock_unlock(&g_storeLock);
+
+   if (rbusValue_Compare(oldValue, newValue) != 0) {
+      publishValueChange(dataModelName(i, buf), newValue, oldValue, NULL);
+   }
+   rbusValue_Release(oldValue);
+   rbusValue_Release(newValue);
+}
+
+// Write a prepared value into g_dataModels[i] that reverts to the current
+// default after ttlMs. ttl is a preallocated state, consumed if the data model
+// has none yet and freed otherwise. The caller must hold g_storeLock exclusively.
+static void storeValueWithTtl(int i, rbusValue_t value, char *str, uint64_t ttlMs, TtlState *ttl) {
+   DataModel *dm = &g_dataModels[i];
+   if (!dm->ttl) {
+      // The value in place before the first TTL write becomes the default;
+      // a string moves to the TTL state instead of being copied
+      memset(ttl, 0, sizeof(*ttl));
+      ttl->defaultValue = dm->value;
+      if (isStringType(dm->type)) {
+         dm->value.strVal = NULL;
+      }
+      dm->ttl = ttl;
+   } else {
+      free(ttl);
+   }
+
+   switch (dm->type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      free(dm->value.strVal);
+      dm->value.strVal = str;
+      break;
+   case TYPE_INT:
+      dm->value.intVal = rbusValue_GetInt32(value);
+      break;
+   case TYPE_UINT:
+      dm->value.uintVal = rbusValue_GetUInt32(value);
+      break;
+   case TYPE_BOOL:
+      dm->value.boolVal = rbusValue_GetBoolean(value);
+      break;
+   case TYPE_LONG:
+      dm->value.longVal = rbusValue_GetInt64(value);
+      break;
+   case TYPE_ULONG:
+      dm->value.ulongVal = rbusValue_GetUInt64(value);
+      break;
+   case TYPE_FLOAT:
+      dm->value.floatVal = rbusValue_GetSingle(value);
+      break;
+   case TYPE_DOUBLE:
+      dm->value.doubleVal = rbusValue_GetDouble(value);
+      break;
+   case TYPE_BYTE:
+      dm->value.byteVal = rbusValue_GetByte(value);
+      break;
+   }
+   dm->version++;
+   dm->ttl->pending = true;
+   timerStart(&dm->ttl->timer, ttlMs, ttlExpired, (void *)(intptr_t)i);
+}
+
+// Callback for handling set requests
+rbusError_t setHandler(rbusHandle_t handle, rbusProperty_t property, rbusSetHandlerOptions_t *options) {
+   uint64_t startNs = monotonicNs();
+   const char *requester = options ? options->requestingComponent : NULL;
+   char const *name = rbusProperty_GetName(property);
+   rbusValue_t value = rbusProperty_GetValue(property);
+   int i = findDataModel(name);
+   if (i < 0) {
+      flightRecord(FLIGHT_SET, -1, requester, startNs, 0, 0, RBUS_ERROR_INVALID_INPUT, false);
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   char *str;
+   bool injected;
+   rbusError_t rc = faultApply(FAULT_SET, name, &injected);
+   if (rc == RBUS_ERROR_SUCCESS) {
+      rc = prepareStoreValue(i, value, &str);
+   }
+   if (rc != RBUS_ERROR_SUCCESS) {
+      flightRecord(FLIGHT_SET, i, requester, startNs, 0, 0, rc, injected);
+      return rc;
+   }
+
+   rbusValue_t oldValue;
+   rbusValue_Init(&oldValue);
+   pthread_rwlock_wrlock(&g_storeLock);
+   uint64_t lockedNs = monotonicNs();
+   dataModelToValue(&g_dataModels[i], oldValue);
+   storeValue(i, value, str);
+   pthread_rwlock_unlock(&g_storeLock);
+   uint64_t storedNs = monotonicNs();
+
+   if (rbusValue_Compare(oldValue, value) != 0) {
+      publishValueChange(name, value, oldValue, requester);
+   }
+   rbusValue_Release(oldValue);
+   flightRecord(FLIGHT_SET, i, requester, startNs, lockedNs, storedNs, RBUS_ERROR_SUCCESS, injected);
+   return RBUS_ERROR_SUCCESS;
+}
+
+rbusError_t eventSubHandler(rbusHandle_t handle, rbusEventSubAction_t action, const char *eventName, rbusFilter_t filter, int32_t interval, bool *autoPublish) {
+   (void)handle;
+   (void)filter;
+   (void)interval;
+   printf("Subscribe handler called for %s, action: %s\n", eventName,
+      action == RBUS_EVENT_ACTION_SUBSCRIBE ? "subscribe" : "unsubscribe");
+
+   // Values held in the store are published from setHandler when they change.
+   // Properties with live handlers keep rbus polling them for changes.
+   int i = findDataModel(eventName);
+   if (i >= 0 && g_dataModels[i].getHandler && !g_dataModels[i].proxy) {
+      return RBUS_ERROR_SUCCESS;
+   }
+   if (autoPublish) {
+      *autoPublish = false;
+   }
+
+   pthread_mutex_lock(&g_subTrieLock);
+   bool ok = true;
+   if (action == RBUS_EVENT_ACTION_SUBSCRIBE) {
+      ok = subTrieAdd(eventName);
+   } else {
+      subTrieRemove(eventName);
+   }
+   pthread_mutex_unlock(&g_subTrieLock);
+   return ok ? RBUS_ERROR_SUCCESS : RBUS_ERROR_OUT_OF_RESOURCES;
+}
+
+// Fill property with the current value of g_dataModels[i], calling its live handler if it has one
+static rbusError_t getDataModelValue(rbusHandle_t handle, int i, rbusProperty_t property) {
+   if (g_dataModels[i].getHandler) {
+      return g_dataModels[i].getHandler(handle, property, NULL);
+   }
+
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   pthread_rwlock_rdlock(&g_storeLock);
+   dataModelToValue(&g_dataModels[i], value);
+   pthread_rwlock_unlock(&g_storeLock);
+   rbusProperty_SetValue(property, value);
+   rbusValue_Release(value);
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Method handler for Device.X_RDK_DataModels.GetPage()
+// Inputs:  Prefix (string), PageSize (uint32), Cursor (string, empty for the first page)
+// Outputs: one property per parameter in lexicographic order, plus NextCursor
+//          (empty once the subtree has been exhausted)
+// The cursor is the last name returned, so each page is a binary search into the
+// name index followed by a walk of at most PageSize entries.
+static rbusError_t getPageMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)methodName;
+   (void)asyncHandle;
+
+   const char *prefix = "";
+   const char *cursor = "";
+   uint32_t pageSize = GETPAGE_DEFAULT_SIZE;
+
+   rbusValue_t prefixVal = rbusObject_GetValue(inParams, "Prefix");
+   if (prefixVal) {
+      if (rbusValue_GetType(prefixVal) != RBUS_STRING) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      prefix = rbusValue_GetString(prefixVal, NULL);
+   }
+
+   rbusValue_t cursorVal = rbusObject_GetValue(inParams, "Cursor");
+   if (cursorVal) {
+      if (rbusValue_GetType(cursorVal) != RBUS_STRING) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      cursor = rbusValue_GetString(cursorVal, NULL);
+   }
+
+   rbusValue_t sizeVal = rbusObject_GetValue(inParams, "PageSize");
+   if (sizeVal) {
+      switch (rbusValue_GetType(sizeVal)) {
+      case RBUS_UINT32:
+         pageSize = rbusValue_GetUInt32(sizeVal);
+         break;
+      case RBUS_INT32:
+         pageSize = rbusValue_GetInt32(sizeVal) > 0 ? (uint32_t)rbusValue_GetInt32(sizeVal) : 0;
+         break;
+      default:
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+   }
+   if (pageSize == 0 || pageSize > GETPAGE_MAX_SIZE) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   size_t prefixLen = strlen(prefix);
+   int pos;
+   if (cursor[0] != '\0') {
+      // A cursor from a different subtree is a client error, not an empty page
+      if (strncmp(cursor, prefix, prefixLen) != 0) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      char buf[MAX_NAME_LEN];
+      pos = lowerBoundName(cursor);
+      if (pos < g_totalDataModels && strcmp(dataModelName(pos, buf), cursor) == 0) {
+         pos++;
+      }
+   } else {
+      pos = lowerBoundName(prefix);
+   }
+
+   uint32_t count = 0;
+   char last[MAX_NAME_LEN] = "";
+   char buf[MAX_NAME_LEN];
+   for (; pos < g_totalDataModels && count < pageSize; pos++) {
+      const char *name = dataModelName(pos, buf);
+      if (strncmp(name, prefix, prefixLen) != 0) {
+         break;
+      }
+
+      rbusProperty_t property;
+      rbusProperty_Init(&property, name, NULL);
+      if (getDataModelValue(handle, pos, property) == RBUS_ERROR_SUCCESS) {
+         rbusObject_SetValue(outParams, name, rbusProperty_GetValue(property));
+      }
+      rbusProperty_Release(property);
+      strcpy(last, name);
+      count++;
+   }
+
+   bool more = pos < g_totalDataModels && strncmp(dataModelName(pos, buf), prefix, prefixLen) == 0;
+   rbusValue_t next;
+   rbusValue_Init(&next);
+   rbusValue_SetString(next, more ? last : "");
+   rbusObject_SetValue(outParams, "NextCursor", next);
+   rbusValue_Release(next);
+
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Returns true if value has the rbus type used to store a data model of type
+static bool valueMatchesType(ValueType type, rbusValue_t value) {
+   rbusValueType_t rbusType = rbusValue_GetType(value);
+   switch (type) {
+   case TYPE_STRING:
+   case TYPE_BASE64:
+      return rbusType == RBUS_STRING;
+   case TYPE_DATETIME:
+      return rbusType == RBUS_STRING || rbusType == RBUS_DATETIME;
+   case TYPE_INT:
+      return rbusType == RBUS_INT32;
+   case TYPE_UINT:
+      return rbusType == RBUS_UINT32;
+   case TYPE_BOOL:
+      return rbusType == RBUS_BOOLEAN;
+   case TYPE_LONG:
+      return rbusType == RBUS_INT64;
+   case TYPE_ULONG:
+      return rbusType == RBUS_UINT64;
+   case TYPE_FLOAT:
+      return rbusType == RBUS_SINGLE;
+   case TYPE_DOUBLE:
+      return rbusType == RBUS_DOUBLE;
+   case TYPE_BYTE:
+      return rbusType == RBUS_BYTE;
+   }
+   return false;
+}
+
+typedef struct {
+   int index;
+   const char *name;
+   rbusValue_t newValue;      // NULL for a precondition-only entry
+   rbusValue_t expectedValue; // Optional
+   bool checkVersion;
+   uint32_t expectedVersion;
+   char *str;                 // Prepared string for string types
+   rbusValue_t oldValue;
+} CasEntry;
+
+// Method handler for Device.X_RDK_DataModels.CompareAndSet()
+// Each input property is named after a parameter. Its value is either the new
+// value (an unconditional set) or an object with the optional fields:
+//   Value           - the new value; without it the entry is only a precondition
+//   ExpectedVersion - (uint32) the version the parameter must still have
+//   ExpectedValue   - the value the parameter must still have
+// All preconditions are checked and all values written under one exclusive
+// hold of the store lock, so the batch is applied entirely or not at all.
+// Outputs: Applied (bool) and, per parameter, its version after the call; when
+// Applied is false these are the current versions, ready for a retry.
+static rbusError_t compareAndSetMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)asyncHandle;
+
+   CasEntry entries[CAS_MAX_ENTRIES];
+   int numEntries = 0;
+   rbusError_t rc = RBUS_ERROR_SUCCESS;
+
+   for (rbusProperty_t prop = rbusObject_GetProperties(inParams); prop; prop = rbusProperty_GetNext(prop)) {
+      if (numEntries == CAS_MAX_ENTRIES) {
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      CasEntry *entry = &entries[numEntries];
+      memset(entry, 0, sizeof(*entry));
+      entry->name = rbusProperty_GetName(prop);
+      entry->index = findDataModel(entry->name);
+      // Live values are computed on every get and have no stored version
+      if (entry->index < 0 || g_dataModels[entry->index].getHandler) {
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+
+      rbusValue_t value = rbusProperty_GetValue(prop);
+      if (value && rbusValue_GetType(value) == RBUS_OBJECT) {
+         rbusObject_t spec = rbusValue_GetObject(value);
+         entry->newValue = rbusObject_GetValue(spec, "Value");
+         entry->expectedValue = rbusObject_GetValue(spec, "ExpectedValue");
+         rbusValue_t version = rbusObject_GetValue(spec, "ExpectedVersion");
+         if (version) {
+            if (rbusValue_GetType(version) != RBUS_UINT32) {
+               rc = RBUS_ERROR_INVALID_INPUT;
+               break;
+            }
+            entry->checkVersion = true;
+            entry->expectedVersion = rbusValue_GetUInt32(version);
+         }
+      } else {
+         entry->newValue = value;
+      }
+
+      ValueType type = g_dataModels[entry->index].type;
+      if ((entry->newValue && !valueMatchesType(type, entry->newValue)) ||
+         (entry->expectedValue && !valueMatchesType(type, entry->expectedValue))) {
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      numEntries++;
+      if (entry->newValue) {
+         rc = prepareStoreValue(entry->index, entry->newValue, &entry->str);
+         if (rc != RBUS_ERROR_SUCCESS) {
+            break;
+         }
+      }
+   }
+
+   bool applied = false;
+   if (rc == RBUS_ERROR_SUCCESS) {
+      pthread_rwlock_wrlock(&g_storeLock);
+      applied = true;
+      for (int e = 0; e < numEntries && applied; e++) {
+         CasEntry *entry = &entries[e];
+         if (entry->checkVersion && g_dataModels[entry->index].version != entry->expectedVersion) {
+            applied = false;
+         }
+         if (entry->expectedValue) {
+            rbusValue_t current;
+            rbusValue_Init(&current);
+            dataModelToValue(&g_dataModels[entry->index], current);
+            if (rbusValue_Compare(current, entry->expectedValue) != 0) {
+               applied = false;
+            }
+            rbusValue_Release(current);
+         }
+      }
+      for (int e = 0; e < numEntries; e++) {
+         CasEntry *entry = &entries[e];
+         if (applied && entry->newValue) {
+            rbusValue_Init(&entry->oldValue);
+            dataModelToValue(&g_dataModels[entry->index], entry->oldValue);
+            storeValue(entry->index, entry->newValue, entry->str);
+            entry->str = NULL;
+         }
+         rbusValue_t version;
+         rbusValue_Init(&version);
+         rbusValue_SetUInt32(version, g_dataModels[entry->index].version);
+         rbusObject_SetValue(outParams, entry->name, version);
+         rbusValue_Release(version);
+      }
+      pthread_rwlock_unlock(&g_storeLock);
+
+      rbusValue_t appliedValue;
+      rbusValue_Init(&appliedValue);
+      rbusValue_SetBoolean(appliedValue, applied);
+      rbusObject_SetValue(outParams, "Applied", appliedValue);
+      rbusValue_Release(appliedValue);
+   }
+
+   for (int e = 0; e < numEntries; e++) {
+      CasEntry *entry = &entries[e];
+      if (entry->oldValue) {
+         if (rbusValue_Compare(entry->oldValue, entry->newValue) != 0) {
+            publishValueChange(entry->name, entry->newValue, entry->oldValue, NULL);
+         }
+         rbusValue_Release(entry->oldValue);
+      }
+      free(entry->str);
+   }
+   return rc;
+}
+
+typedef enum {
+   ATOMIC_ADD,
+   ATOMIC_SUB,
+   ATOMIC_MIN,
+   ATOMIC_MAX,
+   ATOMIC_SET_BITS,
+   ATOMIC_CLEAR_BITS
+} AtomicOp;
+
+// Lock-free read-modify-write of *p; returns the previous value. Integer
+// arithmetic wraps around.
+#define DEFINE_ATOMIC_INT_UPDATE(fn, T) \
+static T fn(T *p, AtomicOp op, T operand) { \
+   switch (op) { \
+   case ATOMIC_ADD: \
+      return __atomic_fetch_add(p, operand, __ATOMIC_SEQ_CST); \
+   case ATOMIC_SUB: \
+      return __atomic_fetch_sub(p, operand, __ATOMIC_SEQ_CST); \
+   case ATOMIC_SET_BITS: \
+      return __atomic_fetch_or(p, operand, __ATOMIC_SEQ_CST); \
+   case ATOMIC_CLEAR_BITS: \
+      return __atomic_fetch_and(p, (T)~operand, __ATOMIC_SEQ_CST); \
+   default: { \
+      T old = __atomic_load_n(p, __ATOMIC_RELAXED); \
+      while ((op == ATOMIC_MIN ? operand < old : operand > old) && \
+         !__atomic_compare_exchange_n(p, &old, operand, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) { \
+      } \
+      return old; \
+   } \
+   } \
+}
+
+#define DEFINE_ATOMIC_FLOAT_UPDATE(fn, T) \
+static T fn(T *p, AtomicOp op, T operand) { \
+   T old, val; \
+   __atomic_load(p, &old, __ATOMIC_RELAXED); \
+   do { \
+      switch (op) { \
+      case ATOMIC_ADD: \
+         val = old + operand; \
+         break; \
+      case ATOMIC_SUB: \
+         val = old - operand; \
+         break; \
+      case ATOMIC_MIN: \
+         val = operand < old ? operand : old; \
+         break; \
+      default: \
+         val = operand > old ? operand : old; \
+         break; \
+      } \
+   } while (!__atomic_compare_exchange(p, &old, &val, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)); \
+   return old; \
+}
+
+DEFINE_ATOMIC_INT_UPDATE(atomicUpdateInt32, int32_t)
+DEFINE_ATOMIC_INT_UPDATE(atomicUpdateUInt32, uint32_t)
+DEFINE_ATOMIC_INT_UPDATE(atomicUpdateInt64, int64_t)
+DEFINE_ATOMIC_INT_UPDATE(atomicUpdateUInt64, uint64_t)
+DEFINE_ATOMIC_INT_UPDATE(atomicUpdateByte, uint8_t)
+DEFINE_ATOMIC_FLOAT_UPDATE(atomicUpdateFloat, float)
+DEFINE_ATOMIC_FLOAT_UPDATE(atomicUpdateDouble, double)
+
+static bool parseAtomicOp(const char *str, AtomicOp *op) {
+   static const struct {
+      const char *name;
+      AtomicOp op;
+   } ops[] = {
+      {"add", ATOMIC_ADD},
+      {"sub", ATOMIC_SUB},
+      {"min", ATOMIC_MIN},
+      {"max", ATOMIC_MAX},
+      {"setbits", ATOMIC_SET_BITS},
+      {"clearbits", ATOMIC_CLEAR_BITS},
+   };
+   for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+      if (strcmp(str, ops[k].name) == 0) {
+         *op = ops[k].op;
+         return true;
+      }
+   }
+   return false;
+}
+
+typedef struct {
+   int64_t i;
+   uint64_t u;
+   double d;
+   bool hasInt;    // i holds the operand
+   bool hasUInt;   // u holds the operand
+} AtomicOperand;
+
+// Accept an operand of any numeric rbus type. Floating point operands are
+// truncated for integer parameters; i and u are only set when the truncated
+// value is representable, since converting anything else is undefined.
+static bool valueToOperand(rbusValue_t value, AtomicOperand *operand) {
+   memset(operand, 0, sizeof(*operand));
+   switch (rbusValue_GetType(value)) {
+   case RBUS_INT32:
+      operand->i = rbusValue_GetInt32(value);
+      break;
+   case RBUS_INT64:
+      operand->i = rbusValue_GetInt64(value);
+      break;
+   case RBUS_UINT32:
+      operand->u = rbusValue_GetUInt32(value);
+      operand->hasUInt = true;
+      operand->hasInt = true;
+      operand->i = (int64_t)operand->u;
+      operand->d = (double)operand->u;
+      return true;
+   case RBUS_UINT64:
+      operand->u = rbusValue_GetUInt64(value);
+      operand->hasUInt = true;
+      operand->hasInt = operand->u <= INT64_MAX;
+      operand->i = operand->hasInt ? (int64_t)operand->u : 0;
+      operand->d = (double)operand->u;
+      return true;
+   case RBUS_BYTE:
+      operand->u = rbusValue_GetByte(value);
+      operand->hasUInt = true;
+      operand->hasInt = true;
+      operand->i = (int64_t)operand->u;
+      operand->d = (double)operand->u;
+      return true;
+   case RBUS_SINGLE:
+   case RBUS_DOUBLE:
+      operand->d = rbusValue_GetType(value) == RBUS_SINGLE ? rbusValue_GetSingle(value) : rbusValue_GetDouble(value);
+      if (!isfinite(operand->d)) {
+         return false;
+      }
+      // -2^63, 2^63 and 2^64 are exact doubles; INT64_MAX and UINT64_MAX are not
+      operand->hasInt = operand->d >= -9223372036854775808.0 && operand->d < 9223372036854775808.0;
+      operand->hasUInt = operand->d > -1.0 && operand->d < 18446744073709551616.0;
+      operand->i = operand->hasInt ? (int64_t)operand->d : 0;
+      operand->u = operand->hasUInt ? (uint64_t)operand->d : 0;
+      return true;
+   default:
+      return false;
+   }
+   operand->hasInt = true;
+   operand->hasUInt = operand->i >= 0;
+   operand->u = operand->hasUInt ? (uint64_t)operand->i : 0;
+   operand->d = (double)operand->i;
+   return true;
+}
+
+// Whether operand fits the type of a parameter, so applying it never needs an
+// out of range conversion
+static bool operandFits(const AtomicOperand *operand, ValueType type) {
+   switch (type) {
+   case TYPE_INT:
+      return operand->hasInt && operand->i >= INT32_MIN && operand->i <= INT32_MAX;
+   case TYPE_UINT:
+      return operand->hasUInt && operand->u <= UINT32_MAX;
+   case TYPE_LONG:
+      return operand->hasInt;
+   case TYPE_ULONG:
+      return operand->hasUInt;
+   case TYPE_BYTE:
+      return operand->hasUInt && operand->u <= UINT8_MAX;
+   case TYPE_FLOAT:
+      return fabs(operand->d) <= FLT_MAX;
+   case TYPE_DOUBLE:
+      return true;
+   default:
+      return false;
+   }
+}
+
+typedef struct {
+   int index;
+   const char *name;
+   AtomicOp op;
+   AtomicOperand operand;
+   rbusValue_t oldValue;
+   rbusValue_t newValue;
+} AtomicEntry;
+
+// Apply entry to its data model. The caller holds g_storeLock shared, which
+// keeps out sets and CompareAndSet() while other atomic updates run concurrently.
+// The value this update produced is recomputed by applying the same operation
+// to a local copy of the previous value.
+static void applyAtomicEntry(AtomicEntry *entry) {
+   DataModel *dm = &g_dataModels[entry->index];
+   rbusValue_Init(&entry->oldValue);
+   rbusValue_Init(&entry->newValue);
+   switch (dm->type) {
+   case TYPE_INT: {
+      int32_t old = atomicUpdateInt32(&dm->value.intVal, entry->op, (int32_t)entry->operand.i);
+      rbusValue_SetInt32(entry->oldValue, old);
+      atomicUpdateInt32(&old, entry->op, (int32_t)entry->operand.i);
+      rbusValue_SetInt32(entry->newValue, old);
+      break;
+   }
+   case TYPE_UINT: {
+      uint32_t old = atomicUpdateUInt32(&dm->value.uintVal, entry->op, (uint32_t)entry->operand.u);
+      rbusValue_SetUInt32(entry->oldValue, old);
+      atomicUpdateUInt32(&old, entry->op, (uint32_t)entry->operand.u);
+      rbusValue_SetUInt32(entry->newValue, old);
+      break;
+   }
+   case TYPE_LONG: {
+      int64_t old = atomicUpdateInt64(&dm->value.longVal, entry->op, entry->operand.i);
+      rbusValue_SetInt64(entry->oldValue, old);
+      atomicUpdateInt64(&old, entry->op, entry->operand.i);
+      rbusValue_SetInt64(entry->newValue, old);
+      break;
+   }
+   case TYPE_ULONG: {
+      uint64_t old = atomicUpdateUInt64(&dm->value.ulongVal, entry->op, entry->operand.u);
+      rbusValue_SetUInt64(entry->oldValue, old);
+      atomicUpdateUInt64(&old, entry->op, entry->operand.u);
+      rbusValue_SetUInt64(entry->newValue, old);
+      break;
+   }
+   case TYPE_BYTE: {
+      uint8_t old = atomicUpdateByte(&dm->value.byteVal, entry->op, (uint8_t)entry->operand.u);
+      rbusValue_SetByte(entry->oldValue, old);
+      atomicUpdateByte(&old, entry->op, (uint8_t)entry->operand.u);
+      rbusValue_SetByte(entry->newValue, old);
+      break;
+   }
+   case TYPE_FLOAT: {
+      float old = atomicUpdateFloat(&dm->value.floatVal, entry->op, (float)entry->operand.d);
+      rbusValue_SetSingle(entry->oldValue, old);
+      atomicUpdateFloat(&old, entry->op, (float)entry->operand.d);
+      rbusValue_SetSingle(entry->newValue, old);
+      break;
+   }
+   case TYPE_DOUBLE: {
+      double old = atomicUpdateDouble(&dm->value.doubleVal, entry->op, entry->operand.d);
+      rbusValue_SetDouble(entry->oldValue, old);
+      atomicUpdateDouble(&old, entry->op, entry->operand.d);
+      rbusValue_SetDouble(entry->newValue, old);
+      break;
+   }
+   default:
+      break;
+   }
+   __atomic_add_fetch(&dm->version, 1, __ATOMIC_SEQ_CST);
+}
+
+// Method handler for Device.X_RDK_DataModels.AtomicUpdate()
+// Each input property is named after a numeric parameter. Its value is either
+// a number to add, or an object with:
+//   Op      - add, sub, min, max, setbits or clearbits (bit operations are
+//             limited to integer types)
+//   Operand - the number to apply
+// Every update is a single atomic read-modify-write on the stored value, so
+// concurrent callers never lose increments. Outputs each parameter's new value;
+// each changed parameter publishes one value-change event.
+static rbusError_t atomicUpdateMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)asyncHandle;
+
+   AtomicEntry entries[ATOMIC_MAX_ENTRIES];
+   int numEntries = 0;
+
+   for (rbusProperty_t prop = rbusObject_GetProperties(inParams); prop; prop = rbusProperty_GetNext(prop)) {
+      if (numEntries == ATOMIC_MAX_ENTRIES) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      AtomicEntry *entry = &entries[numEntries];
+      memset(entry, 0, sizeof(*entry));
+      entry->name = rbusProperty_GetName(prop);
+      entry->index = findDataModel(entry->name);
+      if (entry->index < 0 || g_dataModels[entry->index].getHandler) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+
+      rbusValue_t value = rbusProperty_GetValue(prop);
+      rbusValue_t operand = value;
+      entry->op = ATOMIC_ADD;
+      if (value && rbusValue_GetType(value) == RBUS_OBJECT) {
+         rbusObject_t spec = rbusValue_GetObject(value);
+         rbusValue_t op = rbusObject_GetValue(spec, "Op");
+         if (op && (rbusValue_GetType(op) != RBUS_STRING || !parseAtomicOp(rbusValue_GetString(op, NULL), &entry->op))) {
+            return RBUS_ERROR_INVALID_INPUT;
+         }
+         operand = rbusObject_GetValue(spec, "Operand");
+      }
+      if (!operand || !valueToOperand(operand, &entry->operand)) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+
+      ValueType type = g_dataModels[entry->index].type;
+      if (!operandFits(&entry->operand, type)) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      if ((type == TYPE_FLOAT || type == TYPE_DOUBLE) && (entry->op == ATOMIC_SET_BITS || entry->op == ATOMIC_CLEAR_BITS)) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      numEntries++;
+   }
+
+   pthread_rwlock_rdlock(&g_storeLock);
+   for (int e = 0; e < numEntries; e++) {
+      applyAtomicEntry(&entries[e]);
+   }
+   pthread_rwlock_unlock(&g_storeLock);
+
+   for (int e = 0; e < numEntries; e++) {
+      AtomicEntry *entry = &entries[e];
+      rbusObject_SetValue(outParams, entry->name, entry->newValue);
+      if (rbusValue_Compare(entry->oldValue, entry->newValue) != 0) {
+         publishValueChange(entry->name, entry->newValue, entry->oldValue, NULL);
+      }
+      rbusValue_Release(entry->oldValue);
+      rbusValue_Release(entry->newValue);
+   }
+   return RBUS_ERROR_SUCCESS;
+}
+
+// One value of a Set() batch or an HTTP /set request
+typedef struct {
+   int index;
+   const char *name;
+   rbusValue_t newValue;
+   char *str;                 // Prepared string for string types
+   TtlState *ttl;             // Preallocated expiry state when a TTL is given
+   rbusValue_t oldValue;
+} SetEntry;
+
+// Store prepared SetEntry values under one exclusive hold of the store lock,
+// keeping each previous value in oldValue
+static void applySetEntries(SetEntry *entries, int numEntries, uint64_t ttlMs) {
+   pthread_rwlock_wrlock(&g_storeLock);
+   for (int e = 0; e < numEntries; e++) {
+      SetEntry *entry = &entries[e];
+      rbusValue_Init(&entry->oldValue);
+      dataModelToValue(&g_dataModels[entry->index], entry->oldValue);
+      if (entry->ttl) {
+         storeValueWithTtl(entry->index, entry->newValue, entry->str, ttlMs, entry->ttl);
+      } else {
+         storeValue(entry->index, entry->newValue, entry->str);
+      }
+      entry->str = NULL;
+      entry->ttl = NULL;
+   }
+   pthread_rwlock_unlock(&g_storeLock);
+}
+
+// Apply entries if apply is true, then publish the changes and free what the
+// entries own
+static void finishSetEntries(SetEntry *entries, int numEntries, bool apply, uint64_t ttlMs) {
+   if (apply) {
+      applySetEntries(entries, numEntries, ttlMs);
+   }
+
+   for (int e = 0; e < numEntries; e++) {
+      SetEntry *entry = &entries[e];
+      if (entry->oldValue) {
+         if (rbusValue_Compare(entry->oldValue, entry->newValue) != 0) {
+            publishValueChange(entry->name, entry->newValue, entry->oldValue, NULL);
+         }
+         rbusValue_Release(entry->oldValue);
+         entry->oldValue = NULL;
+      }
+      free(entry->str);
+      entry->str = NULL;
+      free(entry->ttl);
+      entry->ttl = NULL;
+   }
+}
+
+// Method handler for Device.X_RDK_DataModels.Set()
+// Each input property is named after a parameter and holds its new value; the
+// optional TTL property (uint32 seconds) makes every value in the batch
+// ephemeral. When the TTL elapses without being refreshed by another Set() with
+// a TTL, the parameter reverts to the value it had before the first TTL write
+// and a value-change event is published. A plain set (this method without TTL,
+// rbus_set() or CompareAndSet()) cancels the expiry and keeps the new value.
+static rbusError_t setMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)outParams;
+   (void)asyncHandle;
+
+   SetEntry entries[SET_MAX_ENTRIES];
+   int numEntries = 0;
+   uint64_t ttlMs = 0;
+   rbusError_t rc = RBUS_ERROR_SUCCESS;
+
+   rbusValue_t ttlValue = rbusObject_GetValue(inParams, "TTL");
+   if (ttlValue) {
+      if (rbusValue_GetType(ttlValue) != RBUS_UINT32) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      ttlMs = (uint64_t)rbusValue_GetUInt32(ttlValue) * 1000;
+   }
+
+   for (rbusProperty_t prop = rbusObject_GetProperties(inParams); prop; prop = rbusProperty_GetNext(prop)) {
+      const char *name = rbusProperty_GetName(prop);
+      if (strcmp(name, "TTL") == 0) {
+         continue;
+      }
+      if (numEntries == SET_MAX_ENTRIES) {
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      SetEntry *entry = &entries[numEntries];
+      memset(entry, 0, sizeof(*entry));
+      entry->name = name;
+      entry->index = findDataModel(name);
+      entry->newValue = rbusProperty_GetValue(prop);
+      if (entry->index < 0 || g_dataModels[entry->index].getHandler ||
+         !entry->newValue || !valueMatchesType(g_dataModels[entry->index].type, entry->newValue)) {
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      numEntries++;
+      rc = prepareStoreValue(entry->index, entry->newValue, &entry->str);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         break;
+      }
+      if (ttlMs) {
+         entry->ttl = malloc(sizeof(TtlState));
+         if (!entry->ttl) {
+            rc = RBUS_ERROR_OUT_OF_RESOURCES;
+            break;
+         }
+      }
+   }
+
+   finishSetEntries(entries, numEntries, rc == RBUS_ERROR_SUCCESS, ttlMs);
+   return rc;
+}
+
+// Map the rbus type of a remote value to the store type used to cache it
+static bool valueTypeFromRbus(rbusValueType_t rbusType, ValueType *type) {
+   switch (rbusType) {
+   case RBUS_STRING:
+      *type = TYPE_STRING;
+      return true;
+   case RBUS_DATETIME:
+      *type = TYPE_DATETIME;
+      return true;
+   case RBUS_INT32:
+      *type = TYPE_INT;
+      return true;
+   case RBUS_UINT32:
+      *type = TYPE_UINT;
+      return true;
+   case RBUS_BOOLEAN:
+      *type = TYPE_BOOL;
+      return true;
+   case RBUS_INT64:
+      *type = TYPE_LONG;
+      return true;
+   case RBUS_UINT64:
+      *type = TYPE_ULONG;
+      return true;
+   case RBUS_SINGLE:
+      *type = TYPE_FLOAT;
+      return true;
+   case RBUS_DOUBLE:
+      *type = TYPE_DOUBLE;
+      return true;
+   case RBUS_BYTE:
+      *type = TYPE_BYTE;
+      return true;
+   default:
+      return false;
+   }
+}
+
+// Name of the remote parameter cached as g_dataModels[i]
+static const char *proxyRemoteName(int i, char *buf) {
+   char local[MAX_NAME_LEN];
+   snprintf(buf, MAX_NAME_LEN, "Device.%s", dataModelName(i, local) + strlen(PROXY_PREFIX));
+   return buf;
+}
+
+// Replace the cached value of g_dataModels[i] with a value from its owner
+static void proxyStoreValue(int i, rbusValue_t value) {
+   char buf[MAX_NAME_LEN];
+   char *str;
+   if (!value || !valueMatchesType(g_dataModels[i].type, value) ||
+      prepareStoreValue(i, value, &str) != RBUS_ERROR_SUCCESS) {
+      return;
+   }
+
+   rbusValue_t oldValue;
+   rbusValue_Init(&oldValue);
+   pthread_rwlock_wrlock(&g_storeLock);
+   dataModelToValue(&g_dataModels[i], oldValue);
+   storeValue(i, value, str);
+   __atomic_store_n(&g_dataModels[i].proxy->refreshedMs, monotonicMs(), __ATOMIC_RELAXED);
+   pthread_rwlock_unlock(&g_storeLock);
+
+   if (rbusValue_Compare(oldValue, value) != 0) {
+      publishValueChange(dataModelName(i, buf), value, oldValue, NULL);
+   }
+   rbusValue_Release(oldValue);
+}
+
+// Callback for gets of a cached remote value. The cached value is always
+// returned at once, stale or not (stale-while-revalidate): values kept fresh
+// by a subscription are never refetched, and others older than the TTL are
+// queued for an interactive scheduler task to refetch, so concurrent readers
+// cause at most one fetch from the owner. GetCacheAge() tells how old a
+// returned value may be.
+static rbusError_t proxyGetHandler(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t *options) {
+   int i = findDataModel(rbusProperty_GetName(property));
+   if (i < 0 || !g_dataModels[i].proxy) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   ProxyState *proxy = g_dataModels[i].proxy;
+   uint64_t refreshedMs = __atomic_load_n(&proxy->refreshedMs, __ATOMIC_RELAXED);
+   if (!proxy->subscribed && monotonicMs() - refreshedMs >= g_proxyTtlMs &&
+      !__atomic_exchange_n(&proxy->refreshQueued, true, __ATOMIC_ACQ_REL)) {
+      schedSubmit(&g_proxyRefreshTask);
+   }
+   return getHandler(handle, property, options);
+}
+
+// Cached remote values are owned by another component and cannot be set here
+static rbusError_t proxySetHandler(rbusHandle_t handle, rbusProperty_t property, rbusSetHandlerOptions_t *options) {
+   (void)handle;
+   (void)property;
+   (void)options;
+   return RBUS_ERROR_ACCESS_NOT_ALLOWED;
+}
+
+static void proxyEventHandler(rbusHandle_t handle, rbusEvent_t const *event, rbusEventSubscription_t *subscription) {
+   (void)handle;
+   int i = (int)(intptr_t)subscription->userData;
+   proxyStoreValue(i, rbusObject_GetValue(event->data, "value"));
+}
+
+// Fetch every declared remote subtree with rbus_getExt() and append its
+// parameters to g_dataModels under PROXY_PREFIX. Runs before the name
+// dictionary is built.
+static bool loadProxySubtrees(void) {
+   for (int s = 0; s < g_numProxySubtrees; s++) {
+      const char *subtree = g_proxySubtrees[s];
+      int numProps = 0;
+      rbusProperty_t props = NULL;
+      rbusError_t rc = rbus_getExt(g_rbusHandle, 1, &subtree, &numProps, &props);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "Failed to fetch remote subtree %s: %d\n", subtree, rc);
+         return false;
+      }
+
+      DataModel *models = realloc(g_dataModels, (g_totalDataModels + numProps) * sizeof(DataModel));
+      if (!models) {
+         rbusProperty_Release(props);
+         return false;
+      }
+      g_dataModels = models;
+
+      int cached = 0;
+      for (rbusProperty_t prop = props; prop; prop = rbusProperty_GetNext(prop)) {
+         const char *remoteName = rbusProperty_GetName(prop);
+         rbusValue_t value = rbusProperty_GetValue(prop);
+         char localName[MAX_NAME_LEN];
+         int i = g_totalDataModels;
+         DataModel *dm = &g_dataModels[i];
+         memset(dm, 0, sizeof(*dm));
+         if (!value || !valueTypeFromRbus(rbusValue_GetType(value), &dm->type) ||
+            strncmp(remoteName, "Device.", 7) != 0 ||
+            snprintf(localName, sizeof(localName), PROXY_PREFIX "%s", remoteName + 7) >= (int)sizeof(localName)) {
+            continue;
+         }
+         char *str;
+         if (prepareStoreValue(i, value, &str) != RBUS_ERROR_SUCCESS) {
+            continue;
+         }
+         dm->name = strdup(localName);
+         dm->proxy = calloc(1, sizeof(ProxyState));
+         if (!dm->name || !dm->proxy) {
+            free((char *)dm->name);
+            free(dm->proxy);
+            free(str);
+            rbusProperty_Release(props);
+            return false;
+         }
+         storeValue(i, value, str);
+         dm->proxy->refreshedMs = monotonicMs();
+         dm->getHandler = proxyGetHandler;
+         dm->setHandler = proxySetHandler;
+         g_totalDataModels++;
+         cached++;
+      }
+      rbusProperty_Release(props);
+      printf("Caching %d parameters of %s under %s\n", cached, subtree, PROXY_PREFIX);
+   }
+   return true;
+}
+
+// Refetch the cached values that gets found stale. Runs on a scheduler
+// worker so that get handlers never wait on the owner.
+static void refreshProxySubtrees(void *arg) {
+   (void)arg;
+   char buf[MAX_NAME_LEN];
+   for (int i = g_proxyFirst; i < g_proxyEnd; i++) {
+      ProxyState *proxy = g_dataModels[i].proxy;
+      if (!__atomic_load_n(&proxy->refreshQueued, __ATOMIC_ACQUIRE)) {
+         continue;
+      }
+      rbusValue_t value;
+      if (rbus_get(g_rbusHandle, proxyRemoteName(i, buf), &value) == RBUS_ERROR_SUCCESS) {
+         proxyStoreValue(i, value);
+         rbusValue_Release(value);
+      }
+      __atomic_store_n(&proxy->refreshQueued, false, __ATOMIC_RELEASE);
+   }
+}
+
+// Find the cached range in the sorted store and subscribe to value changes of
+// the remote parameters, in one rbusEvent_SubscribeEx() call per subtree. If
+// the owner refuses the batch, its parameters are subscribed one at a time.
+// Values without a subscription fall back to the TTL.
+static void subscribeProxySubtrees(void) {
+   g_proxyFirst = lowerBoundName(PROXY_PREFIX);
+   g_proxyEnd = g_proxyFirst;
+   while (g_proxyEnd < g_totalDataModels && g_dataModels[g_proxyEnd].proxy) {
+      g_proxyEnd++;
+   }
+   schedInit(&g_proxyRefreshTask, SCHED_INTERACTIVE, refreshProxySubtrees, NULL);
+
+   rbusEventSubscription_t *subs = calloc(g_proxyEnd > g_proxyFirst ? g_proxyEnd - g_proxyFirst : 1, sizeof(*subs));
+   int subscribed = 0;
+   char buf[MAX_NAME_LEN];
+   char prefix[MAX_NAME_LEN];
+   for (int t = 0; t < g_numProxySubtrees && subs; t++) {
+      snprintf(prefix, sizeof(prefix), PROXY_PREFIX "%s", g_proxySubtrees[t] + 7);
+      int numSubs = 0;
+      for (int i = lowerBoundName(prefix); i < g_proxyEnd; i++) {
+         if (strncmp(dataModelName(i, buf), prefix, strlen(prefix)) != 0) {
+            break;
+         }
+         // Overlapping subtrees share parameters
+         if (g_dataModels[i].proxy->subscribed) {
+            continue;
+         }
+         rbusEventSubscription_t *sub = &subs[numSubs];
+         memset(sub, 0, sizeof(*sub));
+         sub->eventName = strdup(proxyRemoteName(i, buf));
+         sub->handler = (void *)proxyEventHandler;
+         sub->userData = (void *)(intptr_t)i;
+         if (sub->eventName) {
+            numSubs++;
+         }
+      }
+      bool batched = numSubs > 0 && rbusEvent_SubscribeEx(g_rbusHandle, subs, numSubs, 0) == RBUS_ERROR_SUCCESS;
+      for (int n = 0; n < numSubs; n++) {
+         int i = (int)(intptr_t)subs[n].userData;
+         if (batched || rbusEvent_Subscribe(g_rbusHandle, subs[n].eventName, proxyEventHandler, subs[n].userData, 0) == RBUS_ERROR_SUCCESS) {
+            g_dataModels[i].proxy->subscribed = true;
+            subscribed++;
+         }
+         free((char *)subs[n].eventName);
+      }
+   }
+   free(subs);
+   printf("Subscribed to %d of %d cached parameters\n", subscribed, g_proxyEnd - g_proxyFirst);
+}
+
+// Method handler for Device.X_RDK_DataModels.GetCacheAge()
+// Each input property is named after a cached parameter under PROXY_PREFIX.
+// Outputs, under the same name, the milliseconds (uint32) since its value was
+// last fetched from the owner, or 0 while a subscription keeps it current.
+static rbusError_t getCacheAgeMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)asyncHandle;
+
+   uint64_t nowMs = monotonicMs();
+   for (rbusProperty_t prop = rbusObject_GetProperties(inParams); prop; prop = rbusProperty_GetNext(prop)) {
+      const char *name = rbusProperty_GetName(prop);
+      int i = findDataModel(name);
+      if (i < 0 || !g_dataModels[i].proxy) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      const ProxyState *proxy = g_dataModels[i].proxy;
+      uint64_t ageMs = proxy->subscribed ? 0 : nowMs - __atomic_load_n(&proxy->refreshedMs, __ATOMIC_RELAXED);
+      rbusValue_t value;
+      rbusValue_Init(&value);
+      rbusValue_SetUInt32(value, ageMs > UINT32_MAX ? UINT32_MAX : (uint32_t)ageMs);
+      rbusObject_SetValue(outParams, name, value);
+      rbusValue_Release(value);
+   }
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Growable byte buffer used by the HTTP gateway's streaming JSON writer. A
+// connection keeps its buffer between responses, so encoding does not allocate
+// once it has grown to the working size.
+typedef struct {
+   char *data;
+   size_t len;
+   size_t cap;
+   bool failed;              // An allocation failed and the content is incomplete
+} JsonWriter;
+
+typedef struct {
+   int fd;
+   char *in;                 // Received bytes not yet parsed as complete requests
+   size_t inLen;
+   size_t inCap;
+   JsonWriter out;           // Encoded responses, in request order
+   size_t outSent;
+   bool closeAfter;          // Close once the queued responses have been sent
+} HttpConn;
+
+static const char *g_httpSocketPath = NULL;
+static int g_httpListenFd = -1;
+static HttpConn *g_httpConns[HTTP_MAX_CONNECTIONS];
+
+static bool jwReserve(JsonWriter *w, size_t n) {
+   if (w->failed) {
+      return false;
+   }
+   if (w->len + n <= w->cap) {
+      return true;
+   }
+   size_t cap = w->cap ? w->cap : 4096;
+   while (cap < w->len + n) {
+      cap *= 2;
+   }
+   char *data = realloc(w->data, cap);
+   if (!data) {
+      w->failed = true;
+      return false;
+   }
+   w->data = data;
+   w->cap = cap;
+   return true;
+}
+
+static void jwAppend(JsonWriter *w, const char *s, size_t n) {
+   if (jwReserve(w, n)) {
+      memcpy(w->data + w->len, s, n);
+      w->len += n;
+   }
+}
+
+static void jwLiteral(JsonWriter *w, const char *s) {
+   jwAppend(w, s, strlen(s));
+}
+
+// Append a short formatted item such as a number; output is capped at 63 bytes
+static void jwFormat(JsonWriter *w, const char *fmt, ...) {
+   char buf[64];
+   va_list args;
+   va_start(args, fmt);
+   int n = vsnprintf(buf, sizeof(buf), fmt, args);
+   va_end(args);
+   if (n > 0) {
+      jwAppend(w, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+   }
+}
+
+static void jwString(JsonWriter *w, const char *s) {
+   static const char hex[] = "0123456789abcdef";
+   size_t n = strlen(s);
+   // Worst case every byte becomes a six-byte \u00XX escape
+   if (!jwReserve(w, n * 6 + 2)) {
+      return;
+   }
+   char *out = w->data + w->len;
+   *out++ = '"';
+   for (; *s; s++) {
+      unsigned char c = (unsigned char)*s;
+      if (c == '"' || c == '\\') {
+         *out++ = '\\';
+         *out++ = (char)c;
+      } else if (c < 0x20) {
+         *out++ = '\\';
+         *out++ = 'u';
+         *out++ = '0';
+         *out++ = '0';
+         *out++ = hex[c >> 4];
+         *out++ = hex[c & 0xF];
+      } else {
+         *out++ = (char)c;
+      }
+   }
+   *out++ = '"';
+   w->len = (size_t)(out - w->data);
+}
+
+static void jwDouble(JsonWriter *w, double d, int precision) {
+   if (isfinite(d)) {
+      jwFormat(w, "%.*g", precision, d);
+   } else {
+      jwLiteral(w, "null");
+   }
+}
+
+// Write the stored value of dm; the caller holds g_storeLock shared
+static void jwDataModel(JsonWriter *w, const DataModel *dm) {
+   switch (dm->type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      jwString(w, dm->value.strVal ? dm->value.strVal : "");
+      break;
+   case TYPE_INT:
+      jwFormat(w, "%" PRId32, __atomic_load_n(&dm->value.intVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_UINT:
+      jwFormat(w, "%" PRIu32, __atomic_load_n(&dm->value.uintVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_BOOL:
+      jwLiteral(w, dm->value.boolVal ? "true" : "false");
+      break;
+   case TYPE_LONG:
+      jwFormat(w, "%" PRId64, __atomic_load_n(&dm->value.longVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_ULONG:
+      jwFormat(w, "%" PRIu64, __atomic_load_n(&dm->value.ulongVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_FLOAT: {
+      float f;
+      __atomic_load(&dm->value.floatVal, &f, __ATOMIC_RELAXED);
+      jwDouble(w, f, 9);
+      break;
+   }
+   case TYPE_DOUBLE: {
+      double d;
+      __atomic_load(&dm->value.doubleVal, &d, __ATOMIC_RELAXED);
+      jwDouble(w, d, 17);
+      break;
+   }
+   case TYPE_BYTE:
+      jwFormat(w, "%u", (unsigned)__atomic_load_n(&dm->value.byteVal, __ATOMIC_RELAXED));
+      break;
+   }
+}
+
+static void jwValue(JsonWriter *w, rbusValue_t value) {
+   switch (rbusValue_GetType(value)) {
+   case RBUS_BOOLEAN:
+      jwLiteral(w, rbusValue_GetBoolean(value) ? "true" : "false");
+      break;
+   case RBUS_INT32:
+      jwFormat(w, "%" PRId32, rbusValue_GetInt32(value));
+      break;
+   case RBUS_UINT32:
+      jwFormat(w, "%" PRIu32, rbusValue_GetUInt32(value));
+      break;
+   case RBUS_INT64:
+      jwFormat(w, "%" PRId64, rbusValue_GetInt64(value));
+      break;
+   case RBUS_UINT64:
+      jwFormat(w, "%" PRIu64, rbusValue_GetUInt64(value));
+      break;
+   case RBUS_SINGLE:
+      jwDouble(w, rbusValue_GetSingle(value), 9);
+      break;
+   case RBUS_DOUBLE:
+      jwDouble(w, rbusValue_GetDouble(value), 17);
+      break;
+   case RBUS_BYTE:
+      jwFormat(w, "%u", (unsigned)rbusValue_GetByte(value));
+      break;
+   default: {
+      char *str = rbusValue_ToString(value, NULL, 0);
+      jwString(w, str ? str : "");
+      free(str);
+      break;
+   }
+   }
+}
+
+// Write "name":value for g_dataModels[i], preceded by a comma unless first
+static void jwParameter(JsonWriter *w, int i, bool *first) {
+   char buf[MAX_NAME_LEN];
+   const char *name = dataModelName(i, buf);
+   if (!*first) {
+      jwLiteral(w, ",");
+   }
+   *first = false;
+   jwString(w, name);
+   jwLiteral(w, ":");
+
+   if (g_dataModels[i].getHandler) {
+      rbusProperty_t property;
+      rbusProperty_Init(&property, name, NULL);
+      if (getDataModelValue(g_rbusHandle, i, property) == RBUS_ERROR_SUCCESS && rbusProperty_GetValue(property)) {
+         jwValue(w, rbusProperty_GetValue(property));
+      } else {
+         jwLiteral(w, "null");
+      }
+      rbusProperty_Release(property);
+      return;
+   }
+   pthread_rwlock_rdlock(&g_storeLock);
+   jwDataModel(w, &g_dataModels[i]);
+   pthread_rwlock_unlock(&g_storeLock);
+}
+
+// Convert a JSON value from a set request into the rbus type stored for type
+static bool jsonToValue(ValueType type, const cJSON *item, rbusValue_t value) {
+   if (type == TYPE_STRING || type == TYPE_DATETIME || type == TYPE_BASE64) {
+      if (!cJSON_IsString(item)) {
+         return false;
+      }
+      rbusValue_SetString(value, cJSON_GetStringValue(item));
+      return true;
+   }
+   if (type == TYPE_BOOL) {
+      if (!cJSON_IsBool(item)) {
+         return false;
+      }
+      rbusValue_SetBoolean(value, cJSON_IsTrue(item));
+      return true;
+   }
+   if (!cJSON_IsNumber(item)) {
+      return false;
+   }
+
+   double d = cJSON_GetNumberValue(item);
+   bool integral = d == (double)(int64_t)d;
+   switch (type) {
+   case TYPE_INT:
+      if (!integral || d < INT32_MIN || d > INT32_MAX) {
+         return false;
+      }
+      rbusValue_SetInt32(value, (int32_t)d);
+      return true;
+   case TYPE_UINT:
+      if (!integral || d < 0 || d > UINT32_MAX) {
+         return false;
+      }
+      rbusValue_SetUInt32(value, (uint32_t)d);
+      return true;
+   case TYPE_LONG:
+      if (!integral) {
+         return false;
+      }
+      rbusValue_SetInt64(value, (int64_t)d);
+      return true;
+   case TYPE_ULONG:
+      if (d < 0 || d >= 18446744073709551616.0 || d != (double)(uint64_t)d) {
+         return false;
+      }
+      rbusValue_SetUInt64(value, (uint64_t)d);
+      return true;
+   case TYPE_FLOAT:
+      rbusValue_SetSingle(value, (float)d);
+      return true;
+   case TYPE_DOUBLE:
+      rbusValue_SetDouble(value, d);
+      return true;
+   case TYPE_BYTE:
+      if (!integral || d < 0 || d > UINT8_MAX) {
+         return false;
+      }
+      rbusValue_SetByte(value, (uint8_t)d);
+      return true;
+   default:
+      return false;
+   }
+}
+
+// Length of the header section at buf including the blank line, or 0 if it
+// has not been received completely
+static size_t httpHeaderLength(const char *buf, size_t len) {
+   for (size_t n = 3; n < len; n++) {
+      if (buf[n] == '\n' && buf[n - 1] == '\r' && buf[n - 2] == '\n' && buf[n - 3] == '\r') {
+         return n + 1;
+      }
+   }
+   return 0;
+}
+
+// Parse the headers after the start line that the gateway and its benchmark
+// client care about
+static bool httpParseHeaders(const char *buf, size_t headerLen, size_t *contentLength, bool *close, bool *keepAlive) {
+   *contentLength = 0;
+   *close = false;
+   *keepAlive = false;
+   const char *end = buf + headerLen;
+   const char *line = memchr(buf, '\n', headerLen);
+   while (line && ++line < end) {
+      const char *value = memchr(line, ':', (size_t)(end - line));
+      if (!value) {
+         break;
+      }
+      value++;
+      while (*value == ' ' || *value == '\t') {
+         value++;
+      }
+      if (strncasecmp(line, "Content-Length:", 15) == 0) {
+         char *digitsEnd;
+         unsigned long long n = strtoull(value, &digitsEnd, 10);
+         if (digitsEnd == value) {
+            return false;
+         }
+         *contentLength = n > SIZE_MAX ? SIZE_MAX : (size_t)n;
+      } else if (strncasecmp(line, "Connection:", 11) == 0) {
+         *close = strncasecmp(value, "close", 5) == 0;
+         *keepAlive = strncasecmp(value, "keep-alive", 10) == 0;
+      }
+      line = memchr(line, '\n', (size_t)(end - line));
+   }
+   return true;
+}
+
+// Start a response in the connection's output buffer. The body is streamed
+// after it and its length patched in by httpEndResponse(), so the
+// Content-Length field is written as ten zero-padded digits.
+static size_t httpBeginResponse(HttpConn *conn, int status, const char *reason) {
+   JsonWriter *w = &conn->out;
+   jwFormat(w, "HTTP/1.1 %d ", status);
+   jwLiteral(w, reason);
+   jwLiteral(w, "\r\nContent-Type: application/json\r\n");
+   if (conn->closeAfter) {
+      jwLiteral(w, "Connection: close\r\n");
+   }
+   jwLiteral(w, "Content-Length: 0000000000\r\n\r\n");
+   return w->len;
+}
+
+static void httpEndResponse(HttpConn *conn, size_t bodyStart) {
+   JsonWriter *w = &conn->out;
+   if (!w->failed) {
+      char digits[11];
+      snprintf(digits, sizeof(digits), "%010zu", w->len - bodyStart);
+      memcpy(w->data + bodyStart - 14, digits, 10);
+   }
+}
+
+static void httpError(HttpConn *conn, int status, const char *reason, const char *message) {
+   size_t body = httpBeginResponse(conn, status, reason);
+   jwLiteral(&conn->out, "{\"error\":");
+   jwString(&conn->out, message);
+   jwLiteral(&conn->out, "}");
+   httpEndResponse(conn, body);
+}
+
+// Write g_dataModels[i] as a member and record the get in the flight recorder
+static void httpGetParameter(JsonWriter *w, int i, bool *first) {
+   uint64_t startNs = monotonicNs();
+   jwParameter(w, i, first);
+   flightRecord(g_dataModels[i].getHandler ? FLIGHT_LIVE_GET : FLIGHT_GET, i, HTTP_REQUESTER, startNs, 0, 0,
+      RBUS_ERROR_SUCCESS, false);
+}
+
+// POST /get: an array of names; a name ending in "." selects its whole subtree.
+// Responds with an object of name to value, where unknown names map to null.
+static void httpGet(HttpConn *conn, const cJSON *request) {
+   if (!cJSON_IsArray(request)) {
+      httpError(conn, 400, "Bad Request", "expected an array of names");
+      return;
+   }
+
+   size_t body = httpBeginResponse(conn, 200, "OK");
+   JsonWriter *w = &conn->out;
+   bool first = true;
+   char buf[MAX_NAME_LEN];
+   jwLiteral(w, "{");
+   const cJSON *item;
+   cJSON_ArrayForEach(item, request) {
+      const char *name = cJSON_GetStringValue(item);
+      if (!name) {
+         continue;
+      }
+      size_t len = strlen(name);
+      if (len > 0 && name[len - 1] == '.') {
+         for (int i = lowerBoundName(name); i < g_totalDataModels &&
+            strncmp(dataModelName(i, buf), name, len) == 0; i++) {
+            httpGetParameter(w, i, &first);
+         }
+         continue;
+      }
+      int i = findDataModel(name);
+      if (i >= 0) {
+         httpGetParameter(w, i, &first);
+      } else {
+         flightRecord(FLIGHT_GET, -1, HTTP_REQUESTER, monotonicNs(), 0, 0, RBUS_ERROR_INVALID_INPUT, false);
+         if (!first) {
+            jwLiteral(w, ",");
+         }
+         first = false;
+         jwString(w, name);
+         jwLiteral(w, ":null");
+      }
+   }
+   jwLiteral(w, "}");
+   httpEndResponse(conn, body);
+}
+
+// POST /search: {"prefix", "limit", "cursor"}, paged like GetPage(). Responds
+// with {"parameters": {...}, "nextCursor": "..."}.
+static void httpSearch(HttpConn *conn, const cJSON *request) {
+   const cJSON *prefixItem = cJSON_GetObjectItem(request, "prefix");
+   const cJSON *limitItem = cJSON_GetObjectItem(request, "limit");
+   const cJSON *cursorItem = cJSON_GetObjectItem(request, "cursor");
+   const char *prefix = prefixItem ? cJSON_GetStringValue(prefixItem) : "";
+   const char *cursor = cursorItem ? cJSON_GetStringValue(cursorItem) : "";
+   double limit = limitItem && cJSON_IsNumber(limitItem) ? cJSON_GetNumberValue(limitItem) : GETPAGE_DEFAULT_SIZE;
+   if (!cJSON_IsObject(request) || !prefix || !cursor || (limitItem && !cJSON_IsNumber(limitItem)) ||
+      limit < 1 || limit > GETPAGE_MAX_SIZE) {
+      httpError(conn, 400, "Bad Request", "expected prefix, limit (1-1000) and cursor");
+      return;
+   }
+
+   size_t prefixLen = strlen(prefix);
+   char buf[MAX_NAME_LEN];
+   int pos;
+   if (cursor[0] != '\0') {
+      if (strncmp(cursor, prefix, prefixLen) != 0) {
+         httpError(conn, 400, "Bad Request", "cursor is outside prefix");
+         return;
+      }
+      pos = lowerBoundName(cursor);
+      if (pos < g_totalDataModels && strcmp(dataModelName(pos, buf), cursor) == 0) {
+         pos++;
+      }
+   } else {
+      pos = lowerBoundName(prefix);
+   }
+
+   size_t body = httpBeginResponse(conn, 200, "OK");
+   JsonWriter *w = &conn->out;
+   bool first = true;
+   int count = 0;
+   int last = -1;
+   jwLiteral(w, "{\"parameters\":{");
+   for (; pos < g_totalDataModels && count < (int)limit; pos++) {
+      if (strncmp(dataModelName(pos, buf), prefix, prefixLen) != 0) {
+         break;
+      }
+      jwParameter(w, pos, &first);
+      last = pos;
+      count++;
+   }
+   bool more = last >= 0 && pos < g_totalDataModels && strncmp(dataModelName(pos, buf), prefix, prefixLen) == 0;
+   jwLiteral(w, "},\"nextCursor\":");
+   jwString(w, more ? dataModelName(last, buf) : "");
+   jwLiteral(w, "}");
+   httpEndResponse(conn, body);
+}
+
+// POST /set: an object of name to new value, applied as one store operation
+// like Set(). Responds with {"applied": count}. Each applied value, or the
+// one that failed the batch, is recorded in the flight recorder.
+static void httpSet(HttpConn *conn, const cJSON *request) {
+   uint64_t startNs = monotonicNs();
+   if (!cJSON_IsObject(request)) {
+      httpError(conn, 400, "Bad Request", "expected an object of names to values");
+      return;
+   }
+
+   int size = cJSON_GetArraySize(request);
+   SetEntry *entries = calloc(size ? size : 1, sizeof(SetEntry));
+   if (!entries) {
+      httpError(conn, 500, "Internal Server Error", "out of memory");
+      return;
+   }
+
+   int numEntries = 0;
+   const char *error = NULL;
+   int failed = -1;
+   rbusError_t rc = RBUS_ERROR_SUCCESS;
+   const cJSON *item;
+   cJSON_ArrayForEach(item, request) {
+      SetEntry *entry = &entries[numEntries];
+      entry->name = item->string;
+      entry->index = failed = findDataModel(item->string);
+      // Live values cannot be set through the store
+      if (entry->index < 0 || g_dataModels[entry->index].getHandler) {
+         error = "unknown or read-only parameter";
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      rbusValue_Init(&entry->newValue);
+      numEntries++;
+      if (!jsonToValue(g_dataModels[entry->index].type, item, entry->newValue)) {
+         error = "value does not match the parameter type";
+         rc = RBUS_ERROR_INVALID_INPUT;
+         break;
+      }
+      rc = prepareStoreValue(entry->index, entry->newValue, &entry->str);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         error = "out of memory";
+         break;
+      }
+   }
+
+   finishSetEntries(entries, numEntries, !error, 0);
+   if (error) {
+      flightRecord(FLIGHT_SET, failed, HTTP_REQUESTER, startNs, 0, 0, rc, false);
+   }
+   for (int e = 0; e < numEntries; e++) {
+      if (!error) {
+         flightRecord(FLIGHT_SET, entries[e].index, HTTP_REQUESTER, startNs, 0, 0, RBUS_ERROR_SUCCESS, false);
+      }
+      rbusValue_Release(entries[e].newValue);
+   }
+   free(entries);
+
+   if (error) {
+      char message[MAX_NAME_LEN + 64];
+      snprintf(message, sizeof(message), "%s: %s", error, item->string);
+      httpError(conn, 400, "Bad Request", message);
+      return;
+   }
+   size_t body = httpBeginResponse(conn, 200, "OK");
+   jwFormat(&conn->out, "{\"applied\":%d}", numEntries);
+   httpEndResponse(conn, body);
+}
+
+static void httpHandleRequest(HttpConn *conn, const char *method, const char *path, const char *body) {
+   if (strcmp(method, "POST") != 0) {
+      httpError(conn, 405, "Method Not Allowed", "use POST");
+      return;
+   }
+   void (*handler)(HttpConn *, const cJSON *) = NULL;
+   if (strcmp(path, "/get") == 0) {
+      handler = httpGet;
+   } else if (strcmp(path, "/set") == 0) {
+      handler = httpSet;
+   } else if (strcmp(path, "/search") == 0) {
+      handler = httpSearch;
+   } else {
+      httpError(conn, 404, "Not Found", "use /get, /set or /search");
+      return;
+   }
+
+   cJSON *request = cJSON_Parse(body);
+   if (!request) {
+      httpError(conn, 400, "Bad Request", "invalid JSON");
+      return;
+   }
+   handler(conn, request);
+   cJSON_Delete(request);
+}
+
+// Answer every complete request in the input buffer, in order. Pipelined
+// requests queue their responses back to back in the output buffer.
+static void httpProcess(HttpConn *conn) {
+   size_t pos = 0;
+   while (!conn->closeAfter) {
+      char *start = conn->in + pos;
+      size_t avail = conn->inLen - pos;
+      size_t headerLen = httpHeaderLength(start, avail < HTTP_MAX_HEADER ? avail : HTTP_MAX_HEADER);
+      if (headerLen == 0) {
+         if (avail >= HTTP_MAX_HEADER) {
+            conn->closeAfter = true;
+            httpError(conn, 431, "Request Header Fields Too Large", "header section too large");
+         }
+         break;
+      }
+
+      // The input is not terminated, so only a copy of the request line is
+      // scanned; the header section ends in a line feed, so it has one
+      char line[64];
+      size_t lineLen = (size_t)((const char *)memchr(start, '\n', headerLen) - start);
+      if (lineLen >= sizeof(line)) {
+         lineLen = 0;
+      }
+      memcpy(line, start, lineLen);
+      line[lineLen] = '\0';
+      char method[8] = "";
+      char path[32] = "";
+      char version[9] = "";
+      size_t contentLength;
+      bool close, keepAlive;
+      if (sscanf(line, "%7s %31s %8s", method, path, version) != 3 ||
+         !httpParseHeaders(start, headerLen, &contentLength, &close, &keepAlive)) {
+         conn->closeAfter = true;
+         httpError(conn, 400, "Bad Request", "malformed request");
+         break;
+      }
+      if (contentLength > HTTP_MAX_BODY) {
+         conn->closeAfter = true;
+         httpError(conn, 413, "Payload Too Large", "request body too large");
+         break;
+      }
+      if (avail < headerLen + contentLength) {
+         break;
+      }
+
+      // HTTP/1.0 clients must ask for keep-alive explicitly
+      conn->closeAfter = close || (strcmp(version, "HTTP/1.0") == 0 && !keepAlive);
+      // The input buffer always has a spare byte, so the body can be
+      // terminated in place for the JSON parser
+      char *body = start + headerLen;
+      char saved = body[contentLength];
+      body[contentLength] = '\0';
+      httpHandleRequest(conn, method, path, body);
+      body[contentLength] = saved;
+      pos += headerLen + contentLength;
+   }
+
+   memmove(conn->in, conn->in + pos, conn->inLen - pos);
+   conn->inLen -= pos;
+}
+
+static void httpClose(HttpConn *conn) {
+   reactorRemove(conn->fd);
+   close(conn->fd);
+   for (int c = 0; c < HTTP_MAX_CONNECTIONS; c++) {
+      if (g_httpConns[c] == conn) {
+         g_httpConns[c] = NULL;
+      }
+   }
+   free(conn->in);
+   free(conn->out.data);
+   free(conn);
+}
+
+// Send queued responses. While some are unsent the connection waits for
+// POLLOUT only, so a client that does not read stops being read from.
+static void httpFlush(HttpConn *conn) {
+   if (conn->out.failed) {
+      httpClose(conn);
+      return;
+   }
+   while (conn->outSent < conn->out.len) {
+      ssize_t n = send(conn->fd, conn->out.data + conn->outSent, conn->out.len - conn->outSent, 0);
+      if (n > 0) {
+         conn->outSent += (size_t)n;
+      } else if (n < 0 && errno == EINTR) {
+         continue;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         reactorModify(conn->fd, POLLOUT);
+         return;
+      } else {
+         httpClose(conn);
+         return;
+      }
+   }
+
+   conn->out.len = 0;
+   conn->outSent = 0;
+   if (conn->out.cap > HTTP_BUFFER_KEEP) {
+      free(conn->out.data);
+      conn->out.data = NULL;
+      conn->out.cap = 0;
+   }
+   if (conn->closeAfter) {
+      httpClose(conn);
+      return;
+   }
+   reactorModify(conn->fd, POLLIN);
+}
+
+static void httpConnEvent(int fd, short revents, void *arg) {
+   HttpConn *conn = arg;
+   if (revents & (POLLERR | POLLNVAL)) {
+      httpClose(conn);
+      return;
+   }
+
+   if (revents & (POLLIN | POLLHUP)) {
+      // Keep room for a full request plus the terminating byte of its body
+      if (conn->inCap - conn->inLen < 4096 + 1) {
+         size_t cap = conn->inCap ? conn->inCap * 2 : 8192;
+         if (cap > HTTP_MAX_INPUT) {
+            cap = HTTP_MAX_INPUT;
+         }
+         char *in = cap > conn->inCap ? realloc(conn->in, cap) : NULL;
+         if (!in) {
+            httpClose(conn);
+            return;
+         }
+         conn->in = in;
+         conn->inCap = cap;
+      }
+      ssize_t n = read(fd, conn->in + conn->inLen, conn->inCap - conn->inLen - 1);
+      if (n > 0) {
+         conn->inLen += (size_t)n;
+         httpProcess(conn);
+      } else if (n == 0) {
+         // The client is done sending; answer what it sent, then close
+         httpProcess(conn);
+         conn->closeAfter = true;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+         httpClose(conn);
+         return;
+      }
+   }
+   httpFlush(conn);
+}
+
+static void httpAccept(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   for (;;) {
+      int client = accept(fd, NULL, NULL);
+      if (client < 0) {
+         return;
+      }
+      int slot = 0;
+      while (slot < HTTP_MAX_CONNECTIONS && g_httpConns[slot]) {
+         slot++;
+      }
+      HttpConn *conn = slot < HTTP_MAX_CONNECTIONS ? calloc(1, sizeof(HttpConn)) : NULL;
+      if (!conn || !setNonBlocking(client) || !reactorAdd(client, POLLIN, httpConnEvent, conn)) {
+         free(conn);
+         close(client);
+         continue;
+      }
+      conn->fd = client;
+      g_httpConns[slot] = conn;
+   }
+}
+
+// Listen for HTTP/1.1 requests on a Unix domain socket at path
+static bool httpStart(const char *path) {
+   struct sockaddr_un addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "HTTP socket path too long: %s\n", path);
+      return false;
+   }
+   strcpy(addr.sun_path, path);
+
+   // Only replace a socket left behind by an earlier run
+   struct stat st;
+   bool exists = lstat(path, &st) == 0;
+   if (exists && !S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "%s exists and is not a socket\n", path);
+      return false;
+   }
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0) {
+      perror("socket");
+      return false;
+   }
+   if (exists) {
+      unlink(path);
+   }
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, HTTP_MAX_CONNECTIONS) < 0 ||
+      !setNonBlocking(fd) || !reactorAdd(fd, POLLIN, httpAccept, NULL)) {
+      fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+      close(fd);
+      return false;
+   }
+   g_httpListenFd = fd;
+   g_httpSocketPath = path;
+   printf("Serving HTTP on %s\n", path);
+   return true;
+}
+
+static void httpStop(void) {
+   for (int c = 0; c < HTTP_MAX_CONNECTIONS; c++) {
+      if (g_httpConns[c]) {
+         httpClose(g_httpConns[c]);
+      }
+   }
+   if (g_httpListenFd >= 0) {
+      reactorRemove(g_httpListenFd);
+      close(g_httpListenFd);
+      unlink(g_httpSocketPath);
+      g_httpListenFd = -1;
+   }
+}
+
+// Benchmark client: send count copies of request over fd with up to
+// HTTP_BENCH_DEPTH pipelined, reading the responses as they arrive. The body
+// of the last response is left in lastBody if it is not NULL.
+static int httpClientRun(int fd, const char *request, size_t requestLen, int count, JsonWriter *in, JsonWriter *lastBody) {
+   int sent = 0;
+   int done = 0;
+   size_t writeOffset = 0;
+   while (done < count) {
+      bool wantWrite = sent < count && (writeOffset > 0 || sent - done < HTTP_BENCH_DEPTH);
+      struct pollfd pfd = {fd, (short)(POLLIN | (wantWrite ? POLLOUT : 0)), 0};
+      if (poll(&pfd, 1, 5000) <= 0) {
+         fprintf(stderr, "Timed out waiting for the provider\n");
+         return 1;
+      }
+
+      if (pfd.revents & POLLOUT) {
+         ssize_t n = send(fd, request + writeOffset, requestLen - writeOffset, 0);
+         if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            perror("send");
+            return 1;
+         }
+         if (n > 0 && (writeOffset += (size_t)n) == requestLen) {
+            writeOffset = 0;
+            sent++;
+         }
+      }
+
+      if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+         if (!jwReserve(in, 65536)) {
+            return 1;
+         }
+         ssize_t n = read(fd, in->data + in->len, in->cap - in->len);
+         if (n <= 0) {
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+               continue;
+            }
+            fprintf(stderr, "Provider closed the connection\n");
+            return 1;
+         }
+         in->len += (size_t)n;
+
+         size_t pos = 0;
+         for (;;) {
+            size_t headerLen = httpHeaderLength(in->data + pos, in->len - pos);
+            size_t contentLength;
+            bool close, keepAlive;
+            if (headerLen == 0 ||
+               !httpParseHeaders(in->data + pos, headerLen, &contentLength, &close, &keepAlive) ||
+               in->len - pos < headerLen + contentLength) {
+               break;
+            }
+            if (strncmp(in->data + pos, "HTTP/1.1 200", 12) != 0) {
+               fprintf(stderr, "Request failed: %.*s\n", (int)contentLength, in->data + pos + headerLen);
+               return 1;
+            }
+            if (lastBody) {
+               lastBody->len = 0;
+               jwAppend(lastBody, in->data + pos + headerLen, contentLength);
+               jwAppend(lastBody, "", 1);
+            }
+            pos += headerLen + contentLength;
+            done++;
+         }
+         memmove(in->data, in->data + pos, in->len - pos);
+         in->len -= pos;
+      }
+   }
+   return 0;
+}
+
+// Build a POST request for path with body in w, replacing its content
+static void httpClientRequest(JsonWriter *w, const char *path, const char *body, size_t bodyLen) {
+   w->len = 0;
+   jwLiteral(w, "POST ");
+   jwLiteral(w, path);
+   jwLiteral(w, " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n");
+   jwFormat(w, "Content-Length: %zu\r\n\r\n", bodyLen);
+   jwAppend(w, body, bodyLen);
+}
+
+// Measure batched gets against the HTTP gateway of a running provider: each
+// request asks for the first GETPAGE_MAX_SIZE parameters of the model
+static int runHttpBenchmark(const char *path, int count) {
+   struct sockaddr_un addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "HTTP socket path too long: %s\n", path);
+      return 1;
+   }
+   strcpy(addr.sun_path, path);
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || !setNonBlocking(fd)) {
+      fprintf(stderr, "Failed to connect to %s: %s\n", path, strerror(errno));
+      if (fd >= 0) {
+         close(fd);
+      }
+      return 1;
+   }
+
+   JsonWriter in = {0}, request = {0}, body = {0}, names = {0};
+   int result = 1;
+   char search[64];
+   int searchLen = snprintf(search, sizeof(search), "{\"prefix\":\"Device.\",\"limit\":%d}", GETPAGE_MAX_SIZE);
+   httpClientRequest(&request, "/search", search, (size_t)searchLen);
+   cJSON *page = NULL;
+   if (httpClientRun(fd, request.data, request.len, 1, &in, &body) == 0 && !body.failed) {
+      page = cJSON_Parse(body.data);
+   }
+   const cJSON *parameters = page ? cJSON_GetObjectItem(page, "parameters") : NULL;
+   int numNames = 0;
+   const cJSON *item;
+   jwLiteral(&names, "[");
+   cJSON_ArrayForEach(item, parameters) {
+      jwLiteral(&names, numNames++ ? "," : "");
+      jwString(&names, item->string);
+   }
+   jwLiteral(&names, "]");
+   cJSON_Delete(page);
+
+   if (numNames > 0 && !names.failed) {
+      httpClientRequest(&request, "/get", names.data, names.len);
+      uint64_t start = realMonotonicNs();
+      result = httpClientRun(fd, request.data, request.len, count, &in, NULL);
+      uint64_t elapsed = realMonotonicNs() - start;
+      if (result == 0) {
+         fprintf(stdout, "HTTP gateway: %d requests of %d parameters, %d pipelined\n", count, numNames, HTTP_BENCH_DEPTH);
+         fprintf(stdout, "  %9.0f requests/s, %11.0f parameters/s, %8.1f us avg\n",
+            count * 1e9 / elapsed, (double)count * numNames * 1e9 / elapsed, elapsed / 1e3 / count);
+      }
+   } else {
+      fprintf(stderr, "Failed to list parameters through %s\n", path);
+   }
+
+   free(in.data);
+   free(request.data);
+   free(body.data);
+   free(names.data);
+   close(fd);
+   return result;
+}
+
+typedef enum {
+   REPORT_JSON,
+   REPORT_CBOR
+} ReportFormat;
+
+// Report profile: a set of parameters written to a destination every interval
+typedef struct {
+   bool inUse;
+   char name[REPORT_MAX_NAME];
+   char **parameters;        // Names, or prefixes ending in "." for subtrees
+   int numParameters;
+   uint32_t intervalSec;
+   ReportFormat format;
+   char destination[108];    // A file path, or "unix:" and a datagram socket path
+   Timer timer;
+   JsonWriter buf;           // Reused for every report of this profile
+} ReportProfile;
+
+// Guards g_reportProfiles; taken before g_storeLock
+static pthread_mutex_t g_reportLock = PTHREAD_MUTEX_INITIALIZER;
+static ReportProfile g_reportProfiles[REPORT_MAX_PROFILES];
+static SchedTask g_reportTasks[REPORT_MAX_PROFILES];
+
+// Minimal CBOR (RFC 8949) encoding into a JsonWriter buffer
+static void cborHead(JsonWriter *w, uint8_t major, uint64_t value) {
+   uint8_t head[9];
+   size_t n;
+   if (value < 24) {
+      head[0] = (uint8_t)(major << 5 | value);
+      n = 1;
+   } else if (value <= UINT8_MAX) {
+      head[0] = (uint8_t)(major << 5 | 24);
+      head[1] = (uint8_t)value;
+      n = 2;
+   } else if (value <= UINT16_MAX) {
+      head[0] = (uint8_t)(major << 5 | 25);
+      head[1] = (uint8_t)(value >> 8);
+      head[2] = (uint8_t)value;
+      n = 3;
+   } else if (value <= UINT32_MAX) {
+      head[0] = (uint8_t)(major << 5 | 26);
+      for (int b = 0; b < 4; b++) {
+         head[1 + b] = (uint8_t)(value >> (24 - 8 * b));
+      }
+      n = 5;
+   } else {
+      head[0] = (uint8_t)(major << 5 | 27);
+      for (int b = 0; b < 8; b++) {
+         head[1 + b] = (uint8_t)(value >> (56 - 8 * b));
+      }
+      n = 9;
+   }
+   jwAppend(w, (const char *)head, n);
+}
+
+static void cborText(JsonWriter *w, const char *s) {
+   size_t len = strlen(s);
+   cborHead(w, 3, len);
+   jwAppend(w, s, len);
+}
+
+static void cborInt(JsonWriter *w, int64_t v) {
+   if (v >= 0) {
+      cborHead(w, 0, (uint64_t)v);
+   } else {
+      cborHead(w, 1, (uint64_t)(-(v + 1)));
+   }
+}
+
+static void cborDouble(JsonWriter *w, double d) {
+   uint64_t bits;
+   memcpy(&bits, &d, sizeof(bits));
+   uint8_t out[9] = {0xfb};  // Major type 7, 64-bit float
+   for (int b = 0; b < 8; b++) {
+      out[1 + b] = (uint8_t)(bits >> (56 - 8 * b));
+   }
+   jwAppend(w, (const char *)out, sizeof(out));
+}
+
+static void cborBool(JsonWriter *w, bool b) {
+   jwAppend(w, b ? "\xf5" : "\xf4", 1);
+}
+
+// Write the stored value of dm; the caller holds g_storeLock shared
+static void cborDataModel(JsonWriter *w, const DataModel *dm) {
+   switch (dm->type) {
+   case TYPE_STRING:
+   case TYPE_DATETIME:
+   case TYPE_BASE64:
+      cborText(w, dm->value.strVal ? dm->value.strVal : "");
+      break;
+   case TYPE_INT:
+      cborInt(w, __atomic_load_n(&dm->value.intVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_UINT:
+      cborHead(w, 0, __atomic_load_n(&dm->value.uintVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_BOOL:
+      cborBool(w, dm->value.boolVal);
+      break;
+   case TYPE_LONG:
+      cborInt(w, __atomic_load_n(&dm->value.longVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_ULONG:
+      cborHead(w, 0, __atomic_load_n(&dm->value.ulongVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_FLOAT: {
+      float f;
+      __atomic_load(&dm->value.floatVal, &f, __ATOMIC_RELAXED);
+      cborDouble(w, f);
+      break;
+   }
+   case TYPE_DOUBLE: {
+      double d;
+      __atomic_load(&dm->value.doubleVal, &d, __ATOMIC_RELAXED);
+      cborDouble(w, d);
+      break;
+   }
+   case TYPE_BYTE:
+      cborHead(w, 0, __atomic_load_n(&dm->value.byteVal, __ATOMIC_RELAXED));
+      break;
+   }
+}
+
+static void cborValue(JsonWriter *w, rbusValue_t value) {
+   switch (rbusValue_GetType(value)) {
+   case RBUS_BOOLEAN:
+      cborBool(w, rbusValue_GetBoolean(value));
+      break;
+   case RBUS_INT32:
+      cborInt(w, rbusValue_GetInt32(value));
+      break;
+   case RBUS_UINT32:
+      cborHead(w, 0, rbusValue_GetUInt32(value));
+      break;
+   case RBUS_INT64:
+      cborInt(w, rbusValue_GetInt64(value));
+      break;
+   case RBUS_UINT64:
+      cborHead(w, 0, rbusValue_GetUInt64(value));
+      break;
+   case RBUS_SINGLE:
+      cborDouble(w, rbusValue_GetSingle(value));
+      break;
+   case RBUS_DOUBLE:
+      cborDouble(w, rbusValue_GetDouble(value));
+      break;
+   case RBUS_BYTE:
+      cborHead(w, 0, rbusValue_GetByte(value));
+      break;
+   default: {
+      char *str = rbusValue_ToString(value, NULL, 0);
+      cborText(w, str ? str : "");
+      free(str);
+      break;
+   }
+   }
+}
+
+// Write "name":value (JSON) or a name/value pair (CBOR) for g_dataModels[i].
+// Stored values are written from the caller's hold of g_storeLock.
+static void reportStoredParameter(ReportProfile *profile, int i, bool *first) {
+   char buf[MAX_NAME_LEN];
+   const char *name = dataModelName(i, buf);
+   JsonWriter *w = &profile->buf;
+   if (profile->format == REPORT_CBOR) {
+      cborText(w, name);
+      cborDataModel(w, &g_dataModels[i]);
+   } else {
+      jwLiteral(w, *first ? "" : ",");
+      jwString(w, name);
+      jwLiteral(w, ":");
+      jwDataModel(w, &g_dataModels[i]);
+   }
+   *first = false;
+}
+
+static void reportLiveParameter(ReportProfile *profile, int i, bool *first) {
+   char buf[MAX_NAME_LEN];
+   const char *name = dataModelName(i, buf);
+   JsonWriter *w = &profile->buf;
+   rbusProperty_t property;
+   rbusProperty_Init(&property, name, NULL);
+   if (getDataModelValue(g_rbusHandle, i, property) == RBUS_ERROR_SUCCESS && rbusProperty_GetValue(property)) {
+      if (profile->format == REPORT_CBOR) {
+         cborText(w, name);
+         cborValue(w, rbusProperty_GetValue(property));
+      } else {
+         jwLiteral(w, *first ? "" : ",");
+         jwString(w, name);
+         jwLiteral(w, ":");
+         jwValue(w, rbusProperty_GetValue(property));
+      }
+      *first = false;
+   }
+   rbusProperty_Release(property);
+}
+
+// Index range [*begin, *end) of the parameters matched by a profile entry
+static void reportRange(const char *parameter, int *begin, int *end) {
+   size_t len = strlen(parameter);
+   if (len > 0 && parameter[len - 1] == '.') {
+      char buf[MAX_NAME_LEN];
+      *begin = lowerBoundName(parameter);
+      *end = *begin;
+      while (*end < g_totalDataModels && strncmp(dataModelName(*end, buf), parameter, len) == 0) {
+         (*end)++;
+      }
+   } else {
+      *begin = findDataModel(parameter);
+      *end = *begin < 0 ? *begin : *begin + 1;
+   }
+}
+
+// Encode one report of profile into its buffer. All stored values come from a
+// single shared hold of the store lock, so they form a consistent snapshot;
+// live values are computed after it.
+static void reportEncode(ReportProfile *profile) {
+   JsonWriter *w = &profile->buf;
+   uint64_t timestampMs = wallclockUs() / 1000;
+
+   w->len = 0;
+   w->failed = false;
+   if (profile->format == REPORT_CBOR) {
+      cborHead(w, 5, 3);
+      cborText(w, "Profile");
+      cborText(w, profile->name);
+      cborText(w, "Timestamp");
+      cborHead(w, 0, timestampMs);
+      cborText(w, "Report");
+      jwAppend(w, "\xbf", 1);  // Indefinite-length map
+   } else {
+      jwLiteral(w, "{\"Profile\":");
+      jwString(w, profile->name);
+      jwFormat(w, ",\"Timestamp\":%" PRIu64 ",\"Report\":{", timestampMs);
+   }
+
+   bool first = true;
+   int begin, end;
+   pthread_rwlock_rdlock(&g_storeLock);
+   for (int p = 0; p < profile->numParameters; p++) {
+      reportRange(profile->parameters[p], &begin, &end);
+      for (int i = begin; i < end; i++) {
+         if (!g_dataModels[i].getHandler) {
+            reportStoredParameter(profile, i, &first);
+         }
+      }
+   }
+   pthread_rwlock_unlock(&g_storeLock);
+   for (int p = 0; p < profile->numParameters; p++) {
+      reportRange(profile->parameters[p], &begin, &end);
+      for (int i = begin; i < end; i++) {
+         if (g_dataModels[i].getHandler) {
+            reportLiveParameter(profile, i, &first);
+         }
+      }
+   }
+
+   if (profile->format == REPORT_CBOR) {
+      jwAppend(w, "\xff", 1);
+   } else {
+      jwLiteral(w, "}}\n");
+   }
+}
+
+// Write the encoded report: a file is replaced atomically through a rename,
+// and a Unix socket receives the report as one datagram
+static void reportWrite(ReportProfile *profile) {
+   JsonWriter *w = &profile->buf;
+   if (w->failed) {
+      fprintf(stderr, "Report %s: out of memory\n", profile->name);
+      return;
+   }
+
+   if (strncmp(profile->destination, "unix:", 5) == 0) {
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", profile->destination + 5);
+      int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+      if (fd < 0) {
+         return;
+      }
+      setNonBlocking(fd);
+      if (sendto(fd, w->data, w->len, 0, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+         fprintf(stderr, "Report %s: %s: %s\n", profile->name, profile->destination, strerror(errno));
+      }
+      close(fd);
+      return;
+   }
+
+   char tmp[sizeof(profile->destination) + 4];
+   snprintf(tmp, sizeof(tmp), "%s.tmp", profile->destination);
+   FILE *f = fopen(tmp, "wb");
+   if (!f) {
+      fprintf(stderr, "Report %s: %s: %s\n", profile->name, tmp, strerror(errno));
+      return;
+   }
+   bool ok = fwrite(w->data, 1, w->len, f) == w->len;
+   ok = fclose(f) == 0 && ok;
+   if (!ok || rename(tmp, profile->destination) != 0) {
+      fprintf(stderr, "Report %s: %s: %s\n", profile->name, profile->destination, strerror(errno));
+      unlink(tmp);
+   }
+}
+
+// Timer callback for g_reportProfiles[(intptr_t)arg]: the report is encoded
+// and written by a background task
+static void reportTimer(void *arg) {
+   schedSubmit(&g_reportTasks[(intptr_t)arg]);
+}
+
+static void reportRun(void *arg) {
+   ReportProfile *profile = &g_reportProfiles[(intptr_t)arg];
+   pthread_mutex_lock(&g_reportLock);
+   // Skip a profile removed, or replaced and re-armed, after this expiry was dequeued
+   if (profile->inUse && !timerArmed(&profile->timer)) {
+      reportEncode(profile);
+      reportWrite(profile);
+      timerStart(&profile->timer, profile->intervalSec * 1000ULL, reportTimer, arg);
+   }
+   pthread_mutex_unlock(&g_reportLock);
+}
+
+static void reportProfileFree(ReportProfile *profile) {
+   timerCancel(&profile->timer);
+   for (int p = 0; p < profile->numParameters; p++) {
+      free(profile->parameters[p]);
+   }
+   free(profile->parameters);
+   free(profile->buf.data);
+   memset(profile, 0, sizeof(*profile));
+}
+
+static ReportProfile *reportProfileFind(const char *name) {
+   for (int r = 0; r < REPORT_MAX_PROFILES; r++) {
+      if (g_reportProfiles[r].inUse && strcmp(g_reportProfiles[r].name, name) == 0) {
+         return &g_reportProfiles[r];
+      }
+   }
+   return NULL;
+}
+
+static const char *methodStringParam(rbusObject_t inParams, const char *name) {
+   rbusValue_t value = rbusObject_GetValue(inParams, name);
+   return value && rbusValue_GetType(value) == RBUS_STRING ? rbusValue_GetString(value, NULL) : NULL;
+}
+
+// Method handler for Device.X_RDK_DataModels.AddReportProfile()
+// Inputs: Name (string), Parameters (string, comma-separated names or prefixes
+// ending in "."), Interval (uint32 seconds), Format ("json" or "cbor", default
+// json) and Destination (file path, or "unix:" and a datagram socket path).
+// A profile with the same name is replaced.
+static rbusError_t addReportProfileMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)outParams;
+   (void)asyncHandle;
+
+   const char *name = methodStringParam(inParams, "Name");
+   const char *parameters = methodStringParam(inParams, "Parameters");
+   const char *format = methodStringParam(inParams, "Format");
+   const char *destination = methodStringParam(inParams, "Destination");
+   rbusValue_t interval = rbusObject_GetValue(inParams, "Interval");
+   if (!name || !name[0] || strlen(name) >= REPORT_MAX_NAME || !parameters || !destination ||
+      !destination[0] || strlen(destination) >= sizeof(((ReportProfile *)0)->destination) ||
+      !interval || rbusValue_GetType(interval) != RBUS_UINT32 || rbusValue_GetUInt32(interval) == 0 ||
+      (format && strcmp(format, "json") != 0 && strcmp(format, "cbor") != 0)) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   ReportProfile profile;
+   memset(&profile, 0, sizeof(profile));
+   profile.inUse = true;
+   strcpy(profile.name, name);
+   strcpy(profile.destination, destination);
+   profile.intervalSec = rbusValue_GetUInt32(interval);
+   profile.format = format && strcmp(format, "cbor") == 0 ? REPORT_CBOR : REPORT_JSON;
+
+   char *list = strdup(parameters);
+   if (!list) {
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   char *save = NULL;
+   for (char *token = strtok_r(list, ", ", &save); token; token = strtok_r(NULL, ", ", &save)) {
+      char **grown = realloc(profile.parameters, (profile.numParameters + 1) * sizeof(char *));
+      char *copy = strdup(token);
+      if (!grown || !copy) {
+         free(copy);
+         profile.parameters = grown ? grown : profile.parameters;
+         reportProfileFree(&profile);
+         free(list);
+         return RBUS_ERROR_OUT_OF_RESOURCES;
+      }
+      profile.parameters = grown;
+      profile.parameters[profile.numParameters++] = copy;
+   }
+   free(list);
+   if (profile.numParameters == 0) {
+      reportProfileFree(&profile);
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   pthread_mutex_lock(&g_reportLock);
+   ReportProfile *slot = reportProfileFind(name);
+   if (slot) {
+      reportProfileFree(slot);
+   } else {
+      for (int r = 0; r < REPORT_MAX_PROFILES && !slot; r++) {
+         if (!g_reportProfiles[r].inUse) {
+            slot = &g_reportProfiles[r];
+         }
+      }
+   }
+   if (!slot) {
+      pthread_mutex_unlock(&g_reportLock);
+      reportProfileFree(&profile);
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   *slot = profile;
+   intptr_t index = slot - g_reportProfiles;
+   if (!g_reportTasks[index].run) {
+      schedInit(&g_reportTasks[index], SCHED_BACKGROUND, reportRun, (void *)index);
+   }
+   timerStart(&slot->timer, slot->intervalSec * 1000ULL, reportTimer, (void *)index);
+   pthread_mutex_unlock(&g_reportLock);
+   printf("Report profile %s: %d entries every %u s to %s\n", name, profile.numParameters, profile.intervalSec, destination);
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Method handler for Device.X_RDK_DataModels.RemoveReportProfile()
+// Input: Name (string)
+static rbusError_t removeReportProfileMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)outParams;
+   (void)asyncHandle;
+
+   const char *name = methodStringParam(inParams, "Name");
+   if (!name) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   pthread_mutex_lock(&g_reportLock);
+   ReportProfile *profile = reportProfileFind(name);
+   if (profile) {
+      reportProfileFree(profile);
+   }
+   pthread_mutex_unlock(&g_reportLock);
+   return profile ? RBUS_ERROR_SUCCESS : RBUS_ERROR_INVALID_INPUT;
+}
+
+// IP diagnostics: IPPing() and UDPEchoDiagnostics() run as async methods on the
+// main loop. Probes of all running diagnostics share one non-blocking socket per
+// protocol and address family, and each probe carries its test slot, slot
+// generation and sequence number, so replies are matched without a socket or
+// ICMP identifier per test.
+typedef enum {
+   DIAG_IPPING,
+   DIAG_UDPECHO,
+   DIAG_DOWNLOAD,
+   DIAG_UPLOAD
+} DiagKind;
+
+enum {
+   DIAG_SOCKET_ICMP4,
+   DIAG_SOCKET_ICMP6,
+   DIAG_SOCKET_UDP4,
+   DIAG_SOCKET_UDP6,
+   DIAG_NUM_SOCKETS
+};
+
+typedef struct {
+   uint32_t magic;
+   uint16_t test;
+   uint16_t generation;
+   uint32_t sequence;
+} DiagProbe;
+
+typedef struct {
+   bool inUse;               // Written under g_diagLock, read by the main loop
+   DiagKind kind;
+   uint16_t generation;
+   int socket;               // Index into g_diagFds
+   rbusMethodAsyncHandle_t asyncHandle;
+   struct sockaddr_storage addr;
+   socklen_t addrLen;
+   char host[MAX_NAME_LEN];
+   uint32_t repetitions;
+   uint32_t timeoutMs;
+   uint32_t blockSize;
+   uint32_t sent;
+   uint32_t successes;
+   uint32_t failures;
+   bool awaiting;            // The last probe sent has neither replied nor timed out
+   uint64_t sentUs;          // Wall-clock send time of the outstanding probe
+   uint64_t deadlineMs;
+   uint64_t nextSendMs;
+   uint64_t totalUs;
+   uint64_t minUs;
+   uint64_t maxUs;
+   Timer timer;
+} DiagTest;
+
+// A parameter that the provider adds to the store: its name relative to the
+// object it belongs to, and its type
+typedef struct {
+   const char *name;
+   ValueType type;
+} StoreField;
+
+static const StoreField g_pingResults[] = {
+   {"Status", TYPE_STRING},
+   {"Host", TYPE_STRING},
+   {"SuccessCount", TYPE_UINT},
+   {"FailureCount", TYPE_UINT},
+   {"AverageResponseTime", TYPE_UINT},
+   {"MinimumResponseTime", TYPE_UINT},
+   {"MaximumResponseTime", TYPE_UINT},
+   {"AverageResponseTimeDetailed", TYPE_UINT},
+   {"MinimumResponseTimeDetailed", TYPE_UINT},
+   {"MaximumResponseTimeDetailed", TYPE_UINT},
+};
+
+static const StoreField g_downloadResults[] = {
+   {"Status", TYPE_STRING},
+   {"ROMTime", TYPE_DATETIME},
+   {"BOMTime", TYPE_DATETIME},
+   {"EOMTime", TYPE_DATETIME},
+   {"TCPOpenRequestTime", TYPE_DATETIME},
+   {"TCPOpenResponseTime", TYPE_DATETIME},
+   {"TestBytesReceived", TYPE_ULONG},
+   {"TotalBytesReceived", TYPE_ULONG},
+   {"IncrementalResultNumberOfEntries", TYPE_UINT},
+};
+
+static const StoreField g_uploadResults[] = {
+   {"Status", TYPE_STRING},
+   {"ROMTime", TYPE_DATETIME},
+   {"BOMTime", TYPE_DATETIME},
+   {"EOMTime", TYPE_DATETIME},
+   {"TCPOpenRequestTime", TYPE_DATETIME},
+   {"TCPOpenResponseTime", TYPE_DATETIME},
+   {"TestBytesSent", TYPE_ULONG},
+   {"TotalBytesSent", TYPE_ULONG},
+   {"IncrementalResultNumberOfEntries", TYPE_UINT},
+};
+
+// Indexed by DiagKind
+static const struct {
+   const char *object;
+   const StoreField *results;
+   int numResults;
+} g_diagObjects[] = {
+   {DIAG_IPPING_OBJECT, g_pingResults, sizeof(g_pingResults) / sizeof(g_pingResults[0])},
+   {DIAG_UDPECHO_OBJECT, g_pingResults, sizeof(g_pingResults) / sizeof(g_pingResults[0])},
+   {DIAG_DOWNLOAD_OBJECT, g_downloadResults, sizeof(g_downloadResults) / sizeof(g_downloadResults[0])},
+   {DIAG_UPLOAD_OBJECT, g_uploadResults, sizeof(g_uploadResults) / sizeof(g_uploadResults[0])},
+};
+#define NUM_DIAG_OBJECTS (int)(sizeof(g_diagObjects) / sizeof(g_diagObjects[0]))
+
+static pthread_mutex_t g_diagLock = PTHREAD_MUTEX_INITIALIZER;
+static DiagTest g_diagTests[DIAG_MAX_TESTS];
+static int g_diagFds[DIAG_NUM_SOCKETS] = {-1, -1, -1, -1};
+static bool g_diagRawIcmp4 = false;  // Replies on a raw IPv4 socket start with the IP header
+static int g_udpEchoFd = -1;
+static uint8_t g_diagPacket[8 + DIAG_MAX_BLOCK];
+
+// Grow g_dataModels for count parameters added with appendStoreParameter()
+static bool reserveStoreParameters(int count) {
+   DataModel *models = realloc(g_dataModels, (g_totalDataModels + count) * sizeof(DataModel));
+   if (!models) {
+      return false;
+   }
+   g_dataModels = models;
+   return true;
+}
+
+// Append a parameter to the store unless the JSON file defines it. String types
+// start as initial. Must run before buildNameDictionary().
+static bool appendStoreParameter(const char *name, ValueType type, const char *initial) {
+   for (int i = 0; i < g_totalDataModels; i++) {
+      if (strcmp(g_dataModels[i].name, name) == 0) {
+         return true;
+      }
+   }
+   DataModel *dm = &g_dataModels[g_totalDataModels];
+   memset(dm, 0, sizeof(*dm));
+   dm->name = strdup(name);
+   dm->type = type;
+   dm->version = 1;
+   if (isStringType(dm->type)) {
+      dm->value.strVal = strdup(initial);
+   }
+   if (!dm->name || (isStringType(dm->type) && !dm->value.strVal)) {
+      free((char *)dm->name);
+      free(dm->value.strVal);
+      return false;
+   }
+   g_totalDataModels++;
+   return true;
+}
+
+// Add the result parameters of each diagnostic to the store, unless the JSON
+// file defines them. Must run before buildNameDictionary().
+static bool addDiagnosticsParameters(void) {
+   int total = 0;
+   for (int o = 0; o < NUM_DIAG_OBJECTS; o++) {
+      total += g_diagObjects[o].numResults;
+   }
+   if (!reserveStoreParameters(total)) {
+      return false;
+   }
+
+   for (int o = 0; o < NUM_DIAG_OBJECTS; o++) {
+      for (int r = 0; r < g_diagObjects[o].numResults; r++) {
+         const StoreField *result = &g_diagObjects[o].results[r];
+         char name[MAX_NAME_LEN];
+         snprintf(name, sizeof(name), "%s%s", g_diagObjects[o].object, result->name);
+         const char *initial = strcmp(result->name, "Status") == 0 ? "None" :
+            result->type == TYPE_DATETIME ? DIAG_UNKNOWN_TIME : "";
+         if (!appendStoreParameter(name, result->type, initial)) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+// Kernel receive timestamp of a message, taken when the packet arrived rather
+// than when the main loop got to it. Falls back to the current time.
+static uint64_t diagReceiveTimeUs(struct msghdr *msg) {
+#ifdef SO_TIMESTAMPING
+   // Kernel timestamps are real time, which the simulated clock is not
+   for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg && !clockSimulated(); cmsg = CMSG_NXTHDR(msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+         struct timespec ts[3];
+         memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+         if (ts[0].tv_sec || ts[0].tv_nsec) {
+            return (uint64_t)ts[0].tv_sec * 1000000 + ts[0].tv_nsec / 1000;
+         }
+      }
+   }
+#else
+   (void)msg;
+#endif
+   return wallclockUs();
+}
+
+static uint16_t diagChecksum(const uint8_t *data, size_t len) {
+   uint32_t sum = 0;
+   for (size_t n = 0; n + 1 < len; n += 2) {
+      sum += (uint32_t)data[n] << 8 | data[n + 1];
+   }
+   if (len & 1) {
+      sum += (uint32_t)data[len - 1] << 8;
+   }
+   while (sum >> 16) {
+      sum = (sum & 0xffff) + (sum >> 16);
+   }
+   return htons((uint16_t)~sum);
+}
+
+static void diagTimer(void *arg);
+
+static void diagSendProbe(DiagTest *test) {
+   int index = (int)(test - g_diagTests);
+   size_t headerLen = test->kind == DIAG_IPPING ? 8 : 0;
+   size_t len = headerLen + test->blockSize;
+   DiagProbe probe = {DIAG_PROBE_MAGIC, (uint16_t)index, test->generation, test->sent};
+
+   memset(g_diagPacket, 0, len);
+   memcpy(g_diagPacket + headerLen, &probe, sizeof(probe));
+   if (test->kind == DIAG_IPPING) {
+      // Ping sockets replace the identifier with their port; raw sockets keep
+      // it, and both compute the ICMPv6 checksum
+      bool v6 = test->socket == DIAG_SOCKET_ICMP6;
+      uint16_t id = htons((uint16_t)getpid());
+      uint16_t seq = htons((uint16_t)test->sent);
+      g_diagPacket[0] = v6 ? 128 : 8;
+      memcpy(g_diagPacket + 4, &id, 2);
+      memcpy(g_diagPacket + 6, &seq, 2);
+      if (!v6) {
+         uint16_t sum = diagChecksum(g_diagPacket, len);
+         memcpy(g_diagPacket + 2, &sum, 2);
+      }
+   }
+
+   uint64_t nowMs = monotonicMs();
+   test->sentUs = wallclockUs();
+   test->sent++;
+   test->awaiting = true;
+   test->deadlineMs = nowMs + test->timeoutMs;
+   test->nextSendMs = nowMs + DIAG_PROBE_INTERVAL_MS;
+   // A failed send is left to time out and counts as a failure
+   sendto(g_diagFds[test->socket], g_diagPacket, len, 0, (struct sockaddr *)&test->addr, test->addrLen);
+   timerStart(&test->timer, test->timeoutMs, diagTimer, (void *)(intptr_t)index);
+}
+
+static void diagSetResult(rbusObject_t results, const char *name, rbusValue_t value) {
+   rbusObject_SetValue(results, name, value);
+   rbusValue_Release(value);
+}
+
+static rbusValue_t diagString(const char *s) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetString(value, s);
+   return value;
+}
+
+static rbusValue_t diagUInt32(uint64_t u) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetUInt32(value, u > UINT32_MAX ? UINT32_MAX : (uint32_t)u);
+   return value;
+}
+
+// Write the results of a completed diagnostic into the store, which keeps the
+// last results of each kind, and publish them as its completion event
+static void diagPublishResults(DiagKind kind, rbusObject_t results) {
+   const char *object = g_diagObjects[kind].object;
+   SetEntry entries[DIAG_MAX_RESULTS];
+   char names[DIAG_MAX_RESULTS][MAX_NAME_LEN];
+   int numEntries = 0;
+   for (rbusProperty_t prop = rbusObject_GetProperties(results); prop && numEntries < DIAG_MAX_RESULTS;
+      prop = rbusProperty_GetNext(prop)) {
+      SetEntry *entry = &entries[numEntries];
+      memset(entry, 0, sizeof(*entry));
+      snprintf(names[numEntries], MAX_NAME_LEN, "%s%s", object, rbusProperty_GetName(prop));
+      entry->name = names[numEntries];
+      entry->index = findDataModel(entry->name);
+      entry->newValue = rbusProperty_GetValue(prop);
+      if (entry->index < 0 || g_dataModels[entry->index].getHandler ||
+         !valueMatchesType(g_dataModels[entry->index].type, entry->newValue) ||
+         prepareStoreValue(entry->index, entry->newValue, &entry->str) != RBUS_ERROR_SUCCESS) {
+         continue;
+      }
+      numEntries++;
+   }
+   finishSetEntries(entries, numEntries, true, 0);
+
+   char eventName[MAX_NAME_LEN];
+   snprintf(eventName, sizeof(eventName), "%sComplete!", object);
+   rbusEvent_t event = {0};
+   event.name = eventName;
+   event.type = RBUS_EVENT_GENERAL;
+   event.data = results;
+   rbusError_t rc = rbusEvent_Publish(g_rbusHandle, &event);
+   if (rc != RBUS_ERROR_SUCCESS && rc != RBUS_ERROR_NOSUBSCRIBERS) {
+      fprintf(stderr, "Failed to publish %s: %d\n", eventName, rc);
+   }
+}
+
+// Complete a diagnostic: answer the method call, write the results into the
+// store, publish the completion event and release the slot
+static void diagFinish(DiagTest *test) {
+   uint64_t averageUs = test->successes ? test->totalUs / test->successes : 0;
+   uint64_t minUs = test->successes ? test->minUs : 0;
+
+   rbusObject_t results;
+   rbusObject_Init(&results, NULL);
+   diagSetResult(results, "Status", diagString("Complete"));
+   diagSetResult(results, "Host", diagString(test->host));
+   diagSetResult(results, "SuccessCount", diagUInt32(test->successes));
+   diagSetResult(results, "FailureCount", diagUInt32(test->failures));
+   diagSetResult(results, "AverageResponseTime", diagUInt32((averageUs + 500) / 1000));
+   diagSetResult(results, "MinimumResponseTime", diagUInt32((minUs + 500) / 1000));
+   diagSetResult(results, "MaximumResponseTime", diagUInt32((test->maxUs + 500) / 1000));
+   diagSetResult(results, "AverageResponseTimeDetailed", diagUInt32(averageUs));
+   diagSetResult(results, "MinimumResponseTimeDetailed", diagUInt32(minUs));
+   diagSetResult(results, "MaximumResponseTimeDetailed", diagUInt32(test->maxUs));
+
+   if (test->asyncHandle) {
+      rbusMethod_SendAsyncResponse(test->asyncHandle, RBUS_ERROR_SUCCESS, results);
+   }
+
+   diagPublishResults(test->kind, results);
+   rbusObject_Release(results);
+
+   pthread_mutex_lock(&g_diagLock);
+   timerCancel(&test->timer);
+   __atomic_store_n(&test->inUse, false, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&g_diagLock);
+}
+
+// Timer callback for g_diagTests[(intptr_t)arg]: times out the outstanding
+// probe, then sends the next one once the probe interval has passed
+static void diagTimer(void *arg) {
+   DiagTest *test = &g_diagTests[(intptr_t)arg];
+   if (!__atomic_load_n(&test->inUse, __ATOMIC_ACQUIRE) || timerArmed(&test->timer)) {
+      return;
+   }
+   uint64_t nowMs = monotonicMs();
+   if (test->awaiting) {
+      if (nowMs < test->deadlineMs) {
+         timerStart(&test->timer, test->deadlineMs - nowMs, diagTimer, arg);
+         return;
+      }
+      test->awaiting = false;
+      test->failures++;
+   }
+   if (test->sent == test->repetitions) {
+      diagFinish(test);
+   } else if (test->sent > 0 && nowMs < test->nextSendMs) {
+      timerStart(&test->timer, test->nextSendMs - nowMs, diagTimer, arg);
+   } else {
+      diagSendProbe(test);
+   }
+}
+
+static void diagReply(DiagTest *test, uint64_t receivedUs) {
+   uint64_t rttUs = receivedUs > test->sentUs ? receivedUs - test->sentUs : 0;
+   test->awaiting = false;
+   test->successes++;
+   test->totalUs += rttUs;
+   if (test->successes == 1 || rttUs < test->minUs) {
+      test->minUs = rttUs;
+   }
+   if (rttUs > test->maxUs) {
+      test->maxUs = rttUs;
+   }
+
+   if (test->sent == test->repetitions) {
+      diagFinish(test);
+      return;
+   }
+   uint64_t nowMs = monotonicMs();
+   timerStart(&test->timer, test->nextSendMs > nowMs ? test->nextSendMs - nowMs : 0,
+      diagTimer, (void *)(intptr_t)(test - g_diagTests));
+}
+
+// Reactor callback for the shared probe sockets; arg is the socket index
+static void diagReceive(int fd, short revents, void *arg) {
+   (void)revents;
+   int socketIndex = (int)(intptr_t)arg;
+   uint8_t packet[DIAG_MAX_BLOCK + 128];
+   char control[256];
+
+   for (;;) {
+      struct sockaddr_storage from;
+      struct iovec iov = {packet, sizeof(packet)};
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &from;
+      msg.msg_namelen = sizeof(from);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      ssize_t n = recvmsg(fd, &msg, 0);
+      if (n < 0) {
+         return;
+      }
+      uint64_t receivedUs = diagReceiveTimeUs(&msg);
+
+      const uint8_t *p = packet;
+      size_t len = (size_t)n;
+      if (socketIndex == DIAG_SOCKET_ICMP4 || socketIndex == DIAG_SOCKET_ICMP6) {
+         if (socketIndex == DIAG_SOCKET_ICMP4 && g_diagRawIcmp4) {
+            size_t ipHeaderLen = len > 0 ? (size_t)(p[0] & 0x0f) * 4 : 0;
+            if (ipHeaderLen == 0 || ipHeaderLen > len) {
+               continue;
+            }
+            p += ipHeaderLen;
+            len -= ipHeaderLen;
+         }
+         // Only echo replies; raw sockets also see requests, including our own
+         if (len < 8 || p[0] != (socketIndex == DIAG_SOCKET_ICMP6 ? 129 : 0)) {
+            continue;
+         }
+         p += 8;
+         len -= 8;
+      }
+
+      DiagProbe probe;
+      if (len < sizeof(probe)) {
+         continue;
+      }
+      memcpy(&probe, p, sizeof(probe));
+      if (probe.magic != DIAG_PROBE_MAGIC || probe.test >= DIAG_MAX_TESTS) {
+         continue;
+      }
+      DiagTest *test = &g_diagTests[probe.test];
+      // Late replies to probes that already timed out are ignored
+      if (__atomic_load_n(&test->inUse, __ATOMIC_ACQUIRE) && test->generation == probe.generation &&
+         test->socket == socketIndex && test->awaiting && probe.sequence + 1 == test->sent) {
+         diagReply(test, receivedUs);
+      }
+   }
+}
+
+// Reactor callback for the UDP echo responder: send every datagram back
+static void udpEchoReceive(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   uint8_t packet[65536];
+   for (;;) {
+      struct sockaddr_storage from;
+      socklen_t fromLen = sizeof(from);
+      ssize_t n = recvfrom(fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromLen);
+      if (n < 0) {
+         return;
+      }
+      sendto(fd, packet, (size_t)n, 0, (struct sockaddr *)&from, fromLen);
+   }
+}
+
+static int diagOpenSocket(int socketIndex, int family, int type, int protocol) {
+   int fd = socket(family, type, protocol);
+   if (fd < 0) {
+      return -1;
+   }
+#ifdef SO_TIMESTAMPING
+   int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+   setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+#endif
+   if (!setNonBlocking(fd) || !reactorAdd(fd, POLLIN, diagReceive, (void *)(intptr_t)socketIndex)) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+// Open the shared probe sockets and, if udpEchoPort is set, the UDP echo
+// responder. ICMP uses unprivileged ping sockets where the kernel allows them
+// and raw sockets otherwise; a diagnostic whose socket is missing fails.
+static bool diagStart(int udpEchoPort) {
+   g_diagFds[DIAG_SOCKET_ICMP4] = diagOpenSocket(DIAG_SOCKET_ICMP4, AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+   if (g_diagFds[DIAG_SOCKET_ICMP4] < 0) {
+      g_diagFds[DIAG_SOCKET_ICMP4] = diagOpenSocket(DIAG_SOCKET_ICMP4, AF_INET, SOCK_RAW, IPPROTO_ICMP);
+      g_diagRawIcmp4 = g_diagFds[DIAG_SOCKET_ICMP4] >= 0;
+   }
+   g_diagFds[DIAG_SOCKET_ICMP6] = diagOpenSocket(DIAG_SOCKET_ICMP6, AF_INET6, SOCK_DGRAM, IPPROTO_ICMPV6);
+   if (g_diagFds[DIAG_SOCKET_ICMP6] < 0) {
+      g_diagFds[DIAG_SOCKET_ICMP6] = diagOpenSocket(DIAG_SOCKET_ICMP6, AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
+   }
+   g_diagFds[DIAG_SOCKET_UDP4] = diagOpenSocket(DIAG_SOCKET_UDP4, AF_INET, SOCK_DGRAM, 0);
+   g_diagFds[DIAG_SOCKET_UDP6] = diagOpenSocket(DIAG_SOCKET_UDP6, AF_INET6, SOCK_DGRAM, 0);
+   if (g_diagFds[DIAG_SOCKET_ICMP4] < 0 && g_diagFds[DIAG_SOCKET_ICMP6] < 0) {
+      fprintf(stderr, "IPPing() is unavailable: cannot open an ICMP socket\n");
+   }
+
+   if (udpEchoPort > 0) {
+      struct sockaddr_in6 addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin6_family = AF_INET6;
+      addr.sin6_addr = in6addr_any;
+      addr.sin6_port = htons((uint16_t)udpEchoPort);
+      int off = 0;
+      int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+      if (fd < 0 || setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0 ||
+         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || !setNonBlocking(fd) ||
+         !reactorAdd(fd, POLLIN, udpEchoReceive, NULL)) {
+         fprintf(stderr, "Failed to start the UDP echo responder on port %d: %s\n", udpEchoPort, strerror(errno));
+         if (fd >= 0) {
+            close(fd);
+         }
+         return false;
+      }
+      g_udpEchoFd = fd;
+      printf("UDP echo responder on port %d\n", udpEchoPort);
+   }
+   return true;
+}
+
+static void diagStop(void) {
+   for (int t = 0; t < DIAG_MAX_TESTS; t++) {
+      timerCancel(&g_diagTests[t].timer);
+      g_diagTests[t].inUse = false;
+   }
+   for (int s = 0; s < DIAG_NUM_SOCKETS; s++) {
+      if (g_diagFds[s] >= 0) {
+         reactorRemove(g_diagFds[s]);
+         close(g_diagFds[s]);
+         g_diagFds[s] = -1;
+      }
+   }
+   if (g_udpEchoFd >= 0) {
+      reactorRemove(g_udpEchoFd);
+      close(g_udpEchoFd);
+      g_udpEchoFd = -1;
+   }
+}
+
+static bool methodUInt32Param(rbusObject_t inParams, const char *name, uint32_t defaultValue, uint32_t *out) {
+   rbusValue_t value = rbusObject_GetValue(inParams, name);
+   if (!value) {
+      *out = defaultValue;
+      return true;
+   }
+   if (rbusValue_GetType(value) != RBUS_UINT32) {
+      return false;
+   }
+   *out = rbusValue_GetUInt32(value);
+   return true;
+}
+
+// Read the optional boolean input name: false if it has another type
+static bool methodBoolParam(rbusObject_t inParams, const char *name, bool defaultValue, bool *out) {
+   rbusValue_t value = rbusObject_GetValue(inParams, name);
+   if (!value) {
+      *out = defaultValue;
+      return true;
+   }
+   if (rbusValue_GetType(value) != RBUS_BOOLEAN) {
+      return false;
+   }
+   *out = rbusValue_GetBoolean(value);
+   return true;
+}
+
+// Method handler for Device.IP.Diagnostics.IPPing() and
+// Device.IP.Diagnostics.UDPEchoDiagnostics()
+// Inputs:  Host (string), ProtocolVersion ("Any", "IPv4" or "IPv6"),
+//          NumberOfRepetitions (uint32, default 3), Timeout (uint32 ms per
+//          probe, default 1000), DataBlockSize (uint32, default 64) and, for
+//          UDPEchoDiagnostics(), Port (uint32)
+// Outputs: Status, Host, SuccessCount, FailureCount and the average, minimum
+//          and maximum response times in ms and, as ...Detailed, in µs
+// The call completes asynchronously once every probe has replied or timed out.
+// The outputs are also written under Device.IP.Diagnostics.IPPing. or
+// Device.IP.Diagnostics.UDPEchoDiagnostics. and published as the event
+// Device.IP.Diagnostics.IPPing.Complete! or ...UDPEchoDiagnostics.Complete!
+static rbusError_t diagMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+
+   DiagKind kind = strncmp(methodName, DIAG_UDPECHO_OBJECT, strlen(DIAG_UDPECHO_OBJECT) - 1) == 0 ? DIAG_UDPECHO : DIAG_IPPING;
+   const char *host = methodStringParam(inParams, "Host");
+   const char *protocol = methodStringParam(inParams, "ProtocolVersion");
+   uint32_t repetitions, timeoutMs, blockSize, port;
+   if (!host || !host[0] || strlen(host) >= MAX_NAME_LEN ||
+      !methodUInt32Param(inParams, "NumberOfRepetitions", DIAG_DEFAULT_REPETITIONS, &repetitions) ||
+      !methodUInt32Param(inParams, "Timeout", DIAG_DEFAULT_TIMEOUT_MS, &timeoutMs) ||
+      !methodUInt32Param(inParams, "DataBlockSize", DIAG_DEFAULT_BLOCK, &blockSize) ||
+      !methodUInt32Param(inParams, "Port", 0, &port) ||
+      repetitions == 0 || timeoutMs == 0 || blockSize == 0 || blockSize > DIAG_MAX_BLOCK ||
+      (kind == DIAG_UDPECHO && (port == 0 || port > 65535)) ||
+      (protocol && strcmp(protocol, "Any") != 0 && strcmp(protocol, "IPv4") != 0 && strcmp(protocol, "IPv6") != 0)) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   // Name resolution may block, so it happens here on the rbus thread rather
+   // than on the main loop
+   struct addrinfo hints;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = protocol && strcmp(protocol, "IPv4") == 0 ? AF_INET :
+      protocol && strcmp(protocol, "IPv6") == 0 ? AF_INET6 : AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+   struct addrinfo *res = NULL;
+   if (getaddrinfo(host, NULL, &hints, &res) != 0 || !res) {
+      diagSetResult(outParams, "Status", diagString("Error_CannotResolveHostName"));
+      return RBUS_ERROR_SUCCESS;
+   }
+   bool v6 = res->ai_family == AF_INET6;
+   int socketIndex = kind == DIAG_IPPING ? (v6 ? DIAG_SOCKET_ICMP6 : DIAG_SOCKET_ICMP4) :
+      (v6 ? DIAG_SOCKET_UDP6 : DIAG_SOCKET_UDP4);
+   if (g_diagFds[socketIndex] < 0 || res->ai_addrlen > sizeof(struct sockaddr_storage)) {
+      freeaddrinfo(res);
+      diagSetResult(outParams, "Status", diagString("Error_Internal"));
+      return RBUS_ERROR_SUCCESS;
+   }
+
+   pthread_mutex_lock(&g_diagLock);
+   DiagTest *test = NULL;
+   for (int t = 0; t < DIAG_MAX_TESTS && !test; t++) {
+      if (!__atomic_load_n(&g_diagTests[t].inUse, __ATOMIC_ACQUIRE)) {
+         test = &g_diagTests[t];
+      }
+   }
+   if (!test) {
+      pthread_mutex_unlock(&g_diagLock);
+      freeaddrinfo(res);
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   uint16_t generation = test->generation + 1;
+   memset(test, 0, sizeof(*test));
+   test->generation = generation;
+   test->kind = kind;
+   test->socket = socketIndex;
+   test->asyncHandle = asyncHandle;
+   memcpy(&test->addr, res->ai_addr, res->ai_addrlen);
+   test->addrLen = res->ai_addrlen;
+   if (kind == DIAG_UDPECHO) {
+      if (v6) {
+         ((struct sockaddr_in6 *)&test->addr)->sin6_port = htons((uint16_t)port);
+      } else {
+         ((struct sockaddr_in *)&test->addr)->sin_port = htons((uint16_t)port);
+      }
+   }
+   strcpy(test->host, host);
+   test->repetitions = repetitions;
+   test->timeoutMs = timeoutMs;
+   test->blockSize = blockSize < sizeof(DiagProbe) ? sizeof(DiagProbe) : blockSize;
+   __atomic_store_n(&test->inUse, true, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&g_diagLock);
+   freeaddrinfo(res);
+
+   // The first probe goes out from the main loop on the next tick
+   timerStart(&test->timer, 0, diagTimer, (void *)(intptr_t)(test - g_diagTests));
+   return RBUS_ERROR_ASYNC_RESPONSE;
+}
+
+// Download and upload diagnostics: one HTTP transfer per test on the main loop.
+// Payload bytes never pass through user space on Linux: downloads are spliced
+// from the socket through a pipe into /dev/null, and uploads are sent with
+// sendfile() from a sparse file of zeros. Elsewhere they are copied through a
+// scratch buffer.
+typedef enum {
+   XFER_CONNECTING,
+   XFER_REQUEST,
+   XFER_UPLOAD_BODY,
+   XFER_HEADERS,
+   XFER_DOWNLOAD_BODY
+} XferPhase;
+
+typedef struct {
+   uint64_t startUs;
+   uint64_t endUs;
+   uint64_t bytes;
+} XferSample;
+
+typedef struct {
+   bool inUse;               // Written under g_diagLock, read by the main loop
+   bool upload;
+   XferPhase phase;
+   rbusMethodAsyncHandle_t asyncHandle;
+   struct sockaddr_storage addr;
+   socklen_t addrLen;
+   int fd;
+   int pipeFds[2];
+   char header[XFER_MAX_HEADER];  // The request while sending, then the response header
+   size_t headerLen;
+   size_t headerSent;
+   bool knownLength;
+   uint64_t length;          // Upload size, or the download's Content-Length
+   uint64_t testBytes;       // Payload bytes moved
+   uint64_t totalBytes;      // Payload and HTTP header bytes moved
+   uint64_t durationMs;      // Time-based test length, 0 to transfer the whole file
+   uint64_t intervalMs;      // Incremental result period, 0 for none
+   uint64_t bomMs;
+   uint64_t progressMs;      // When bytes last moved
+   uint64_t tcpOpenRequestUs;
+   uint64_t tcpOpenResponseUs;
+   uint64_t romUs;
+   uint64_t bomUs;
+   uint64_t eomUs;
+   XferSample *samples;
+   int numSamples;
+   uint64_t sampleStartUs;
+   uint64_t sampleStartBytes;
+   Timer timer;
+} XferTest;
+
+// Connection of the HTTP stand-in server started with --throughput-server
+typedef struct {
+   Coroutine co;
+   int fd;
+   int pipeFds[2];
+   char header[XFER_MAX_HEADER];  // The request header, then the response header
+   size_t headerLen;
+   size_t headerSent;
+   size_t bodyStart;         // Length of the request header once it is complete
+   int status;
+   uint64_t remaining;       // Upload bytes left to discard, then zeros to send
+} XferServerConn;
+
+static XferTest g_xferTests[XFER_MAX_TESTS];
+static XferServerConn *g_xferServerConns[XFER_SERVER_MAX_CONNECTIONS];
+static int g_xferServerFd = -1;
+static int g_xferZeroFd = -1;
+static int g_xferNullFd = -1;
+
+static void diagTimeString(uint64_t us, char *buf, size_t len) {
+   if (us == 0) {
+      snprintf(buf, len, DIAG_UNKNOWN_TIME);
+      return;
+   }
+   time_t sec = (time_t)(us / 1000000);
+   struct tm tm;
+   gmtime_r(&sec, &tm);
+   size_t n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+   snprintf(buf + n, len - n, ".%06uZ", (unsigned)(us % 1000000));
+}
+
+static bool xferOpenPipe(int pipeFds[2]) {
+#ifdef __linux__
+   if (pipe(pipeFds) != 0) {
+      return false;
+   }
+   // A pipe as large as a transfer chunk lets one splice() move a whole chunk
+   fcntl(pipeFds[1], F_SETPIPE_SZ, XFER_CHUNK);
+#else
+   pipeFds[0] = pipeFds[1] = -1;
+#endif
+   return true;
+}
+
+static void xferClosePipe(int pipeFds[2]) {
+   if (pipeFds[0] >= 0) {
+      close(pipeFds[0]);
+      close(pipeFds[1]);
+      pipeFds[0] = pipeFds[1] = -1;
+   }
+}
+
+// Discard up to max bytes from the socket fd. Returns the bytes consumed, 0 at
+// the end of the stream, or -1 with errno set.
+static ssize_t xferDrain(int fd, int pipeFds[2], size_t max) {
+   if (max > XFER_CHUNK) {
+      max = XFER_CHUNK;
+   }
+#ifdef __linux__
+   ssize_t n = splice(fd, NULL, pipeFds[1], NULL, max, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+   for (ssize_t left = n; left > 0;) {
+      ssize_t m = splice(pipeFds[0], NULL, g_xferNullFd, NULL, (size_t)left, SPLICE_F_MOVE);
+      if (m <= 0) {
+         return -1;
+      }
+      left -= m;
+   }
+   return n;
+#else
+   (void)pipeFds;
+   static char scratch[65536];
+   return recv(fd, scratch, max < sizeof(scratch) ? max : sizeof(scratch), 0);
+#endif
+}
+
+// Send up to max zero bytes on the socket fd. Returns the bytes sent, or -1
+// with errno set.
+static ssize_t xferSendZeros(int fd, uint64_t max) {
+   size_t n = max > XFER_CHUNK ? XFER_CHUNK : (size_t)max;
+#ifdef __linux__
+   // Every chunk is the same page-cache pages at the start of the zero file
+   off_t offset = 0;
+   return sendfile(fd, g_xferZeroFd, &offset, n);
+#else
+   static const char zeros[65536];
+   return send(fd, zeros, n < sizeof(zeros) ? n : sizeof(zeros), 0);
+#endif
+}
+
+// Split an http:// URL into host, port and path; path points into url
+static bool xferParseUrl(const char *url, char *host, size_t hostLen, char *port, size_t portLen, const char **path) {
+   if (strncmp(url, "http://", 7) != 0) {
+      return false;
+   }
+   const char *h = url + 7;
+   const char *end;
+   size_t len;
+   if (*h == '[') {
+      end = strchr(h, ']');
+      if (!end) {
+         return false;
+      }
+      h++;
+      len = (size_t)(end - h);
+      end++;
+   } else {
+      len = strcspn(h, ":/");
+      end = h + len;
+   }
+   if (len == 0 || len >= hostLen) {
+      return false;
+   }
+   memcpy(host, h, len);
+   host[len] = '\0';
+
+   snprintf(port, portLen, "80");
+   if (*end == ':') {
+      size_t digits = strspn(end + 1, "0123456789");
+      if (digits == 0 || digits >= portLen) {
+         return false;
+      }
+      memcpy(port, end + 1, digits);
+      port[digits] = '\0';
+      end += 1 + digits;
+   }
+   if (*end != '/' && *end != '\0') {
+      return false;
+   }
+   *path = *end ? end : "/";
+   return true;
+}
+
+// Length of the HTTP header at the start of buf, or 0 if it is incomplete
+static size_t xferHeaderLength(const char *buf, size_t len) {
+   for (size_t n = 3; n < len; n++) {
+      if (buf[n - 3] == '\r' && buf[n - 2] == '\n' && buf[n - 1] == '\r' && buf[n] == '\n') {
+         return n + 1;
+      }
+   }
+   return 0;
+}
+
+// Content-Length of a complete header, or false if it has none
+static bool xferContentLength(const char *header, size_t len, uint64_t *length) {
+   const char *end = header + len;
+   for (const char *line = header; line && line < end;) {
+      if (strncasecmp(line, "Content-Length:", 15) == 0) {
+         *length = strtoull(line + 15, NULL, 10);
+         return true;
+      }
+      line = strstr(line, "\r\n");
+      line = line ? line + 2 : NULL;
+   }
+   return false;
+}
+
+static void xferTimer(void *arg);
+
+static void xferSample(XferTest *test, uint64_t nowUs) {
+   if (test->intervalMs == 0 || test->sampleStartUs == 0 || test->numSamples == XFER_MAX_SAMPLES) {
+      return;
+   }
+   if (!test->samples) {
+      test->samples = malloc(XFER_MAX_SAMPLES * sizeof(XferSample));
+      if (!test->samples) {
+         return;
+      }
+   }
+   XferSample *sample = &test->samples[test->numSamples++];
+   sample->startUs = test->sampleStartUs;
+   sample->endUs = nowUs;
+   sample->bytes = test->testBytes - test->sampleStartBytes;
+   test->sampleStartUs = nowUs;
+   test->sampleStartBytes = test->testBytes;
+}
+
+// Complete a transfer with status: answer the method call, store and publish
+// the results and release the slot
+static void xferFinish(XferTest *test, const char *status) {
+   bool complete = strcmp(status, "Complete") == 0;
+   uint64_t nowUs = wallclockUs();
+   if (complete) {
+      if (!test->eomUs) {
+         test->eomUs = nowUs;
+      }
+      if (test->testBytes > test->sampleStartBytes) {
+         xferSample(test, test->eomUs);
+      }
+   }
+   if (test->fd >= 0) {
+      reactorRemove(test->fd);
+      close(test->fd);
+      test->fd = -1;
+   }
+   xferClosePipe(test->pipeFds);
+
+   const char *bytesName = test->upload ? "TestBytesSent" : "TestBytesReceived";
+   char buf[64];
+   rbusObject_t results;
+   rbusObject_Init(&results, NULL);
+   diagSetResult(results, "Status", diagString(status));
+   diagTimeString(test->romUs, buf, sizeof(buf));
+   diagSetResult(results, "ROMTime", diagString(buf));
+   diagTimeString(test->bomUs, buf, sizeof(buf));
+   diagSetResult(results, "BOMTime", diagString(buf));
+   diagTimeString(test->eomUs, buf, sizeof(buf));
+   diagSetResult(results, "EOMTime", diagString(buf));
+   diagTimeString(test->tcpOpenRequestUs, buf, sizeof(buf));
+   diagSetResult(results, "TCPOpenRequestTime", diagString(buf));
+   diagTimeString(test->tcpOpenResponseUs, buf, sizeof(buf));
+   diagSetResult(results, "TCPOpenResponseTime", diagString(buf));
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetUInt64(value, test->testBytes);
+   diagSetResult(results, bytesName, value);
+   rbusValue_Init(&value);
+   rbusValue_SetUInt64(value, test->totalBytes);
+   diagSetResult(results, test->upload ? "TotalBytesSent" : "TotalBytesReceived", value);
+   diagSetResult(results, "IncrementalResultNumberOfEntries", diagUInt32(test->numSamples));
+   for (int n = 0; n < test->numSamples; n++) {
+      char name[MAX_NAME_LEN];
+      snprintf(name, sizeof(name), "IncrementalResult.%d.%s", n + 1, bytesName);
+      rbusValue_Init(&value);
+      rbusValue_SetUInt64(value, test->samples[n].bytes);
+      diagSetResult(results, name, value);
+      snprintf(name, sizeof(name), "IncrementalResult.%d.StartTime", n + 1);
+      diagTimeString(test->samples[n].startUs, buf, sizeof(buf));
+      diagSetResult(results, name, diagString(buf));
+      snprintf(name, sizeof(name), "IncrementalResult.%d.EndTime", n + 1);
+      diagTimeString(test->samples[n].endUs, buf, sizeof(buf));
+      diagSetResult(results, name, diagString(buf));
+   }
+
+   if (test->asyncHandle) {
+      rbusMethod_SendAsyncResponse(test->asyncHandle, RBUS_ERROR_SUCCESS, results);
+   }
+   diagPublishResults(test->upload ? DIAG_UPLOAD : DIAG_DOWNLOAD, results);
+   rbusObject_Release(results);
+
+   free(test->samples);
+   test->samples = NULL;
+   pthread_mutex_lock(&g_diagLock);
+   timerCancel(&test->timer);
+   __atomic_store_n(&test->inUse, false, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&g_diagLock);
+}
+
+// The response header is complete: check the status and, for a download,
+// start on the body
+static void xferResponseHeader(XferTest *test, size_t headerLen) {
+   int status = 0;
+   if (sscanf(test->header, "HTTP/%*d.%*d %d", &status) != 1 || status < 200 || status > 299) {
+      xferFinish(test, "Error_TransferFailed");
+      return;
+   }
+   if (test->upload) {
+      xferFinish(test, "Complete");
+      return;
+   }
+
+   test->knownLength = xferContentLength(test->header, headerLen, &test->length);
+   // Body bytes read along with the header
+   test->testBytes = test->headerLen - headerLen;
+   test->bomUs = wallclockUs();
+   test->bomMs = monotonicMs();
+   test->sampleStartUs = test->bomUs;
+   test->phase = XFER_DOWNLOAD_BODY;
+   if (test->knownLength && test->testBytes >= test->length) {
+      xferFinish(test, "Complete");
+   }
+}
+
+// Reactor callback for the socket of g_xferTests[(intptr_t)arg]
+static void xferEvent(int fd, short revents, void *arg) {
+   XferTest *test = &g_xferTests[(intptr_t)arg];
+   if (!__atomic_load_n(&test->inUse, __ATOMIC_ACQUIRE) || test->fd != fd) {
+      return;
+   }
+
+   if (test->phase == XFER_CONNECTING) {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+         xferFinish(test, "Error_InitConnectionFailed");
+         return;
+      }
+      test->tcpOpenResponseUs = test->romUs = wallclockUs();
+      test->phase = XFER_REQUEST;
+   }
+
+   if (test->phase == XFER_REQUEST) {
+      ssize_t n = send(fd, test->header + test->headerSent, test->headerLen - test->headerSent, 0);
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            xferFinish(test, "Error_InitConnectionFailed");
+         }
+         return;
+      }
+      test->headerSent += (size_t)n;
+      test->totalBytes += (uint64_t)n;
+      if (test->headerSent < test->headerLen) {
+         return;
+      }
+      test->headerLen = 0;
+      test->progressMs = monotonicMs();
+      if (test->upload) {
+         test->phase = XFER_UPLOAD_BODY;
+         test->bomUs = test->sampleStartUs = wallclockUs();
+         test->bomMs = test->progressMs;
+      } else {
+         test->phase = XFER_HEADERS;
+         reactorModify(fd, POLLIN);
+         return;
+      }
+   }
+
+   if (test->phase == XFER_UPLOAD_BODY) {
+      while (test->testBytes < test->length) {
+         ssize_t n = xferSendZeros(fd, test->length - test->testBytes);
+         if (n <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+               xferFinish(test, "Error_TransferFailed");
+            }
+            return;
+         }
+         test->testBytes += (uint64_t)n;
+         test->totalBytes += (uint64_t)n;
+         test->progressMs = monotonicMs();
+      }
+      test->eomUs = wallclockUs();
+      xferSample(test, test->eomUs);
+      test->phase = XFER_HEADERS;
+      reactorModify(fd, POLLIN);
+      return;
+   }
+
+   if (test->phase == XFER_HEADERS) {
+      ssize_t n = recv(fd, test->header + test->headerLen, sizeof(test->header) - 1 - test->headerLen, 0);
+      if (n <= 0) {
+         if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            xferFinish(test, "Error_NoResponse");
+         }
+         return;
+      }
+      test->headerLen += (size_t)n;
+      test->header[test->headerLen] = '\0';
+      if (!test->upload) {
+         test->totalBytes += (uint64_t)n;
+      }
+      test->progressMs = monotonicMs();
+      size_t headerLen = xferHeaderLength(test->header, test->headerLen);
+      if (headerLen > 0) {
+         xferResponseHeader(test, headerLen);
+      } else if (test->headerLen == sizeof(test->header) - 1) {
+         xferFinish(test, "Error_NoResponse");
+      }
+      return;
+   }
+
+   // XFER_DOWNLOAD_BODY
+   for (;;) {
+      uint64_t max = test->knownLength ? test->length - test->testBytes : XFER_CHUNK;
+      ssize_t n = xferDrain(fd, test->pipeFds, max);
+      if (n < 0) {
+         if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            xferFinish(test, "Error_TransferFailed");
+         }
+         return;
+      }
+      if (n == 0) {
+         // The server closed the connection: complete only if nothing is missing
+         xferFinish(test, test->knownLength ? "Error_TransferFailed" : "Complete");
+         return;
+      }
+      test->testBytes += (uint64_t)n;
+      test->totalBytes += (uint64_t)n;
+      test->progressMs = monotonicMs();
+      if (test->knownLength && test->testBytes >= test->length) {
+         test->eomUs = wallclockUs();
+         xferFinish(test, "Complete");
+         return;
+      }
+   }
+   (void)revents;
+}
+
+// Timer callback for g_xferTests[(intptr_t)arg]: connects on the first expiry,
+// then every tick takes incremental samples, ends a time-based test and gives
+// up on a stalled transfer
+static void xferTimer(void *arg) {
+   XferTest *test = &g_xferTests[(intptr_t)arg];
+   if (!__atomic_load_n(&test->inUse, __ATOMIC_ACQUIRE) || timerArmed(&test->timer)) {
+      return;
+   }
+   uint64_t nowMs = monotonicMs();
+
+   if (test->fd < 0) {
+      test->tcpOpenRequestUs = wallclockUs();
+      test->progressMs = nowMs;
+      test->fd = socket(test->addr.ss_family, SOCK_STREAM, 0);
+      if (test->fd < 0 || !setNonBlocking(test->fd) || (!test->upload && !xferOpenPipe(test->pipeFds)) ||
+         (connect(test->fd, (struct sockaddr *)&test->addr, test->addrLen) != 0 && errno != EINPROGRESS) ||
+         !reactorAdd(test->fd, POLLOUT, xferEvent, arg)) {
+         if (test->fd >= 0) {
+            close(test->fd);
+            test->fd = -1;
+         }
+         xferFinish(test, "Error_InitConnectionFailed");
+         return;
+      }
+   } else {
+      bool moving = test->phase == XFER_UPLOAD_BODY || test->phase == XFER_DOWNLOAD_BODY;
+      if (moving && test->intervalMs && (nowMs - test->bomMs) / test->intervalMs > (uint64_t)test->numSamples) {
+         xferSample(test, wallclockUs());
+      }
+      if (moving && test->durationMs && nowMs - test->bomMs >= test->durationMs) {
+         test->eomUs = wallclockUs();
+         xferFinish(test, "Complete");
+         return;
+      }
+      if (nowMs - test->progressMs >= XFER_IDLE_TIMEOUT_MS) {
+         xferFinish(test, "Error_Timeout");
+         return;
+      }
+   }
+   timerStart(&test->timer, TIMER_TICK_MS, xferTimer, arg);
+}
+
+// Method handler for Device.IP.Diagnostics.DownloadDiagnostics() and
+// Device.IP.Diagnostics.UploadDiagnostics()
+// Inputs:  DownloadURL or UploadURL (string, http:// only), TestFileLength
+//          (uint64 or uint32 bytes, uploads only), TimeBasedTestDuration (uint32 seconds,
+//          downloads only, 0 to transfer the whole file) and
+//          TimeBasedTestMeasurementInterval (uint32 seconds, 0 for none)
+// Outputs: Status, ROMTime, BOMTime, EOMTime, TCPOpenRequestTime,
+//          TCPOpenResponseTime, TestBytesReceived or TestBytesSent,
+//          TotalBytesReceived or TotalBytesSent, and one IncrementalResult.{i}.
+//          with StartTime, EndTime and the payload bytes per interval
+// Like IPPing(), the call completes asynchronously, and the results are stored
+// and published as ...DownloadDiagnostics.Complete! or ...UploadDiagnostics.Complete!
+static rbusError_t xferMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+
+   bool upload = strncmp(methodName, DIAG_UPLOAD_OBJECT, strlen(DIAG_UPLOAD_OBJECT) - 1) == 0;
+   const char *url = methodStringParam(inParams, upload ? "UploadURL" : "DownloadURL");
+   rbusValue_t fileLength = rbusObject_GetValue(inParams, "TestFileLength");
+   uint32_t durationSec, intervalSec;
+   char host[MAX_NAME_LEN];
+   char port[8];
+   const char *path;
+   if (!url || !xferParseUrl(url, host, sizeof(host), port, sizeof(port), &path) ||
+      !methodUInt32Param(inParams, "TimeBasedTestDuration", 0, &durationSec) ||
+      !methodUInt32Param(inParams, "TimeBasedTestMeasurementInterval", 0, &intervalSec) ||
+      (upload && (durationSec || !fileLength || (rbusValue_GetType(fileLength) != RBUS_UINT64 &&
+         rbusValue_GetType(fileLength) != RBUS_UINT32)))) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   struct addrinfo hints;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_socktype = SOCK_STREAM;
+   struct addrinfo *res = NULL;
+   if (getaddrinfo(host, port, &hints, &res) != 0 || !res) {
+      diagSetResult(outParams, "Status", diagString("Error_CannotResolveHostName"));
+      return RBUS_ERROR_SUCCESS;
+   }
+
+   pthread_mutex_lock(&g_diagLock);
+   XferTest *test = NULL;
+   for (int t = 0; t < XFER_MAX_TESTS && !test; t++) {
+      if (!__atomic_load_n(&g_xferTests[t].inUse, __ATOMIC_ACQUIRE)) {
+         test = &g_xferTests[t];
+      }
+   }
+   if (!test || res->ai_addrlen > sizeof(test->addr)) {
+      pthread_mutex_unlock(&g_diagLock);
+      freeaddrinfo(res);
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   memset(test, 0, sizeof(*test));
+   test->fd = -1;
+   test->pipeFds[0] = test->pipeFds[1] = -1;
+   test->upload = upload;
+   test->asyncHandle = asyncHandle;
+   memcpy(&test->addr, res->ai_addr, res->ai_addrlen);
+   test->addrLen = res->ai_addrlen;
+   test->durationMs = (uint64_t)durationSec * 1000;
+   test->intervalMs = (uint64_t)intervalSec * 1000;
+   if (upload) {
+      test->length = rbusValue_GetType(fileLength) == RBUS_UINT64 ? rbusValue_GetUInt64(fileLength) :
+         rbusValue_GetUInt32(fileLength);
+      test->knownLength = true;
+   }
+   int headerLen = upload ?
+      snprintf(test->header, sizeof(test->header),
+         "PUT %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %" PRIu64 "\r\nConnection: close\r\n\r\n",
+         path, host, test->length) :
+      snprintf(test->header, sizeof(test->header),
+         "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+   // The slot stays free while inUse is unset
+   if (headerLen < 0 || (size_t)headerLen >= sizeof(test->header)) {
+      pthread_mutex_unlock(&g_diagLock);
+      freeaddrinfo(res);
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   test->headerLen = (size_t)headerLen;
+   __atomic_store_n(&test->inUse, true, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&g_diagLock);
+   freeaddrinfo(res);
+
+   // The connection is opened from the main loop on the next tick
+   timerStart(&test->timer, 0, xferTimer, (void *)(intptr_t)(test - g_xferTests));
+   return RBUS_ERROR_ASYNC_RESPONSE;
+}
+
+static void xferServerClose(XferServerConn *conn) {
+   for (int c = 0; c < XFER_SERVER_MAX_CONNECTIONS; c++) {
+      if (g_xferServerConns[c] == conn) {
+         g_xferServerConns[c] = NULL;
+      }
+   }
+   coCancel(&conn->co);
+   close(conn->fd);
+   xferClosePipe(conn->pipeFds);
+   free(conn);
+}
+
+static void xferServerDone(Coroutine *co) {
+   xferServerClose(co->arg);
+}
+
+static bool xferWouldBlock(ssize_t n) {
+   return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Stand-in server connection. "GET /<bytes>" returns that many zero bytes,
+// and a PUT or POST body is discarded. A connection that moves no data for
+// XFER_IDLE_TIMEOUT_MS is closed.
+static bool xferServerRun(Coroutine *co) {
+   XferServerConn *conn = co->arg;
+   ssize_t n;
+
+   CO_BEGIN(co);
+   while ((conn->bodyStart = xferHeaderLength(conn->header, conn->headerLen)) == 0 &&
+      conn->headerLen < sizeof(conn->header) - 1) {
+      n = recv(conn->fd, conn->header + conn->headerLen, sizeof(conn->header) - 1 - conn->headerLen, 0);
+      if (xferWouldBlock(n)) {
+         CO_WAIT_FD(co, conn->fd, POLLIN, XFER_IDLE_TIMEOUT_MS);
+         if (!co->revents) {
+            CO_EXIT(co);
+         }
+      } else if (n <= 0) {
+         CO_EXIT(co);
+      } else {
+         conn->headerLen += (size_t)n;
+         conn->header[conn->headerLen] = '\0';
+      }
+   }
+
+   conn->status = 400;
+   conn->remaining = 0;
+   if (conn->bodyStart > 0 && strncmp(conn->header, "GET /", 5) == 0) {
+      conn->status = 200;
+      conn->remaining = strtoull(conn->header + 5, NULL, 10);
+   } else if (conn->bodyStart > 0 &&
+      (strncmp(conn->header, "PUT ", 4) == 0 || strncmp(conn->header, "POST ", 5) == 0) &&
+      xferContentLength(conn->header, conn->bodyStart, &conn->remaining) && xferOpenPipe(conn->pipeFds)) {
+      // Body bytes read along with the header
+      uint64_t early = conn->headerLen - conn->bodyStart;
+      conn->remaining = conn->remaining > early ? conn->remaining - early : 0;
+      while (conn->remaining > 0) {
+         n = xferDrain(conn->fd, conn->pipeFds, conn->remaining);
+         if (xferWouldBlock(n)) {
+            CO_WAIT_FD(co, conn->fd, POLLIN, XFER_IDLE_TIMEOUT_MS);
+            if (!co->revents) {
+               CO_EXIT(co);
+            }
+         } else if (n <= 0) {
+            CO_EXIT(co);
+         } else {
+            conn->remaining -= (uint64_t)n;
+         }
+      }
+      conn->status = 200;
+   }
+
+   conn->headerLen = (size_t)snprintf(conn->header, sizeof(conn->header),
+      "HTTP/1.1 %d %s\r\nContent-Length: %" PRIu64 "\r\nConnection: close\r\n\r\n",
+      conn->status, conn->status == 200 ? "OK" : "Bad Request", conn->remaining);
+   conn->headerSent = 0;
+   while (conn->headerSent < conn->headerLen) {
+      n = send(conn->fd, conn->header + conn->headerSent, conn->headerLen - conn->headerSent, 0);
+      if (xferWouldBlock(n)) {
+         CO_WAIT_FD(co, conn->fd, POLLOUT, XFER_IDLE_TIMEOUT_MS);
+         if (!co->revents) {
+            CO_EXIT(co);
+         }
+      } else if (n < 0) {
+         CO_EXIT(co);
+      } else {
+         conn->headerSent += (size_t)n;
+      }
+   }
+   while (conn->remaining > 0) {
+      n = xferSendZeros(conn->fd, conn->remaining);
+      if (xferWouldBlock(n)) {
+         CO_WAIT_FD(co, conn->fd, POLLOUT, XFER_IDLE_TIMEOUT_MS);
+         if (!co->revents) {
+            CO_EXIT(co);
+         }
+      } else if (n <= 0) {
+         CO_EXIT(co);
+      } else {
+         conn->remaining -= (uint64_t)n;
+      }
+   }
+   CO_END(co);
+}
+
+static void xferServerAccept(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   for (;;) {
+      int client = accept(fd, NULL, NULL);
+      if (client < 0) {
+         return;
+      }
+      int slot = -1;
+      for (int c = 0; c < XFER_SERVER_MAX_CONNECTIONS && slot < 0; c++) {
+         if (!g_xferServerConns[c]) {
+            slot = c;
+         }
+      }
+      XferServerConn *conn = slot >= 0 ? calloc(1, sizeof(XferServerConn)) : NULL;
+      if (!conn || !setNonBlocking(client)) {
+         free(conn);
+         close(client);
+         continue;
+      }
+      conn->fd = client;
+      conn->pipeFds[0] = conn->pipeFds[1] = -1;
+      g_xferServerConns[slot] = conn;
+      coStart(&conn->co, xferServerRun, xferServerDone, conn);
+   }
+}
+
+// Set up the zero-copy sources and sinks and, if serverPort is set, the HTTP
+// stand-in server for loopback tests
+static bool xferStart(int serverPort) {
+#ifdef __linux__
+   char zeroPath[] = "/tmp/rbus-datamodels-XXXXXX";
+   g_xferZeroFd = mkstemp(zeroPath);
+   if (g_xferZeroFd >= 0) {
+      unlink(zeroPath);
+   }
+   g_xferNullFd = open("/dev/null", O_WRONLY);
+   // A sparse file reads back as zeros without using disk space
+   if (g_xferZeroFd < 0 || ftruncate(g_xferZeroFd, XFER_CHUNK) != 0 || g_xferNullFd < 0) {
+      fprintf(stderr, "Failed to set up transfer diagnostics: %s\n", strerror(errno));
+      return false;
+   }
+#endif
+
+   if (serverPort > 0) {
+      struct sockaddr_in6 addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin6_family = AF_INET6;
+      addr.sin6_addr = in6addr_any;
+      addr.sin6_port = htons((uint16_t)serverPort);
+      int off = 0;
+      int on = 1;
+      int fd = socket(AF_INET6, SOCK_STREAM, 0);
+      if (fd < 0 || setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0 ||
+         setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, XFER_SERVER_MAX_CONNECTIONS) < 0 ||
+         !setNonBlocking(fd) || !reactorAdd(fd, POLLIN, xferServerAccept, NULL)) {
+         fprintf(stderr, "Failed to start the throughput server on port %d: %s\n", serverPort, strerror(errno));
+         if (fd >= 0) {
+            close(fd);
+         }
+         return false;
+      }
+      g_xferServerFd = fd;
+      printf("Throughput server on port %d\n", serverPort);
+   }
+   return true;
+}
+
+static void xferStop(void) {
+   for (int t = 0; t < XFER_MAX_TESTS; t++) {
+      XferTest *test = &g_xferTests[t];
+      timerCancel(&test->timer);
+      if (test->inUse && test->fd >= 0) {
+         reactorRemove(test->fd);
+         close(test->fd);
+      }
+      if (test->inUse) {
+         xferClosePipe(test->pipeFds);
+         free(test->samples);
+      }
+      test->inUse = false;
+   }
+   for (int c = 0; c < XFER_SERVER_MAX_CONNECTIONS; c++) {
+      if (g_xferServerConns[c]) {
+         xferServerClose(g_xferServerConns[c]);
+      }
+   }
+   if (g_xferServerFd >= 0) {
+      reactorRemove(g_xferServerFd);
+      close(g_xferServerFd);
+      g_xferServerFd = -1;
+   }
+   if (g_xferZeroFd >= 0) {
+      close(g_xferZeroFd);
+      g_xferZeroFd = -1;
+   }
+   if (g_xferNullFd >= 0) {
+      close(g_xferNullFd);
+      g_xferNullFd = -1;
+   }
+}
+
+// Method handler for Device.X_RDK_DataModels.InjectFault(), only with --fault-injection
+// Inputs:  Pattern (string: a name, with "*" for any one segment, or a prefix
+//          ending in "."), Operations (string, comma-separated "get", "set",
+//          "event" and "method", default all), Latency ("fixed", "uniform" or
+//          "exponential", default fixed), LatencyMs (uint32: the fixed latency,
+//          uniform minimum or exponential mean), LatencyMaxMs (uint32: the
+//          uniform maximum or exponential cap; both at most
+//          FAULT_MAX_BLOCKING_MS for gets and sets), ErrorCode (uint32 rbusError_t
+//          answered to gets, sets and methods), ErrorPercent (uint32, default
+//          100 with an ErrorCode), DropPercent (uint32, events discarded) and
+//          Blocking (boolean, required to be true for a latency on gets or
+//          sets, as these hold the calling rbus thread)
+// Output:  Id (uint32), for ClearFaults()
+static rbusError_t injectFaultMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)asyncHandle;
+   if (!g_faultEnabled) {
+      return RBUS_ERROR_ACCESS_NOT_ALLOWED;
+   }
+
+   FaultRule rule;
+   memset(&rule, 0, sizeof(rule));
+   const char *pattern = methodStringParam(inParams, "Pattern");
+   const char *operations = methodStringParam(inParams, "Operations");
+   const char *latency = methodStringParam(inParams, "Latency");
+   uint32_t error;
+   bool blocking;
+   if (!pattern || !pattern[0] || strlen(pattern) >= sizeof(rule.pattern) ||
+      !methodUInt32Param(inParams, "LatencyMs", 0, &rule.latencyMs) ||
+      !methodUInt32Param(inParams, "LatencyMaxMs", 0, &rule.latencyMaxMs) ||
+      !methodUInt32Param(inParams, "ErrorCode", RBUS_ERROR_SUCCESS, &error) ||
+      !methodUInt32Param(inParams, "ErrorPercent", error != RBUS_ERROR_SUCCESS ? 100 : 0, &rule.errorPercent) ||
+      !methodUInt32Param(inParams, "DropPercent", 0, &rule.dropPercent) ||
+      !methodBoolParam(inParams, "Blocking", false, &blocking) ||
+      rule.latencyMs > FAULT_MAX_LATENCY_MS || rule.latencyMaxMs > FAULT_MAX_LATENCY_MS ||
+      error == RBUS_ERROR_ASYNC_RESPONSE || rule.errorPercent > 100 || rule.dropPercent > 100) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   strcpy(rule.pattern, pattern);
+   rule.error = (rbusError_t)error;
+
+   if (!latency || strcmp(latency, "fixed") == 0) {
+      rule.latency = FAULT_FIXED;
+   } else if (strcmp(latency, "uniform") == 0 && rule.latencyMaxMs >= rule.latencyMs) {
+      rule.latency = FAULT_UNIFORM;
+   } else if (strcmp(latency, "exponential") == 0) {
+      rule.latency = FAULT_EXPONENTIAL;
+   } else {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   if (!operations) {
+      rule.ops = FAULT_ALL;
+   } else {
+      char list[64];
+      if (strlen(operations) >= sizeof(list)) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+      strcpy(list, operations);
+      char *save = NULL;
+      for (char *token = strtok_r(list, ", ", &save); token; token = strtok_r(NULL, ", ", &save)) {
+         if (strcmp(token, "get") == 0) {
+            rule.ops |= FAULT_GET;
+         } else if (strcmp(token, "set") == 0) {
+            rule.ops |= FAULT_SET;
+         } else if (strcmp(token, "event") == 0) {
+            rule.ops |= FAULT_EVENT;
+         } else if (strcmp(token, "method") == 0) {
+            rule.ops |= FAULT_METHOD;
+         } else {
+            return RBUS_ERROR_INVALID_INPUT;
+         }
+      }
+      if (rule.ops == 0) {
+         return RBUS_ERROR_INVALID_INPUT;
+      }
+   }
+   // Gets and sets are held on the rbus thread that called the handler, so
+   // a latency for them must be asked for explicitly
+   if ((rule.ops & (FAULT_GET | FAULT_SET)) && (rule.latencyMs || rule.latencyMaxMs) &&
+      (!blocking || rule.latencyMs > FAULT_MAX_BLOCKING_MS || rule.latencyMaxMs > FAULT_MAX_BLOCKING_MS)) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   pthread_mutex_lock(&g_faultLock);
+   if (g_faultNumRules == FAULT_MAX_RULES) {
+      pthread_mutex_unlock(&g_faultLock);
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   rule.id = g_faultNextId++;
+   g_faultRules[g_faultNumRules] = rule;
+   __atomic_store_n(&g_faultNumRules, g_faultNumRules + 1, __ATOMIC_RELAXED);
+   pthread_mutex_unlock(&g_faultLock);
+
+   rbusValue_t id;
+   rbusValue_Init(&id);
+   rbusValue_SetUInt32(id, rule.id);
+   rbusObject_SetValue(outParams, "Id", id);
+   rbusValue_Release(id);
+   printf("Fault %u: %s, %u ms %s latency, error %d in %u%%, %u%% of events dropped\n", rule.id, rule.pattern,
+      rule.latencyMs, latency ? latency : "fixed", rule.error, rule.errorPercent, rule.dropPercent);
+   return RBUS_ERROR_SUCCESS;
+}
+
+// Method handler for Device.X_RDK_DataModels.ClearFaults(), only with --fault-injection
+// Input: Id (uint32, the rule to remove; every rule without it). Responses and
+// events already held back are still sent when their latency runs out.
+static rbusError_t clearFaultsMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)outParams;
+   (void)asyncHandle;
+   if (!g_faultEnabled) {
+      return RBUS_ERROR_ACCESS_NOT_ALLOWED;
+   }
+   uint32_t id;
+   if (!methodUInt32Param(inParams, "Id", 0, &id)) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+
+   pthread_mutex_lock(&g_faultLock);
+   int kept = 0;
+   for (int r = 0; r < g_faultNumRules; r++) {
+      if (id != 0 && g_faultRules[r].id != id) {
+         g_faultRules[kept++] = g_faultRules[r];
+      }
+   }
+   bool found = kept < g_faultNumRules;
+   __atomic_store_n(&g_faultNumRules, kept, __ATOMIC_RELAXED);
+   pthread_mutex_unlock(&g_faultLock);
+   return found || id == 0 ? RBUS_ERROR_SUCCESS : RBUS_ERROR_INVALID_INPUT;
+}
+
+#ifdef SIMULATED_CLOCK
+// Method handler for Device.X_RDK_DataModels.AdvanceClock(), only with --simulated-clock
+// Input:  Ms (uint32)
+// Output: Time (string, the simulated date and time afterwards)
+// The call completes once the main loop has moved the clocks and run every
+// timer that expired on the way.
+static rbusError_t advanceClockMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   (void)handle;
+   (void)methodName;
+   (void)outParams;
+   if (!g_clockSimulated) {
+      return RBUS_ERROR_ACCESS_NOT_ALLOWED;
+   }
+   uint32_t ms;
+   if (!methodUInt32Param(inParams, "Ms", 0, &ms) || ms == 0 || !asyncHandle) {
+      return RBUS_ERROR_INVALID_INPUT;
+   }
+   pthread_mutex_lock(&g_clockLock);
+   bool busy = g_clockAdvanceHandle != NULL;
+   if (!busy) {
+      g_clockAdvanceMs = ms;
+      g_clockAdvanceHandle = asyncHandle;
+   }
+   pthread_mutex_unlock(&g_clockLock);
+   // A full pipe already holds a wake-up
+   if (!busy && write(g_clockWakeFds[1], "", 1) < 0 && errno != EAGAIN) {
+      fprintf(stderr, "Failed to wake the main loop: %s\n", strerror(errno));
+   }
+   return busy ? RBUS_ERROR_INVALID_OPERATION : RBUS_ERROR_ASYNC_RESPONSE;
+}
+
+// Main loop: carry out a waiting AdvanceClock() call
+static void clockRunPending(void) {
+   pthread_mutex_lock(&g_clockLock);
+   uint64_t ms = g_clockAdvanceMs;
+   rbusMethodAsyncHandle_t asyncHandle = g_clockAdvanceHandle;
+   pthread_mutex_unlock(&g_clockLock);
+   if (!asyncHandle) {
+      return;
+   }
+
+   clockAdvance(ms);
+   char now[40];
+   diagTimeString(wallclockUs(), now, sizeof(now));
+   rbusObject_t results;
+   rbusObject_Init(&results, NULL);
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetString(value, now);
+   rbusObject_SetValue(results, "Time", value);
+   rbusValue_Release(value);
+   rbusMethod_SendAsyncResponse(asyncHandle, RBUS_ERROR_SUCCESS, results);
+   rbusObject_Release(results);
+
+   pthread_mutex_lock(&g_clockLock);
+   g_clockAdvanceHandle = NULL;
+   pthread_mutex_unlock(&g_clockLock);
+}
+
+// Reactor callback for the wake pipe
+static void clockWake(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   char buf[64];
+   while (read(fd, buf, sizeof(buf)) > 0) {
+   }
+   clockRunPending();
+}
+
+static void clockStop(void) {
+   if (g_clockWakeFds[0] >= 0) {
+      reactorRemove(g_clockWakeFds[0]);
+      close(g_clockWakeFds[0]);
+      g_clockWakeFds[0] = -1;
+   }
+   if (g_clockWakeFds[1] >= 0) {
+      close(g_clockWakeFds[1]);
+      g_clockWakeFds[1] = -1;
+   }
+}
+
+// With --simulated-clock, watch the pipe through which AdvanceClock() calls
+// reach the main loop without waiting for its next tick
+static bool clockStart(void) {
+   if (!g_clockSimulated) {
+      return true;
+   }
+   if (pipe(g_clockWakeFds) != 0) {
+      g_clockWakeFds[0] = g_clockWakeFds[1] = -1;
+   }
+   if (g_clockWakeFds[0] < 0 || !setNonBlocking(g_clockWakeFds[0]) || !setNonBlocking(g_clockWakeFds[1]) ||
+      !reactorAdd(g_clockWakeFds[0], POLLIN, clockWake, NULL)) {
+      fprintf(stderr, "Failed to set up the simulated clock: %s\n", strerror(errno));
+      clockStop();
+      return false;
+   }
+   return true;
+}
+#endif
+
+// Provider methods registered alongside the data models
+static rbusDataElement_t g_methodElements[] = {
+   {"Device.X_RDK_DataModels.GetPage()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, getPageMethodHandler}},
+   {"Device.X_RDK_DataModels.CompareAndSet()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, compareAndSetMethodHandler}},
+   {"Device.X_RDK_DataModels.Set()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, setMethodHandler}},
+   {"Device.X_RDK_DataModels.AtomicUpdate()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, atomicUpdateMethodHandler}},
+   {"Device.X_RDK_DataModels.GetCacheAge()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, getCacheAgeMethodHandler}},
+   {"Device.X_RDK_DataModels.AddReportProfile()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, addReportProfileMethodHandler}},
+   {"Device.X_RDK_DataModels.RemoveReportProfile()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, removeReportProfileMethodHandler}},
+   {"Device.X_RDK_DataModels.InjectFault()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, injectFaultMethodHandler}},
+   {"Device.X_RDK_DataModels.ClearFaults()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, clearFaultsMethodHandler}},
+#ifdef SIMULATED_CLOCK
+   {"Device.X_RDK_DataModels.AdvanceClock()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, advanceClockMethodHandler}},
+#endif
+   {"Device.IP.Diagnostics.IPPing()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, diagMethodHandler}},
+   {"Device.IP.Diagnostics.UDPEchoDiagnostics()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, diagMethodHandler}},
+   {"Device.IP.Diagnostics.DownloadDiagnostics()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, xferMethodHandler}},
+   {"Device.IP.Diagnostics.UploadDiagnostics()", RBUS_ELEMENT_TYPE_METHOD, {NULL, NULL, NULL, NULL, NULL, xferMethodHandler}},
+   {DIAG_IPPING_OBJECT "Complete!", RBUS_ELEMENT_TYPE_EVENT, {NULL, NULL, NULL, NULL, eventSubHandler, NULL}},
+   {DIAG_UDPECHO_OBJECT "Complete!", RBUS_ELEMENT_TYPE_EVENT, {NULL, NULL, NULL, NULL, eventSubHandler, NULL}},
+   {DIAG_DOWNLOAD_OBJECT "Complete!", RBUS_ELEMENT_TYPE_EVENT, {NULL, NULL, NULL, NULL, eventSubHandler, NULL}},
+   {DIAG_UPLOAD_OBJECT "Complete!", RBUS_ELEMENT_TYPE_EVENT, {NULL, NULL, NULL, NULL, eventSubHandler, NULL}},
+};
+#define NUM_METHOD_ELEMENTS (int)(sizeof(g_methodElements) / sizeof(g_methodElements[0]))
+static bool g_methodsRegistered = false;
+// Handlers of g_methodElements that faultMethodHandler() stands in for
+static rbusMethodHandler_t g_faultMethodHandlers[NUM_METHOD_ELEMENTS];
+
+// Registered in place of every method but InjectFault() and ClearFaults()
+// with --fault-injection. A response with an injected latency is sent
+// asynchronously from the timer wheel, so it holds up no other request.
+// Methods that already answer asynchronously, the diagnostics, only get
+// injected errors.
+static rbusError_t faultMethodHandler(rbusHandle_t handle, char const *methodName, rbusObject_t inParams, rbusObject_t outParams, rbusMethodAsyncHandle_t asyncHandle) {
+   rbusMethodHandler_t handler = NULL;
+   for (int m = 0; m < NUM_METHOD_ELEMENTS && !handler; m++) {
+      if (strcmp(g_methodElements[m].name, methodName) == 0) {
+         handler = g_faultMethodHandlers[m];
+      }
+   }
+   if (!handler) {
+      return RBUS_ERROR_INVALID_METHOD;
+   }
+
+   uint32_t delayMs;
+   bool drop;
+   rbusError_t rc = faultCheck(FAULT_METHOD, methodName, &delayMs, &drop);
+   if (delayMs == 0 || !asyncHandle) {
+      return rc != RBUS_ERROR_SUCCESS ? rc : handler(handle, methodName, inParams, outParams, asyncHandle);
+   }
+
+   FaultDeferred *d = calloc(1, sizeof(*d));
+   if (!d) {
+      return RBUS_ERROR_OUT_OF_RESOURCES;
+   }
+   rbusObject_Init(&d->results, NULL);
+   d->asyncHandle = asyncHandle;
+   d->error = rc != RBUS_ERROR_SUCCESS ? rc : handler(handle, methodName, inParams, d->results, asyncHandle);
+   if (d->error == RBUS_ERROR_ASYNC_RESPONSE) {
+      faultDeferredFree(d);
+      return RBUS_ERROR_ASYNC_RESPONSE;
+   }
+   faultDefer(d, delayMs);
+   return RBUS_ERROR_ASYNC_RESPONSE;
+}
+
+// With --fault-injection, put faultMethodHandler() in front of the methods
+static void faultWrapMethods(void) {
+   for (int m = 0; m < NUM_METHOD_ELEMENTS; m++) {
+      rbusMethodHandler_t handler = g_methodElements[m].cbTable.methodHandler;
+      if (handler && handler != injectFaultMethodHandler && handler != clearFaultsMethodHandler) {
+         g_faultMethodHandlers[m] = handler;
+         g_methodElements[m].cbTable.methodHandler = faultMethodHandler;
+      }
+   }
+}
+
+// Answer held-back method responses at once and drop held-back events
+static void faultStop(void) {
+   pthread_mutex_lock(&g_faultLock);
+   g_faultStopping = true;
+   while (g_faultDeferred.next != &g_faultDeferred) {
+      FaultDeferred *d = g_faultDeferred.next;
+      timerCancel(&d->timer);
+      d->prev->next = d->next;
+      d->next->prev = d->prev;
+      if (d->asyncHandle && g_rbusHandle) {
+         rbusMethod_SendAsyncResponse(d->asyncHandle, d->error, d->results);
+      }
+      faultDeferredFree(d);
+   }
+   g_faultNumRules = 0;
+   pthread_mutex_unlock(&g_faultLock);
+}
+
+// One exported series: a numeric parameter and where its value sits in the
+// persistent textfile buffer
+typedef struct {
+   int model;
+   uint32_t version;         // Version last rendered; 0 until the first render
+   size_t valueOffset;       // Start of the fixed-width value field in g_promBuf
+} PromSeries;
+
+static const char *g_promPath = NULL;
+static const char *g_promSubtrees[PROM_MAX_SUBTREES];
+static int g_numPromSubtrees = 0;
+static uint32_t g_promIntervalSec = PROM_DEFAULT_INTERVAL;
+static PromSeries *g_promSeries = NULL;
+static int g_numPromSeries = 0;
+static JsonWriter g_promBuf = {0};
+static SchedTask g_promTask;
+
+// Types exported as gauges. Booleans, date-times and strings are not numbers.
+static bool isNumericType(ValueType type) {
+   switch (type) {
+   case TYPE_INT:
+   case TYPE_UINT:
+   case TYPE_LONG:
+   case TYPE_ULONG:
+   case TYPE_FLOAT:
+   case TYPE_DOUBLE:
+   case TYPE_BYTE:
+      return true;
+   default:
+      return false;
+   }
+}
+
+// Metric family and labels for name: the non-numeric path segments, lowercased
+// and joined by "_", form the family; numeric instance segments become the
+// labels index, index2, ...
+static void promMetricName(const char *name, char *family, size_t familyLen, char *labels, size_t labelsLen) {
+   size_t f = 0;
+   size_t l = 0;
+   int numIndexes = 0;
+   family[0] = labels[0] = '\0';
+   while (*name) {
+      size_t segLen = strcspn(name, ".");
+      bool numeric = segLen > 0 && strspn(name, "0123456789") == segLen;
+      if (numeric) {
+         numIndexes++;
+         int n = numIndexes == 1 ? snprintf(labels + l, labelsLen - l, "%sindex=\"%.*s\"", l ? "," : "", (int)segLen, name)
+                                 : snprintf(labels + l, labelsLen - l, "%sindex%d=\"%.*s\"", l ? "," : "", numIndexes, (int)segLen, name);
+         l = n > 0 && l + n < labelsLen ? l + n : l;
+      } else if (segLen > 0) {
+         if (f > 0 && f + 1 < familyLen) {
+            family[f++] = '_';
+         }
+         for (size_t c = 0; c < segLen && f + 1 < familyLen; c++) {
+            char ch = name[c];
+            family[f++] = (ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' :
+               ((ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9')) ? ch : '_';
+         }
+      }
+      family[f] = '\0';
+      name += segLen;
+      if (*name == '.') {
+         name++;
+      }
+   }
+}
+
+// Whether a and b have the same segments, apart from their instance numbers.
+// Only such parameters may share a metric family: others would either mix two
+// parameters in one series, as Foo-Bar and Foo_Bar would, or give one family
+// two label sets, as Foo.1.Bar and Foo.Bar would.
+static bool promSameShape(const char *a, const char *b) {
+   for (;;) {
+      size_t aLen = strcspn(a, ".");
+      size_t bLen = strcspn(b, ".");
+      bool aNumeric = aLen > 0 && strspn(a, "0123456789") == aLen;
+      bool bNumeric = bLen > 0 && strspn(b, "0123456789") == bLen;
+      if (aNumeric != bNumeric || (!aNumeric && (aLen != bLen || memcmp(a, b, aLen) != 0))) {
+         return false;
+      }
+      a += aLen;
+      b += bLen;
+      if (*a != *b) {
+         return false;
+      }
+      if (!*a) {
+         return true;
+      }
+      a++;
+      b++;
+   }
+}
+
+typedef struct {
+   int model;
+   char family[MAX_NAME_LEN];
+   char labels[MAX_NAME_LEN];
+} PromLayoutEntry;
+
+static int comparePromLayout(const void *a, const void *b) {
+   const PromLayoutEntry *x = a;
+   const PromLayoutEntry *y = b;
+   int c = strcmp(x->family, y->family);
+   return c ? c : x->model - y->model;
+}
+
+// Render a number into the fixed-width value field, right-aligned
+static void promFillValue(size_t offset, const char *value) {
+   size_t len = strlen(value);
+   if (len > PROM_VALUE_WIDTH) {
+      len = PROM_VALUE_WIDTH;
+   }
+   memset(g_promBuf.data + offset, ' ', PROM_VALUE_WIDTH - len);
+   memcpy(g_promBuf.data + offset + PROM_VALUE_WIDTH - len, value, len);
+}
+
+static void promFormatDouble(char *out, size_t outLen, double d) {
+   if (isnan(d)) {
+      snprintf(out, outLen, "NaN");
+   } else if (isinf(d)) {
+      snprintf(out, outLen, d > 0 ? "+Inf" : "-Inf");
+   } else {
+      snprintf(out, outLen, "%.17g", d);
+   }
+}
+
+// Format the stored value of dm; the caller holds g_storeLock shared
+static void promFormatDataModel(const DataModel *dm, char *out, size_t outLen) {
+   switch (dm->type) {
+   case TYPE_INT:
+      snprintf(out, outLen, "%" PRId32, __atomic_load_n(&dm->value.intVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_UINT:
+      snprintf(out, outLen, "%" PRIu32, __atomic_load_n(&dm->value.uintVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_LONG:
+      snprintf(out, outLen, "%" PRId64, __atomic_load_n(&dm->value.longVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_ULONG:
+      snprintf(out, outLen, "%" PRIu64, __atomic_load_n(&dm->value.ulongVal, __ATOMIC_RELAXED));
+      break;
+   case TYPE_FLOAT: {
+      float f;
+      __atomic_load(&dm->value.floatVal, &f, __ATOMIC_RELAXED);
+      promFormatDouble(out, outLen, f);
+      break;
+   }
+   case TYPE_DOUBLE: {
+      double d;
+      __atomic_load(&dm->value.doubleVal, &d, __ATOMIC_RELAXED);
+      promFormatDouble(out, outLen, d);
+      break;
+   }
+   case TYPE_BYTE:
+      snprintf(out, outLen, "%u", (unsigned)__atomic_load_n(&dm->value.byteVal, __ATOMIC_RELAXED));
+      break;
+   default:
+      snprintf(out, outLen, "NaN");
+      break;
+   }
+}
+
+static void promFormatValue(rbusValue_t value, char *out, size_t outLen) {
+   switch (rbusValue_GetType(value)) {
+   case RBUS_INT32:
+      snprintf(out, outLen, "%" PRId32, rbusValue_GetInt32(value));
+      break;
+   case RBUS_UINT32:
+      snprintf(out, outLen, "%" PRIu32, rbusValue_GetUInt32(value));
+      break;
+   case RBUS_INT64:
+      snprintf(out, outLen, "%" PRId64, rbusValue_GetInt64(value));
+      break;
+   case RBUS_UINT64:
+      snprintf(out, outLen, "%" PRIu64, rbusValue_GetUInt64(value));
+      break;
+   case RBUS_SINGLE:
+      promFormatDouble(out, outLen, rbusValue_GetSingle(value));
+      break;
+   case RBUS_DOUBLE:
+      promFormatDouble(out, outLen, rbusValue_GetDouble(value));
+      break;
+   case RBUS_BYTE:
+      snprintf(out, outLen, "%u", (unsigned)rbusValue_GetByte(value));
+      break;
+   default:
+      snprintf(out, outLen, "NaN");
+      break;
+   }
+}
+
+// Background task: re-render the series whose version changed since the last
+// export, then replace the textfile with the buffer
+static void promExport(void *arg) {
+   (void)arg;
+   char value[32];
+   pthread_rwlock_rdlock(&g_storeLock);
+   for (int s = 0; s < g_numPromSeries; s++) {
+      PromSeries *series = &g_promSeries[s];
+      const DataModel *dm = &g_dataModels[series->model];
+      uint32_t version = __atomic_load_n(&dm->version, __ATOMIC_ACQUIRE);
+      if (!dm->getHandler && version != series->version) {
+         promFormatDataModel(dm, value, sizeof(value));
+         promFillValue(series->valueOffset, value);
+         series->version = version;
+      }
+   }
+   pthread_rwlock_unlock(&g_storeLock);
+
+   // Live values carry no version, so they are rendered on every export
+   char buf[MAX_NAME_LEN];
+   for (int s = 0; s < g_numPromSeries; s++) {
+      PromSeries *series = &g_promSeries[s];
+      if (!g_dataModels[series->model].getHandler) {
+         continue;
+      }
+      rbusProperty_t property;
+      rbusProperty_Init(&property, dataModelName(series->model, buf), NULL);
+      if (getDataModelValue(g_rbusHandle, series->model, property) == RBUS_ERROR_SUCCESS && rbusProperty_GetValue(property)) {
+         promFormatValue(rbusProperty_GetValue(property), value, sizeof(value));
+      } else {
+         snprintf(value, sizeof(value), "NaN");
+      }
+      promFillValue(series->valueOffset, value);
+      rbusProperty_Release(property);
+   }
+
+   char tmp[MAX_NAME_LEN + 4];
+   snprintf(tmp, sizeof(tmp), "%s.tmp", g_promPath);
+   FILE *f = fopen(tmp, "wb");
+   if (!f) {
+      fprintf(stderr, "Prometheus export: %s: %s\n", tmp, strerror(errno));
+   } else {
+      bool ok = fwrite(g_promBuf.data, 1, g_promBuf.len, f) == g_promBuf.len;
+      ok = fclose(f) == 0 && ok;
+      if (!ok || rename(tmp, g_promPath) != 0) {
+         fprintf(stderr, "Prometheus export: %s: %s\n", g_promPath, strerror(errno));
+         unlink(tmp);
+      }
+   }
+
+   schedAfter(&g_promTask, g_promIntervalSec * 1000ULL);
+}
+
+// Lay out the textfile for every numeric parameter under the selected
+// subtrees: series are grouped by metric family, and each line ends in a
+// fixed-width value field that later exports overwrite in place
+static bool promStart(void) {
+   if (g_numPromSubtrees == 0) {
+      g_promSubtrees[g_numPromSubtrees++] = "Device.";
+   }
+
+   PromLayoutEntry *layout = malloc(g_totalDataModels * sizeof(PromLayoutEntry));
+   if (!layout) {
+      return false;
+   }
+   int count = 0;
+   char buf[MAX_NAME_LEN];
+   for (int i = 0; i < g_totalDataModels; i++) {
+      const char *name = dataModelName(i, buf);
+      bool selected = false;
+      for (int p = 0; p < g_numPromSubtrees && !selected; p++) {
+         selected = strncmp(name, g_promSubtrees[p], strlen(g_promSubtrees[p])) == 0;
+      }
+      if (selected && isNumericType(g_dataModels[i].type)) {
+         layout[count].model = i;
+         promMetricName(name, layout[count].family, MAX_NAME_LEN, layout[count].labels, MAX_NAME_LEN);
+         count++;
+      }
+   }
+   qsort(layout, count, sizeof(PromLayoutEntry), comparePromLayout);
+
+   // A family belongs to its first parameter; the parameters of another shape
+   // that map to it are skipped, with one warning per family
+   char first[MAX_NAME_LEN];
+   char other[MAX_NAME_LEN];
+   int kept = 0;
+   int familyStart = 0;
+   int skipped = 0;
+   for (int s = 0; s <= count; s++) {
+      if (s == count || strcmp(layout[s].family, layout[familyStart].family) != 0) {
+         if (skipped > 0) {
+            fprintf(stderr, "Prometheus export: metric %s belongs to %s; skipped %d parameter%s such as %s\n",
+               layout[familyStart].family, dataModelName(layout[familyStart].model, first), skipped,
+               skipped == 1 ? "" : "s", other);
+         }
+         if (s == count) {
+            break;
+         }
+         familyStart = kept;
+         skipped = 0;
+      } else {
+         const char *name = dataModelName(layout[s].model, buf);
+         if (!promSameShape(dataModelName(layout[familyStart].model, first), name)) {
+            if (skipped++ == 0) {
+               snprintf(other, sizeof(other), "%s", name);
+            }
+            continue;
+         }
+      }
+      layout[kept++] = layout[s];
+   }
+   count = kept;
+
+   g_promSeries = calloc(count ? count : 1, sizeof(PromSeries));
+   if (!g_promSeries) {
+      free(layout);
+      return false;
+   }
+   JsonWriter *w = &g_promBuf;
+   for (int s = 0; s < count; s++) {
+      if (s == 0 || strcmp(layout[s].family, layout[s - 1].family) != 0) {
+         jwLiteral(w, "# TYPE ");
+         jwLiteral(w, layout[s].family);
+         jwLiteral(w, " gauge\n");
+      }
+      jwLiteral(w, layout[s].family);
+      if (layout[s].labels[0]) {
+         jwLiteral(w, "{");
+         jwLiteral(w, layout[s].labels);
+         jwLiteral(w, "}");
+      }
+      jwLiteral(w, " ");
+      g_promSeries[s].model = layout[s].model;
+      g_promSeries[s].valueOffset = w->len;
+      jwAppend(w, "NaN", 3);
+      for (int pad = 3; pad < PROM_VALUE_WIDTH; pad++) {
+         jwLiteral(w, " ");
+      }
+      jwLiteral(w, "\n");
+   }
+   free(layout);
+   if (w->failed) {
+      return false;
+   }
+   g_numPromSeries = count;
+
+   printf("Exporting %d series to %s every %u s\n", count, g_promPath, g_promIntervalSec);
+   schedInit(&g_promTask, SCHED_BACKGROUND, promExport, NULL);
+   schedSubmit(&g_promTask);
+   return true;
+}
+
+static void promStop(void) {
+   timerCancel(&g_promTask.timer);
+   free(g_promSeries);
+   g_promSeries = NULL;
+   g_numPromSeries = 0;
+   free(g_promBuf.data);
+   memset(&g_promBuf, 0, sizeof(g_promBuf));
+}
+
+// Build a value of the stored type of g_dataModels[i] from an integer
+static rbusValue_t storeNumberValue(int i, int64_t number) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   switch (g_dataModels[i].type) {
+   case TYPE_INT:
+      rbusValue_SetInt32(value, (int32_t)number);
+      break;
+   case TYPE_LONG:
+      rbusValue_SetInt64(value, number);
+      break;
+   case TYPE_ULONG:
+      rbusValue_SetUInt64(value, number < 0 ? 0 : (uint64_t)number);
+      break;
+   default:
+      rbusValue_SetUInt32(value, number < 0 ? 0 : (uint32_t)number);
+      break;
+   }
+   return value;
+}
+
+// Store writes of a backend are queued in its own batch and applied in one
+// exclusive hold of the store lock, with their value-change events. A batch is
+// used by one thread at a time; the backends keep theirs in static storage, so
+// only the entries a backend queues are ever touched.
+typedef struct {
+   SetEntry entries[STORE_BATCH_SIZE];
+   char names[STORE_BATCH_SIZE][MAX_NAME_LEN];
+   int numEntries;
+   int numApplied;                 // Entries already written to the store
+} StoreBatch;
+
+// Write the queued values to the store without publishing their events yet
+static void storeBatchApply(StoreBatch *batch) {
+   applySetEntries(batch->entries + batch->numApplied, batch->numEntries - batch->numApplied, 0);
+   batch->numApplied = batch->numEntries;
+}
+
+// Write the queued values and publish their value-change events
+static void storeBatchFlush(StoreBatch *batch) {
+   storeBatchApply(batch);
+   finishSetEntries(batch->entries, batch->numEntries, false, 0);
+   for (int e = 0; e < batch->numEntries; e++) {
+      rbusValue_Release(batch->entries[e].newValue);
+   }
+   batch->numEntries = 0;
+   batch->numApplied = 0;
+}
+
+// Queue a write of value to g_dataModels[index], taking ownership of value.
+// Negative indexes, for rows the store lacks, are ignored.
+static void storeBatchAdd(StoreBatch *batch, int index, rbusValue_t value) {
+   if (batch->numEntries == STORE_BATCH_SIZE) {
+      storeBatchFlush(batch);
+   }
+   SetEntry *entry = &batch->entries[batch->numEntries];
+   memset(entry, 0, sizeof(*entry));
+   entry->index = index;
+   entry->newValue = value;
+   if (index < 0 || !valueMatchesType(g_dataModels[index].type, value) ||
+      prepareStoreValue(index, value, &entry->str) != RBUS_ERROR_SUCCESS) {
+      rbusValue_Release(value);
+      return;
+   }
+   entry->name = dataModelName(index, batch->names[batch->numEntries]);
+   batch->numEntries++;
+}
+
+static void storeBatchString(StoreBatch *batch, int index, const char *str) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetString(value, str);
+   storeBatchAdd(batch, index, value);
+}
+
+static void storeBatchNumber(StoreBatch *batch, int index, int64_t number) {
+   if (index >= 0) {
+      storeBatchAdd(batch, index, storeNumberValue(index, number));
+   }
+}
+
+// Only the Wi-Fi rows and the DNS servers, which need Linux, publish flags
+#ifdef __linux__
+static void storeBatchBool(StoreBatch *batch, int index, bool b) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetBoolean(value, b);
+   storeBatchAdd(batch, index, value);
+}
+#endif
+
+// Scheduler statistics under SCHED_OBJECT, one set per class: the tasks run,
+// and the mean and longest wait in the queue, in microseconds, of the tasks
+// that started during the last second
+static const char *const g_schedClassNames[NUM_SCHED_CLASSES] = {"Interactive", "Periodic", "Background"};
+enum { SCHED_TASKS, SCHED_LATENCY_AVG, SCHED_LATENCY_MAX, NUM_SCHED_FIELDS };
+static const StoreField g_schedFields[NUM_SCHED_FIELDS] = {
+   {"Tasks", TYPE_ULONG},
+   {"QueueLatencyAvg", TYPE_UINT},
+   {"QueueLatencyMax", TYPE_UINT},
+};
+
+static int g_schedFieldIndexes[NUM_SCHED_CLASSES][NUM_SCHED_FIELDS];
+static int64_t g_schedValues[NUM_SCHED_CLASSES][NUM_SCHED_FIELDS];
+static SchedStats g_schedLastStats[NUM_SCHED_CLASSES];
+static Timer g_schedStatsTimer;
+static StoreBatch g_schedStatsBatch;
+
+// Add the statistics to the store, unless the JSON file defines them. Must run
+// before buildNameDictionary().
+static bool addSchedParameters(void) {
+   if (!reserveStoreParameters(1 + NUM_SCHED_CLASSES * NUM_SCHED_FIELDS) ||
+      !appendStoreParameter(SCHED_OBJECT "Workers", TYPE_UINT, "")) {
+      return false;
+   }
+   char name[MAX_NAME_LEN];
+   for (int c = 0; c < NUM_SCHED_CLASSES; c++) {
+      for (int f = 0; f < NUM_SCHED_FIELDS; f++) {
+         snprintf(name, sizeof(name), SCHED_OBJECT "%s.%s", g_schedClassNames[c], g_schedFields[f].name);
+         if (!appendStoreParameter(name, g_schedFields[f].type, "")) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+// Timer callback
+static void schedStatsTimer(void *arg) {
+   (void)arg;
+   if (timerArmed(&g_schedStatsTimer)) {
+      return;
+   }
+   for (int c = 0; c < NUM_SCHED_CLASSES; c++) {
+      SchedStats *stats = &g_schedStats[c];
+      SchedStats *last = &g_schedLastStats[c];
+      uint64_t maxLatencyNs = __atomic_exchange_n(&stats->maxLatencyNs, 0, __ATOMIC_RELAXED);
+      uint64_t latencyNs = __atomic_load_n(&stats->latencyNs, __ATOMIC_RELAXED);
+      uint64_t tasks = __atomic_load_n(&stats->tasks, __ATOMIC_RELAXED);
+      int64_t values[NUM_SCHED_FIELDS];
+      values[SCHED_TASKS] = (int64_t)tasks;
+      values[SCHED_LATENCY_AVG] = tasks > last->tasks ? (int64_t)((latencyNs - last->latencyNs) / (tasks - last->tasks) / 1000) : 0;
+      values[SCHED_LATENCY_MAX] = (int64_t)(maxLatencyNs / 1000);
+      last->tasks = tasks;
+      last->latencyNs = latencyNs;
+      for (int f = 0; f < NUM_SCHED_FIELDS; f++) {
+         if (values[f] != g_schedValues[c][f]) {
+            g_schedValues[c][f] = values[f];
+            storeBatchNumber(&g_schedStatsBatch, g_schedFieldIndexes[c][f], values[f]);
+         }
+      }
+   }
+   storeBatchFlush(&g_schedStatsBatch);
+   timerStart(&g_schedStatsTimer, SCHED_STATS_INTERVAL_MS, schedStatsTimer, NULL);
+}
+
+static void schedStop(void) {
+   timerCancel(&g_schedStatsTimer);
+   pthread_mutex_lock(&g_schedLock);
+   __atomic_store_n(&g_schedStopping, true, __ATOMIC_RELEASE);
+   pthread_cond_broadcast(&g_schedCond);
+   pthread_mutex_unlock(&g_schedLock);
+   for (int w = 0; w < g_schedNumThreads; w++) {
+      pthread_join(g_schedWorkers[w].thread, NULL);
+   }
+   // The queue locks and g_schedNumWorkers stay as they are: a thread that
+   // passed the check in schedSubmit() just before may still push a task,
+   // which is then never run
+   g_schedNumThreads = 0;
+}
+
+// Start the workers, at most one per online CPU. Interactive tasks may use
+// every worker; samplers leave one for them, and exports at most half.
+static bool schedStart(void) {
+   long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   int workers = cpus > 0 && cpus < g_schedWorkerCount ? (int)cpus : g_schedWorkerCount;
+   // On the simulated clock tasks run at once on the thread that submits them,
+   // so that runs are repeatable
+   if (clockSimulated()) {
+      workers = 0;
+   }
+   g_schedClassLimit[SCHED_INTERACTIVE] = workers;
+   g_schedClassLimit[SCHED_PERIODIC] = workers > 1 ? workers - 1 : 1;
+   g_schedClassLimit[SCHED_BACKGROUND] = workers > 1 ? workers / 2 : 1;
+   g_schedStopping = false;
+   for (int w = 0; w < workers; w++) {
+      memset(g_schedWorkers[w].head, 0, sizeof(g_schedWorkers[w].head));
+      memset(g_schedWorkers[w].tail, 0, sizeof(g_schedWorkers[w].tail));
+      pthread_mutex_init(&g_schedWorkers[w].lock, NULL);
+   }
+   g_schedNumWorkers = workers;
+   for (int w = 0; w < workers; w++) {
+      if (pthread_create(&g_schedWorkers[w].thread, NULL, schedWorker, (void *)(intptr_t)w) != 0) {
+         fprintf(stderr, "Failed to start scheduler workers\n");
+         schedStop();
+         return false;
+      }
+      g_schedNumThreads++;
+   }
+
+   char name[MAX_NAME_LEN];
+   for (int c = 0; c < NUM_SCHED_CLASSES; c++) {
+      for (int f = 0; f < NUM_SCHED_FIELDS; f++) {
+         snprintf(name, sizeof(name), SCHED_OBJECT "%s.%s", g_schedClassNames[c], g_schedFields[f].name);
+         g_schedFieldIndexes[c][f] = findDataModel(name);
+      }
+   }
+   storeBatchNumber(&g_schedStatsBatch, findDataModel(SCHED_OBJECT "Workers"), workers);
+   storeBatchFlush(&g_schedStatsBatch);
+   timerStart(&g_schedStatsTimer, SCHED_STATS_INTERVAL_MS, schedStatsTimer, NULL);
+   printf("Scheduler: %d workers\n", workers);
+   return true;
+}
+
+static const char *const g_flightOpNames[NUM_FLIGHT_OPS] = {"get", "live-get", "set", "publish"};
+
+static void flightWriteRecord(FILE *f, const FlightRecord *r, uint64_t wallOffsetUs) {
+   char start[40];
+   char buf[MAX_NAME_LEN];
+   diagTimeString(r->startNs / 1000 + wallOffsetUs, start, sizeof(start));
+   fprintf(f, "%" PRIu64 " %s %s %s %s rc=%d", r->seq - 1, start, g_flightOpNames[r->op],
+      r->model >= 0 ? dataModelName(r->model, buf) : "-", r->requester[0] ? r->requester : "-", r->result);
+   if (r->lockedNs) {
+      fprintf(f, " wait=%.1f", r->lockedNs / 1000.0);
+   }
+   if (r->storedNs) {
+      fprintf(f, " store=%.1f publish=%.1f", (r->storedNs - r->lockedNs) / 1000.0, (r->doneNs - r->storedNs) / 1000.0);
+   } else if (r->lockedNs) {
+      fprintf(f, " read=%.1f", (r->doneNs - r->lockedNs) / 1000.0);
+   }
+   fprintf(f, " total=%.1f%s\n", r->doneNs / 1000.0,
+      r->injected ? " injected" : g_flightSloNs && r->doneNs > g_flightSloNs ? " slow" : "");
+}
+
+// Write the flight recorder to g_flightPath, oldest record first, with times
+// in microseconds: the snapshot taken on an SLO breach if there is one, or
+// else the ring as it is now
+static void flightDump(void *arg) {
+   (void)arg;
+   FlightRecord *records;
+   int count;
+   uint64_t breach = 0;
+   if (__atomic_load_n(&g_flightSnapshotState, __ATOMIC_ACQUIRE) == FLIGHT_SNAPSHOT_READY) {
+      records = g_flightSnapshot;
+      count = g_flightSnapshotCount;
+      breach = g_flightBreachSeq;
+   } else {
+      records = malloc(sizeof(g_flightRing));
+      if (!records) {
+         return;
+      }
+      count = flightCopy(records);
+   }
+   uint64_t wallOffsetUs = wallclockUs() - monotonicNs() / 1000;
+
+   char tmp[MAX_NAME_LEN + 4];
+   snprintf(tmp, sizeof(tmp), "%s.tmp", g_flightPath);
+   FILE *f = fopen(tmp, "w");
+   bool ok = f != NULL;
+   if (ok && breach) {
+      fprintf(f, "# %d records, dumped after record %" PRIu64 " took longer than %" PRIu64 " ms\n", count, breach - 1,
+         g_flightSloNs / 1000000);
+   } else if (ok) {
+      fprintf(f, "# %d records, dumped on request\n", count);
+   }
+   if (ok) {
+      fprintf(f, "# seq start op property requester result phases(us)\n");
+      for (int n = 0; n < count; n++) {
+         flightWriteRecord(f, &records[n], wallOffsetUs);
+      }
+      ok = !ferror(f);
+      ok = fclose(f) == 0 && ok;
+   }
+   if (breach) {
+      __atomic_store_n(&g_flightSnapshotState, FLIGHT_SNAPSHOT_FREE, __ATOMIC_RELEASE);
+   } else {
+      free(records);
+   }
+   if (!ok || rename(tmp, g_flightPath) != 0) {
+      fprintf(stderr, "Flight recorder: %s: %s\n", g_flightPath, strerror(errno));
+      unlink(tmp);
+      return;
+   }
+   printf("Flight recorder: %d records written to %s\n", count, g_flightPath);
+}
+
+#if defined(HAVE_ETHTOOL_NETLINK) || defined(HAVE_NL80211)
+// Minimal netlink message building and attribute parsing, enough for generic
+// netlink dumps and notifications without a libnl dependency
+static struct nlmsghdr *nlMsgInit(void *buf, uint16_t type, uint16_t flags, uint8_t cmd, uint32_t seq) {
+   struct nlmsghdr *nlh = buf;
+   memset(buf, 0, NLMSG_HDRLEN + GENL_HDRLEN);
+   nlh->nlmsg_len = NLMSG_HDRLEN + GENL_HDRLEN;
+   nlh->nlmsg_type = type;
+   nlh->nlmsg_flags = NLM_F_REQUEST | flags;
+   nlh->nlmsg_seq = seq;
+   struct genlmsghdr *genl = NLMSG_DATA(nlh);
+   genl->cmd = cmd;
+   genl->version = 1;
+   return nlh;
+}
+
+static struct nlattr *nlPutAttr(struct nlmsghdr *nlh, uint16_t type, const void *data, size_t len) {
+   struct nlattr *attr = (struct nlattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+   attr->nla_type = type;
+   attr->nla_len = (uint16_t)(NLA_HDRLEN + len);
+   if (len) {
+      memcpy((char *)attr + NLA_HDRLEN, data, len);
+   }
+   nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + NLA_ALIGN(attr->nla_len);
+   return attr;
+}
+
+static void nlNestEnd(struct nlmsghdr *nlh, struct nlattr *nest) {
+   nest->nla_type |= NLA_F_NESTED;
+   nest->nla_len = (uint16_t)((char *)nlh + nlh->nlmsg_len - (char *)nest);
+}
+
+static const void *nlAttrData(const struct nlattr *attr) {
+   return (const char *)attr + NLA_HDRLEN;
+}
+
+static size_t nlAttrLen(const struct nlattr *attr) {
+   return attr->nla_len - NLA_HDRLEN;
+}
+
+// Index the attributes in data by type; types above max are ignored
+static void nlParse(const void *data, size_t len, const struct nlattr **table, int max) {
+   memset(table, 0, (max + 1) * sizeof(*table));
+   const char *p = data;
+   while (len >= NLA_HDRLEN) {
+      const struct nlattr *attr = (const struct nlattr *)p;
+      if (attr->nla_len < NLA_HDRLEN || attr->nla_len > len) {
+         return;
+      }
+      int type = attr->nla_type & NLA_TYPE_MASK;
+      if (type <= max) {
+         table[type] = attr;
+      }
+      size_t step = NLA_ALIGN(attr->nla_len);
+      if (step >= len) {
+         return;
+      }
+      p += step;
+      len -= step;
+   }
+}
+
+static void nlParseNested(const struct nlattr *nest, const struct nlattr **table, int max) {
+   nlParse(nlAttrData(nest), nlAttrLen(nest), table, max);
+}
+
+static uint32_t nlAttrU32(const struct nlattr *attr, uint32_t fallback) {
+   uint32_t value;
+   if (!attr || nlAttrLen(attr) < sizeof(value)) {
+      return fallback;
+   }
+   memcpy(&value, nlAttrData(attr), sizeof(value));
+   return value;
+}
+
+static uint8_t nlAttrU8(const struct nlattr *attr, uint8_t fallback) {
+   return attr && nlAttrLen(attr) >= 1 ? *(const uint8_t *)nlAttrData(attr) : fallback;
+}
+
+static int nlOpen(int protocol, uint32_t groups) {
+   int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+   if (fd < 0) {
+      return -1;
+   }
+   struct sockaddr_nl addr;
+   memset(&addr, 0, sizeof(addr));
+   addr.nl_family = AF_NETLINK;
+   addr.nl_groups = groups;
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+static bool nlSend(int fd, struct nlmsghdr *nlh) {
+   struct sockaddr_nl kernel;
+   memset(&kernel, 0, sizeof(kernel));
+   kernel.nl_family = AF_NETLINK;
+   return sendto(fd, nlh, nlh->nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) == (ssize_t)nlh->nlmsg_len;
+}
+
+// Look up a generic netlink family and, if group is set, the id of one of its
+// multicast groups. Runs once at startup on a blocking socket.
+static bool nlResolveFamily(int fd, const char *family, uint16_t *familyId, const char *group, uint32_t *groupId) {
+   uint8_t buf[NL_BUFFER_SIZE];
+   struct nlmsghdr *nlh = nlMsgInit(buf, GENL_ID_CTRL, 0, CTRL_CMD_GETFAMILY, 1);
+   nlPutAttr(nlh, CTRL_ATTR_FAMILY_NAME, family, strlen(family) + 1);
+   if (!nlSend(fd, nlh)) {
+      return false;
+   }
+   ssize_t n = recv(fd, buf, sizeof(buf), 0);
+   nlh = (struct nlmsghdr *)buf;
+   if (n < (ssize_t)NLMSG_HDRLEN || !NLMSG_OK(nlh, (size_t)n) || nlh->nlmsg_type != GENL_ID_CTRL) {
+      return false;
+   }
+
+   const struct nlattr *attrs[CTRL_ATTR_MAX + 1];
+   nlParse((char *)NLMSG_DATA(nlh) + GENL_HDRLEN, nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, attrs, CTRL_ATTR_MAX);
+   if (!attrs[CTRL_ATTR_FAMILY_ID]) {
+      return false;
+   }
+   memcpy(familyId, nlAttrData(attrs[CTRL_ATTR_FAMILY_ID]), sizeof(*familyId));
+   if (!group) {
+      return true;
+   }
+   if (!attrs[CTRL_ATTR_MCAST_GROUPS]) {
+      return false;
+   }
+   const char *p = nlAttrData(attrs[CTRL_ATTR_MCAST_GROUPS]);
+   size_t len = nlAttrLen(attrs[CTRL_ATTR_MCAST_GROUPS]);
+   while (len >= NLA_HDRLEN) {
+      const struct nlattr *entry = (const struct nlattr *)p;
+      if (entry->nla_len < NLA_HDRLEN || entry->nla_len > len) {
+         break;
+      }
+      const struct nlattr *groupAttrs[CTRL_ATTR_MCAST_GRP_MAX + 1];
+      nlParseNested(entry, groupAttrs, CTRL_ATTR_MCAST_GRP_MAX);
+      if (groupAttrs[CTRL_ATTR_MCAST_GRP_NAME] && groupAttrs[CTRL_ATTR_MCAST_GRP_ID] &&
+         strcmp(nlAttrData(groupAttrs[CTRL_ATTR_MCAST_GRP_NAME]), group) == 0) {
+         *groupId = nlAttrU32(groupAttrs[CTRL_ATTR_MCAST_GRP_ID], 0);
+         return true;
+      }
+      size_t step = NLA_ALIGN(entry->nla_len);
+      if (step >= len) {
+         break;
+      }
+      p += step;
+      len -= step;
+   }
+   return false;
+}
+
+#endif
+
+#ifdef HAVE_ETHTOOL_NETLINK
+// Ethernet link settings: MaxBitRate, CurrentBitRate and DuplexMode of each
+// Device.Ethernet.Interface.{i}. whose Name is a host interface are written to
+// the store from one ethtool netlink dump of every interface's link modes.
+// Dumps run at startup and after link-change notifications, never from gets.
+typedef struct {
+   int name;                 // Store indexes of the row's parameters
+   int maxBitRate;
+   int currentBitRate;
+   int duplexMode;
+} EthRow;
+
+typedef struct {
+   char name[IFNAMSIZ];
+   int32_t maxBitRate;       // Mbit/s
+   uint32_t currentBitRate;  // Mbit/s, 0 while the link is down
+   const char *duplexMode;
+} EthLink;
+
+static EthRow g_ethRows[ETH_MAX_ROWS];
+static int g_numEthRows = 0;
+static EthLink g_ethLinks[ETH_MAX_LINKS];  // Links of the dump in progress
+static int g_numEthLinks = 0;
+static int g_ethDumpFd = -1;
+static int g_ethMonitorFd = -1;              // ethtool monitor group
+static int g_ethLinkFd = -1;                 // rtnetlink link group
+static uint16_t g_ethFamily = 0;
+static uint32_t g_ethSeq = 0;
+static bool g_ethDumping = false;
+static bool g_ethDumpAgain = false;          // A change arrived during the dump
+static Timer g_ethTimer;
+static StoreBatch g_ethBatch;
+
+static void ethDump(void) {
+   if (g_ethDumping) {
+      g_ethDumpAgain = true;
+      return;
+   }
+   uint8_t buf[256];
+   struct nlmsghdr *nlh = nlMsgInit(buf, g_ethFamily, NLM_F_DUMP, ETHTOOL_MSG_LINKMODES_GET, ++g_ethSeq);
+   // An empty header selects every device; without ETHTOOL_FLAG_COMPACT_BITSETS
+   // the supported link modes come back with their names
+   struct nlattr *header = nlPutAttr(nlh, ETHTOOL_A_LINKMODES_HEADER | NLA_F_NESTED, NULL, 0);
+   nlNestEnd(nlh, header);
+   if (!nlSend(g_ethDumpFd, nlh)) {
+      fprintf(stderr, "ethtool link mode dump failed: %s\n", strerror(errno));
+      return;
+   }
+   g_ethDumping = true;
+   g_numEthLinks = 0;
+}
+
+// Timer callback: coalesces a burst of link notifications into one dump
+static void ethTimer(void *arg) {
+   (void)arg;
+   if (!timerArmed(&g_ethTimer)) {
+      ethDump();
+   }
+}
+
+static void ethParseLinkModes(const struct nlmsghdr *nlh) {
+   const struct nlattr *attrs[ETHTOOL_A_LINKMODES_MAX + 1];
+   nlParse((const char *)NLMSG_DATA(nlh) + GENL_HDRLEN, nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN,
+      attrs, ETHTOOL_A_LINKMODES_MAX);
+   if (!attrs[ETHTOOL_A_LINKMODES_HEADER] || g_numEthLinks == ETH_MAX_LINKS) {
+      return;
+   }
+   const struct nlattr *header[ETHTOOL_A_HEADER_MAX + 1];
+   nlParseNested(attrs[ETHTOOL_A_LINKMODES_HEADER], header, ETHTOOL_A_HEADER_MAX);
+   if (!header[ETHTOOL_A_HEADER_DEV_NAME]) {
+      return;
+   }
+
+   EthLink *link = &g_ethLinks[g_numEthLinks++];
+   snprintf(link->name, sizeof(link->name), "%s", (const char *)nlAttrData(header[ETHTOOL_A_HEADER_DEV_NAME]));
+   uint32_t speed = nlAttrU32(attrs[ETHTOOL_A_LINKMODES_SPEED], SPEED_UNKNOWN);
+   link->currentBitRate = speed == (uint32_t)SPEED_UNKNOWN ? 0 : speed;
+   uint8_t duplex = nlAttrU8(attrs[ETHTOOL_A_LINKMODES_DUPLEX], DUPLEX_UNKNOWN);
+   link->duplexMode = duplex == DUPLEX_FULL ? "Full" : duplex == DUPLEX_HALF ? "Half" : "Auto";
+
+   // The fastest supported link mode: mode names start with their speed, as
+   // in "2500baseT/Full", and the other bits ("Autoneg", "Pause") with a
+   // letter, so only names that start with a digit count
+   link->maxBitRate = -1;
+   if (!attrs[ETHTOOL_A_LINKMODES_OURS]) {
+      return;
+   }
+   const struct nlattr *bitset[ETHTOOL_A_BITSET_MAX + 1];
+   nlParseNested(attrs[ETHTOOL_A_LINKMODES_OURS], bitset, ETHTOOL_A_BITSET_MAX);
+   if (!bitset[ETHTOOL_A_BITSET_BITS]) {
+      return;
+   }
+   const char *p = nlAttrData(bitset[ETHTOOL_A_BITSET_BITS]);
+   size_t len = nlAttrLen(bitset[ETHTOOL_A_BITSET_BITS]);
+   while (len >= NLA_HDRLEN) {
+      const struct nlattr *bit = (const struct nlattr *)p;
+      if (bit->nla_len < NLA_HDRLEN || bit->nla_len > len) {
+         break;
+      }
+      const struct nlattr *bitAttrs[ETHTOOL_A_BITSET_BIT_MAX + 1];
+      nlParseNested(bit, bitAttrs, ETHTOOL_A_BITSET_BIT_MAX);
+      const char *name = bitAttrs[ETHTOOL_A_BITSET_BIT_NAME] ? nlAttrData(bitAttrs[ETHTOOL_A_BITSET_BIT_NAME]) : "";
+      if (name[0] >= '0' && name[0] <= '9') {
+         long rate = strtol(name, NULL, 10);
+         if (rate > link->maxBitRate && rate <= INT32_MAX) {
+            link->maxBitRate = (int32_t)rate;
+         }
+      }
+      size_t step = NLA_ALIGN(bit->nla_len);
+      if (step >= len) {
+         break;
+      }
+      p += step;
+      len -= step;
+   }
+}
+
+// Write the links of a finished dump into the rows whose Name matches
+static void ethApplyDump(void) {
+   for (int r = 0; r < g_numEthRows; r++) {
+      const EthRow *row = &g_ethRows[r];
+      char ifName[IFNAMSIZ] = "";
+      pthread_rwlock_rdlock(&g_storeLock);
+      if (g_dataModels[row->name].value.strVal) {
+         snprintf(ifName, sizeof(ifName), "%s", g_dataModels[row->name].value.strVal);
+      }
+      pthread_rwlock_unlock(&g_storeLock);
+
+      const EthLink *link = NULL;
+      for (int l = 0; l < g_numEthLinks && !link; l++) {
+         link = strcmp(g_ethLinks[l].name, ifName) == 0 ? &g_ethLinks[l] : NULL;
+      }
+      if (link) {
+         storeBatchNumber(&g_ethBatch, row->maxBitRate, link->maxBitRate);
+         storeBatchNumber(&g_ethBatch, row->currentBitRate, link->currentBitRate);
+         if (row->duplexMode >= 0) {
+            storeBatchString(&g_ethBatch, row->duplexMode, link->duplexMode);
+         }
+      }
+   }
+   storeBatchFlush(&g_ethBatch);
+}
+
+// Reactor callback for the dump socket
+static void ethDumpReceive(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   uint8_t buf[NL_BUFFER_SIZE];
+   for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+         return;
+      }
+      for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)n); nlh = NLMSG_NEXT(nlh, n)) {
+         if (nlh->nlmsg_seq != g_ethSeq) {
+            continue;
+         }
+         if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR) {
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+               const struct nlmsgerr *err = NLMSG_DATA(nlh);
+               fprintf(stderr, "ethtool link mode dump failed: %s\n", strerror(-err->error));
+            } else {
+               ethApplyDump();
+            }
+            g_ethDumping = false;
+            if (g_ethDumpAgain) {
+               g_ethDumpAgain = false;
+               ethDump();
+            }
+         } else if (nlh->nlmsg_type == g_ethFamily) {
+            ethParseLinkModes(nlh);
+         }
+      }
+   }
+}
+
+// Reactor callback for the notification sockets: any link change or ethtool
+// notification schedules a dump
+static void ethNotify(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   uint8_t buf[NL_BUFFER_SIZE];
+   bool changed = false;
+   while (recv(fd, buf, sizeof(buf), 0) > 0) {
+      changed = true;
+   }
+   if (changed && !timerArmed(&g_ethTimer)) {
+      timerStart(&g_ethTimer, ETH_DUMP_DELAY_MS, ethTimer, NULL);
+   }
+}
+
+static void ethStop(void) {
+   timerCancel(&g_ethTimer);
+   int *fds[] = {&g_ethDumpFd, &g_ethMonitorFd, &g_ethLinkFd};
+   for (int f = 0; f < 3; f++) {
+      if (*fds[f] >= 0) {
+         reactorRemove(*fds[f]);
+         close(*fds[f]);
+         *fds[f] = -1;
+      }
+   }
+   g_numEthRows = 0;
+   g_ethDumping = false;
+}
+// Find the Ethernet interface rows, open the netlink sockets and start the
+// first dump. Without ethtool netlink support the stored values stay as loaded.
+static void ethStart(void) {
+   const char *prefix = "Device.Ethernet.Interface.";
+   char buf[MAX_NAME_LEN];
+   for (int i = lowerBoundName(prefix); i < g_totalDataModels && g_numEthRows < ETH_MAX_ROWS; i++) {
+      const char *name = dataModelName(i, buf);
+      if (strncmp(name, prefix, strlen(prefix)) != 0) {
+         break;
+      }
+      const char *field = name + strlen(prefix) + strspn(name + strlen(prefix), "0123456789");
+      if (strcmp(field, ".Name") != 0 || !isStringType(g_dataModels[i].type)) {
+         continue;
+      }
+      EthRow *row = &g_ethRows[g_numEthRows++];
+      int rowLen = (int)(field - name) + 1;
+      char sibling[MAX_NAME_LEN];
+      row->name = i;
+      snprintf(sibling, sizeof(sibling), "%.*sMaxBitRate", rowLen, name);
+      row->maxBitRate = findDataModel(sibling);
+      snprintf(sibling, sizeof(sibling), "%.*sCurrentBitRate", rowLen, name);
+      row->currentBitRate = findDataModel(sibling);
+      snprintf(sibling, sizeof(sibling), "%.*sDuplexMode", rowLen, name);
+      row->duplexMode = findDataModel(sibling);
+      if (row->duplexMode >= 0 && !isStringType(g_dataModels[row->duplexMode].type)) {
+         row->duplexMode = -1;
+      }
+   }
+   if (g_numEthRows == 0) {
+      return;
+   }
+
+   uint32_t monitorGroup = 0;
+   g_ethDumpFd = nlOpen(NETLINK_GENERIC, 0);
+   g_ethMonitorFd = nlOpen(NETLINK_GENERIC, 0);
+   g_ethLinkFd = nlOpen(NETLINK_ROUTE, RTMGRP_LINK);
+   if (g_ethDumpFd < 0 || g_ethMonitorFd < 0 || g_ethLinkFd < 0 ||
+      !nlResolveFamily(g_ethDumpFd, ETHTOOL_GENL_NAME, &g_ethFamily, ETHTOOL_MCGRP_MONITOR_NAME, &monitorGroup) ||
+      setsockopt(g_ethMonitorFd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &monitorGroup, sizeof(monitorGroup)) != 0 ||
+      !setNonBlocking(g_ethDumpFd) || !setNonBlocking(g_ethMonitorFd) || !setNonBlocking(g_ethLinkFd) ||
+      !reactorAdd(g_ethDumpFd, POLLIN, ethDumpReceive, NULL) ||
+      !reactorAdd(g_ethMonitorFd, POLLIN, ethNotify, NULL) ||
+      !reactorAdd(g_ethLinkFd, POLLIN, ethNotify, NULL)) {
+      fprintf(stderr, "ethtool netlink is unavailable; Ethernet link settings are not refreshed\n");
+      ethStop();
+      return;
+   }
+   printf("Refreshing link settings of %d Ethernet interfaces from ethtool netlink\n", g_numEthRows);
+   ethDump();
+}
+
+#endif
+
+// Wi-Fi: access point interfaces and their associated stations from nl80211.
+// Rows are preallocated at startup: interface slot i owns Device.WiFi.SSID.{i}.
+// and Device.WiFi.AccessPoint.{i}., and a station keeps its AssociatedDevice.{k}.
+// row from association until it leaves. Sweeps dump every interface and then
+// the stations of each one; association events update rows in between.
+static bool g_wifiEnabled = false;
+static uint32_t g_wifiIntervalSec = WIFI_DEFAULT_INTERVAL;
+
+#ifdef HAVE_NL80211
+enum { WIFI_SSID_NAME, WIFI_SSID_MAC, WIFI_SSID_SSID, WIFI_SSID_STATUS, NUM_WIFI_SSID_FIELDS };
+static const StoreField g_wifiSsidFields[NUM_WIFI_SSID_FIELDS] = {
+   {"Name", TYPE_STRING},
+   {"MACAddress", TYPE_STRING},
+   {"SSID", TYPE_STRING},
+   {"Status", TYPE_STRING},
+};
+
+enum { WIFI_AP_SSID_REFERENCE, WIFI_AP_NUM_STATIONS, NUM_WIFI_AP_FIELDS };
+static const StoreField g_wifiApFields[NUM_WIFI_AP_FIELDS] = {
+   {"SSIDReference", TYPE_STRING},
+   {"AssociatedDeviceNumberOfEntries", TYPE_UINT},
+};
+
+enum {
+   WIFI_STA_MAC, WIFI_STA_ACTIVE, WIFI_STA_SIGNAL, WIFI_STA_DOWNLINK_RATE, WIFI_STA_UPLINK_RATE,
+   WIFI_STA_BYTES_SENT, WIFI_STA_BYTES_RECEIVED, WIFI_STA_PACKETS_SENT, WIFI_STA_PACKETS_RECEIVED,
+   NUM_WIFI_STA_FIELDS
+};
+static const StoreField g_wifiStationFields[NUM_WIFI_STA_FIELDS] = {
+   {"MACAddress", TYPE_STRING},
+   {"Active", TYPE_BOOL},
+   {"SignalStrength", TYPE_INT},
+   {"LastDataDownlinkRate", TYPE_UINT},
+   {"LastDataUplinkRate", TYPE_UINT},
+   {"Stats.BytesSent", TYPE_ULONG},
+   {"Stats.BytesReceived", TYPE_ULONG},
+   {"Stats.PacketsSent", TYPE_ULONG},
+   {"Stats.PacketsReceived", TYPE_ULONG},
+};
+
+typedef struct {
+   bool active;
+   bool seen;                // Reported by the station dump in progress
+   uint8_t mac[6];
+   int32_t signal;           // dBm
+   uint32_t downlinkRate;    // kbit/s, access point to station
+   uint32_t uplinkRate;
+   uint64_t bytesSent;
+   uint64_t bytesReceived;
+   uint64_t packetsSent;
+   uint64_t packetsReceived;
+} WifiStation;
+
+typedef struct {
+   bool present;
+   bool seen;                // Reported by the interface dump in progress
+   uint32_t ifindex;
+   char name[IFNAMSIZ];
+   uint8_t mac[6];
+   char ssid[33];
+   uint32_t numStations;
+   WifiStation stations[WIFI_MAX_STATIONS];
+   int ssidFields[NUM_WIFI_SSID_FIELDS];     // Store indexes of the slot's rows
+   int apFields[NUM_WIFI_AP_FIELDS];
+   int stationFields[WIFI_MAX_STATIONS][NUM_WIFI_STA_FIELDS];
+} WifiInterface;
+
+static WifiInterface g_wifiInterfaces[WIFI_MAX_INTERFACES];
+static int g_wifiFd = -1;                    // Dumps
+static int g_wifiEventFd = -1;               // config and mlme groups
+static uint16_t g_wifiFamily = 0;
+static uint32_t g_wifiSeq = 0;
+static int g_wifiSweep = -1;                 // -1 idle, 0 interfaces, s + 1 stations of slot s
+static bool g_wifiSweepAgain = false;
+static StoreBatch g_wifiBatch;
+static Timer g_wifiTimer;
+
+static void wifiRowName(char *buf, size_t len, const char *object, int slot, int station, const char *field) {
+   if (station < 0) {
+      snprintf(buf, len, "Device.WiFi.%s.%d.%s", object, slot + 1, field);
+   } else {
+      snprintf(buf, len, "Device.WiFi.%s.%d.AssociatedDevice.%d.%s", object, slot + 1, station + 1, field);
+   }
+}
+
+// Add the Wi-Fi rows to the store, unless the JSON file defines them. Must run
+// before buildNameDictionary().
+static bool addWifiParameters(void) {
+   int perSlot = NUM_WIFI_SSID_FIELDS + NUM_WIFI_AP_FIELDS + WIFI_MAX_STATIONS * NUM_WIFI_STA_FIELDS;
+   if (!reserveStoreParameters(WIFI_MAX_INTERFACES * perSlot)) {
+      return false;
+   }
+   char name[MAX_NAME_LEN];
+   char initial[MAX_NAME_LEN];
+   for (int s = 0; s < WIFI_MAX_INTERFACES; s++) {
+      for (int f = 0; f < NUM_WIFI_SSID_FIELDS; f++) {
+         wifiRowName(name, sizeof(name), "SSID", s, -1, g_wifiSsidFields[f].name);
+         if (!appendStoreParameter(name, g_wifiSsidFields[f].type, f == WIFI_SSID_STATUS ? "NotPresent" : "")) {
+            return false;
+         }
+      }
+      for (int f = 0; f < NUM_WIFI_AP_FIELDS; f++) {
+         wifiRowName(name, sizeof(name), "AccessPoint", s, -1, g_wifiApFields[f].name);
+         snprintf(initial, sizeof(initial), "Device.WiFi.SSID.%d.", s + 1);
+         if (!appendStoreParameter(name, g_wifiApFields[f].type, initial)) {
+            return false;
+         }
+      }
+      for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+         for (int f = 0; f < NUM_WIFI_STA_FIELDS; f++) {
+            wifiRowName(name, sizeof(name), "AccessPoint", s, k, g_wifiStationFields[f].name);
+            if (!appendStoreParameter(name, g_wifiStationFields[f].type, "")) {
+               return false;
+            }
+         }
+      }
+   }
+   return true;
+}
+
+static void wifiQueueMac(int index, const uint8_t *mac) {
+   static const uint8_t zero[6];
+   char str[18] = "";
+   if (memcmp(mac, zero, 6) != 0) {
+      snprintf(str, sizeof(str), "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+   }
+   storeBatchString(&g_wifiBatch, index, str);
+}
+
+// Queue the fields of a station row that differ from next and remember next
+static void wifiUpdateStation(WifiInterface *wi, int k, const WifiStation *next) {
+   WifiStation *cur = &wi->stations[k];
+   const int *fields = wi->stationFields[k];
+   if (memcmp(cur->mac, next->mac, 6) != 0) {
+      wifiQueueMac(fields[WIFI_STA_MAC], next->mac);
+   }
+   if (cur->active != next->active) {
+      storeBatchBool(&g_wifiBatch, fields[WIFI_STA_ACTIVE], next->active);
+   }
+   if (cur->signal != next->signal) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_SIGNAL], next->signal);
+   }
+   if (cur->downlinkRate != next->downlinkRate) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_DOWNLINK_RATE], next->downlinkRate);
+   }
+   if (cur->uplinkRate != next->uplinkRate) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_UPLINK_RATE], next->uplinkRate);
+   }
+   if (cur->bytesSent != next->bytesSent) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_BYTES_SENT], (int64_t)next->bytesSent);
+   }
+   if (cur->bytesReceived != next->bytesReceived) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_BYTES_RECEIVED], (int64_t)next->bytesReceived);
+   }
+   if (cur->packetsSent != next->packetsSent) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_PACKETS_SENT], (int64_t)next->packetsSent);
+   }
+   if (cur->packetsReceived != next->packetsReceived) {
+      storeBatchNumber(&g_wifiBatch, fields[WIFI_STA_PACKETS_RECEIVED], (int64_t)next->packetsReceived);
+   }
+   bool seen = cur->seen;
+   *cur = *next;
+   cur->seen = seen;
+}
+
+static void wifiUpdateStationCount(WifiInterface *wi) {
+   uint32_t count = 0;
+   for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+      count += wi->stations[k].active;
+   }
+   if (count != wi->numStations) {
+      wi->numStations = count;
+      storeBatchNumber(&g_wifiBatch, wi->apFields[WIFI_AP_NUM_STATIONS], count);
+   }
+}
+
+static void wifiRemoveStation(WifiInterface *wi, int k) {
+   WifiStation empty;
+   memset(&empty, 0, sizeof(empty));
+   wifiUpdateStation(wi, k, &empty);
+}
+
+static WifiInterface *wifiFindInterface(uint32_t ifindex) {
+   for (int s = 0; s < WIFI_MAX_INTERFACES; s++) {
+      if (g_wifiInterfaces[s].present && g_wifiInterfaces[s].ifindex == ifindex) {
+         return &g_wifiInterfaces[s];
+      }
+   }
+   return NULL;
+}
+
+static void wifiRemoveInterface(WifiInterface *wi) {
+   for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+      wifiRemoveStation(wi, k);
+   }
+   wifiUpdateStationCount(wi);
+   wi->present = false;
+   memset(wi->mac, 0, sizeof(wi->mac));
+   wi->name[0] = wi->ssid[0] = '\0';
+   storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_NAME], "");
+   wifiQueueMac(wi->ssidFields[WIFI_SSID_MAC], wi->mac);
+   storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_SSID], "");
+   storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_STATUS], "NotPresent");
+}
+
+static void wifiParse(const struct nlmsghdr *nlh, const struct nlattr **attrs) {
+   nlParse((const char *)NLMSG_DATA(nlh) + GENL_HDRLEN, nlh->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, attrs, NL80211_ATTR_MAX);
+}
+
+// NL80211_CMD_NEW_INTERFACE, from a dump or an event: take a slot for an
+// access point interface and refresh its SSID row
+static void wifiInterfaceMessage(const struct nlmsghdr *nlh) {
+   const struct nlattr *attrs[NL80211_ATTR_MAX + 1];
+   wifiParse(nlh, attrs);
+   uint32_t iftype = nlAttrU32(attrs[NL80211_ATTR_IFTYPE], NL80211_IFTYPE_UNSPECIFIED);
+   if (!attrs[NL80211_ATTR_IFINDEX] || !attrs[NL80211_ATTR_IFNAME] ||
+      (iftype != NL80211_IFTYPE_AP && iftype != NL80211_IFTYPE_P2P_GO && iftype != NL80211_IFTYPE_MESH_POINT)) {
+      return;
+   }
+   uint32_t ifindex = nlAttrU32(attrs[NL80211_ATTR_IFINDEX], 0);
+   WifiInterface *wi = wifiFindInterface(ifindex);
+   for (int s = 0; s < WIFI_MAX_INTERFACES && !wi; s++) {
+      if (!g_wifiInterfaces[s].present) {
+         wi = &g_wifiInterfaces[s];
+         wi->present = true;
+         wi->ifindex = ifindex;
+         storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_STATUS], "Up");
+      }
+   }
+   if (!wi) {
+      return;
+   }
+   wi->seen = true;
+
+   char name[IFNAMSIZ];
+   snprintf(name, sizeof(name), "%s", (const char *)nlAttrData(attrs[NL80211_ATTR_IFNAME]));
+   if (strcmp(name, wi->name) != 0) {
+      snprintf(wi->name, sizeof(wi->name), "%s", name);
+      storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_NAME], name);
+   }
+   if (attrs[NL80211_ATTR_MAC] && nlAttrLen(attrs[NL80211_ATTR_MAC]) >= 6 &&
+      memcmp(wi->mac, nlAttrData(attrs[NL80211_ATTR_MAC]), 6) != 0) {
+      memcpy(wi->mac, nlAttrData(attrs[NL80211_ATTR_MAC]), 6);
+      wifiQueueMac(wi->ssidFields[WIFI_SSID_MAC], wi->mac);
+   }
+   char ssid[33] = "";
+   if (attrs[NL80211_ATTR_SSID]) {
+      size_t len = nlAttrLen(attrs[NL80211_ATTR_SSID]);
+      memcpy(ssid, nlAttrData(attrs[NL80211_ATTR_SSID]), len < 32 ? len : 32);
+   }
+   if (strcmp(ssid, wi->ssid) != 0) {
+      snprintf(wi->ssid, sizeof(wi->ssid), "%s", ssid);
+      storeBatchString(&g_wifiBatch, wi->ssidFields[WIFI_SSID_SSID], ssid);
+   }
+}
+
+static uint32_t wifiBitrate(const struct nlattr *rate) {
+   if (!rate) {
+      return 0;
+   }
+   const struct nlattr *attrs[NL80211_RATE_INFO_MAX + 1];
+   nlParseNested(rate, attrs, NL80211_RATE_INFO_MAX);
+   uint32_t rate100k = nlAttrU32(attrs[NL80211_RATE_INFO_BITRATE32], 0);
+   if (!rate100k && attrs[NL80211_RATE_INFO_BITRATE] && nlAttrLen(attrs[NL80211_RATE_INFO_BITRATE]) >= 2) {
+      uint16_t rate16;
+      memcpy(&rate16, nlAttrData(attrs[NL80211_RATE_INFO_BITRATE]), sizeof(rate16));
+      rate100k = rate16;
+   }
+   return rate100k * 100;
+}
+
+static uint64_t wifiCounter(const struct nlattr *const *info, int attr64, int attr32) {
+   if (info[attr64] && nlAttrLen(info[attr64]) >= 8) {
+      uint64_t value;
+      memcpy(&value, nlAttrData(info[attr64]), sizeof(value));
+      return value;
+   }
+   return nlAttrU32(info[attr32], 0);
+}
+
+// NL80211_CMD_NEW_STATION, from a dump or an association event: find or take
+// the station's row and refresh it
+static void wifiStationMessage(const struct nlmsghdr *nlh) {
+   const struct nlattr *attrs[NL80211_ATTR_MAX + 1];
+   wifiParse(nlh, attrs);
+   WifiInterface *wi = wifiFindInterface(nlAttrU32(attrs[NL80211_ATTR_IFINDEX], 0));
+   if (!wi || !attrs[NL80211_ATTR_MAC] || nlAttrLen(attrs[NL80211_ATTR_MAC]) < 6) {
+      return;
+   }
+   const uint8_t *mac = nlAttrData(attrs[NL80211_ATTR_MAC]);
+   int k = -1;
+   for (int s = 0; s < WIFI_MAX_STATIONS && k < 0; s++) {
+      k = wi->stations[s].active && memcmp(wi->stations[s].mac, mac, 6) == 0 ? s : -1;
+   }
+   for (int s = 0; s < WIFI_MAX_STATIONS && k < 0; s++) {
+      k = wi->stations[s].active ? -1 : s;
+   }
+   if (k < 0) {
+      return;
+   }
+
+   WifiStation next;
+   memset(&next, 0, sizeof(next));
+   next.active = true;
+   memcpy(next.mac, mac, 6);
+   if (attrs[NL80211_ATTR_STA_INFO]) {
+      const struct nlattr *info[NL80211_STA_INFO_MAX + 1];
+      nlParseNested(attrs[NL80211_ATTR_STA_INFO], info, NL80211_STA_INFO_MAX);
+      next.signal = (int8_t)nlAttrU8(info[NL80211_STA_INFO_SIGNAL], 0);
+      next.downlinkRate = wifiBitrate(info[NL80211_STA_INFO_TX_BITRATE]);
+      next.uplinkRate = wifiBitrate(info[NL80211_STA_INFO_RX_BITRATE]);
+      next.bytesSent = wifiCounter(info, NL80211_STA_INFO_TX_BYTES64, NL80211_STA_INFO_TX_BYTES);
+      next.bytesReceived = wifiCounter(info, NL80211_STA_INFO_RX_BYTES64, NL80211_STA_INFO_RX_BYTES);
+      next.packetsSent = nlAttrU32(info[NL80211_STA_INFO_TX_PACKETS], 0);
+      next.packetsReceived = nlAttrU32(info[NL80211_STA_INFO_RX_PACKETS], 0);
+   }
+   wifiUpdateStation(wi, k, &next);
+   wi->stations[k].seen = true;
+   wifiUpdateStationCount(wi);
+}
+
+// NL80211_CMD_DEL_STATION event: free the station's row
+static void wifiStationLeft(const struct nlmsghdr *nlh) {
+   const struct nlattr *attrs[NL80211_ATTR_MAX + 1];
+   wifiParse(nlh, attrs);
+   WifiInterface *wi = wifiFindInterface(nlAttrU32(attrs[NL80211_ATTR_IFINDEX], 0));
+   if (!wi || !attrs[NL80211_ATTR_MAC] || nlAttrLen(attrs[NL80211_ATTR_MAC]) < 6) {
+      return;
+   }
+   for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+      if (wi->stations[k].active && memcmp(wi->stations[k].mac, nlAttrData(attrs[NL80211_ATTR_MAC]), 6) == 0) {
+         wifiRemoveStation(wi, k);
+      }
+   }
+   wifiUpdateStationCount(wi);
+}
+
+static void wifiTimer(void *arg);
+
+static bool wifiRequest(uint8_t cmd, uint32_t ifindex) {
+   uint8_t buf[64];
+   struct nlmsghdr *nlh = nlMsgInit(buf, g_wifiFamily, NLM_F_DUMP, cmd, ++g_wifiSeq);
+   if (ifindex) {
+      nlPutAttr(nlh, NL80211_ATTR_IFINDEX, &ifindex, sizeof(ifindex));
+   }
+   if (!nlSend(g_wifiFd, nlh)) {
+      fprintf(stderr, "nl80211 dump failed: %s\n", strerror(errno));
+      return false;
+   }
+   return true;
+}
+
+// Move the sweep to the next station dump, or finish it and publish the batch
+static void wifiSweepNext(void) {
+   for (int s = g_wifiSweep; s < WIFI_MAX_INTERFACES; s++) {
+      WifiInterface *wi = &g_wifiInterfaces[s];
+      if (!wi->present) {
+         continue;
+      }
+      for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+         wi->stations[k].seen = false;
+      }
+      if (wifiRequest(NL80211_CMD_GET_STATION, wi->ifindex)) {
+         g_wifiSweep = s + 1;
+         return;
+      }
+   }
+   storeBatchFlush(&g_wifiBatch);
+   g_wifiSweep = -1;
+   if (g_wifiSweepAgain) {
+      g_wifiSweepAgain = false;
+      timerStart(&g_wifiTimer, 0, wifiTimer, NULL);
+   } else {
+      timerStart(&g_wifiTimer, g_wifiIntervalSec * 1000ULL, wifiTimer, NULL);
+   }
+}
+
+static void wifiSweepStart(void) {
+   if (g_wifiSweep >= 0) {
+      g_wifiSweepAgain = true;
+      return;
+   }
+   for (int s = 0; s < WIFI_MAX_INTERFACES; s++) {
+      g_wifiInterfaces[s].seen = false;
+   }
+   if (wifiRequest(NL80211_CMD_GET_INTERFACE, 0)) {
+      g_wifiSweep = 0;
+   } else {
+      timerStart(&g_wifiTimer, g_wifiIntervalSec * 1000ULL, wifiTimer, NULL);
+   }
+}
+
+static void wifiTimer(void *arg) {
+   (void)arg;
+   if (!timerArmed(&g_wifiTimer)) {
+      wifiSweepStart();
+   }
+}
+
+// End of one dump of the sweep: rows that it no longer reported are freed
+static void wifiDumpDone(void) {
+   if (g_wifiSweep == 0) {
+      for (int s = 0; s < WIFI_MAX_INTERFACES; s++) {
+         if (g_wifiInterfaces[s].present && !g_wifiInterfaces[s].seen) {
+            wifiRemoveInterface(&g_wifiInterfaces[s]);
+         }
+      }
+   } else {
+      WifiInterface *wi = &g_wifiInterfaces[g_wifiSweep - 1];
+      for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+         if (wi->stations[k].active && !wi->stations[k].seen) {
+            wifiRemoveStation(wi, k);
+         }
+      }
+      wifiUpdateStationCount(wi);
+   }
+   wifiSweepNext();
+}
+
+static uint8_t wifiCommand(const struct nlmsghdr *nlh) {
+   return ((const struct genlmsghdr *)NLMSG_DATA(nlh))->cmd;
+}
+
+// Reactor callback for the dump socket
+static void wifiReceive(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   static uint8_t buf[NL_BUFFER_SIZE];
+   for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+         return;
+      }
+      for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)n); nlh = NLMSG_NEXT(nlh, n)) {
+         if (nlh->nlmsg_seq != g_wifiSeq || g_wifiSweep < 0) {
+            continue;
+         }
+         if (nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR) {
+            // An interface that went away mid-sweep fails its station dump;
+            // the next sweep's interface dump frees its slot
+            wifiDumpDone();
+         } else if (nlh->nlmsg_type == g_wifiFamily && wifiCommand(nlh) == NL80211_CMD_NEW_INTERFACE) {
+            wifiInterfaceMessage(nlh);
+         } else if (nlh->nlmsg_type == g_wifiFamily && wifiCommand(nlh) == NL80211_CMD_NEW_STATION) {
+            wifiStationMessage(nlh);
+         }
+      }
+   }
+}
+
+// Reactor callback for the event socket: stations are updated as they come
+// and go, and interface changes start a sweep
+static void wifiEvent(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   static uint8_t buf[NL_BUFFER_SIZE];
+   bool sweep = false;
+   for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0) {
+         // ENOBUFS means events were lost; a sweep resynchronizes the rows
+         sweep = sweep || (n < 0 && errno == ENOBUFS);
+         break;
+      }
+      for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)n); nlh = NLMSG_NEXT(nlh, n)) {
+         if (nlh->nlmsg_type != g_wifiFamily) {
+            continue;
+         }
+         switch (wifiCommand(nlh)) {
+         case NL80211_CMD_NEW_STATION:
+            wifiStationMessage(nlh);
+            break;
+         case NL80211_CMD_DEL_STATION:
+            wifiStationLeft(nlh);
+            break;
+         case NL80211_CMD_NEW_INTERFACE:
+         case NL80211_CMD_DEL_INTERFACE:
+         case NL80211_CMD_SET_INTERFACE:
+         case NL80211_CMD_START_AP:
+         case NL80211_CMD_STOP_AP:
+            sweep = true;
+            break;
+         default:
+            break;
+         }
+      }
+   }
+   storeBatchFlush(&g_wifiBatch);
+   if (sweep) {
+      timerStart(&g_wifiTimer, 0, wifiTimer, NULL);
+   }
+}
+
+static void wifiStop(void) {
+   timerCancel(&g_wifiTimer);
+   int *fds[] = {&g_wifiFd, &g_wifiEventFd};
+   for (int f = 0; f < 2; f++) {
+      if (*fds[f] >= 0) {
+         reactorRemove(*fds[f]);
+         close(*fds[f]);
+         *fds[f] = -1;
+      }
+   }
+   g_wifiSweep = -1;
+}
+
+// Resolve the store rows of each slot, open the nl80211 sockets and start the
+// first sweep. Without nl80211 (no cfg80211 in the kernel) the rows stay empty.
+static void wifiStart(void) {
+   char name[MAX_NAME_LEN];
+   for (int s = 0; s < WIFI_MAX_INTERFACES; s++) {
+      WifiInterface *wi = &g_wifiInterfaces[s];
+      for (int f = 0; f < NUM_WIFI_SSID_FIELDS; f++) {
+         wifiRowName(name, sizeof(name), "SSID", s, -1, g_wifiSsidFields[f].name);
+         wi->ssidFields[f] = findDataModel(name);
+      }
+      for (int f = 0; f < NUM_WIFI_AP_FIELDS; f++) {
+         wifiRowName(name, sizeof(name), "AccessPoint", s, -1, g_wifiApFields[f].name);
+         wi->apFields[f] = findDataModel(name);
+      }
+      for (int k = 0; k < WIFI_MAX_STATIONS; k++) {
+         for (int f = 0; f < NUM_WIFI_STA_FIELDS; f++) {
+            wifiRowName(name, sizeof(name), "AccessPoint", s, k, g_wifiStationFields[f].name);
+            wi->stationFields[k][f] = findDataModel(name);
+         }
+      }
+   }
+
+   uint32_t configGroup = 0;
+   uint32_t mlmeGroup = 0;
+   g_wifiFd = nlOpen(NETLINK_GENERIC, 0);
+   g_wifiEventFd = nlOpen(NETLINK_GENERIC, 0);
+   if (g_wifiFd < 0 || g_wifiEventFd < 0 ||
+      !nlResolveFamily(g_wifiFd, NL80211_GENL_NAME, &g_wifiFamily, NL80211_MULTICAST_GROUP_CONFIG, &configGroup) ||
+      !nlResolveFamily(g_wifiFd, NL80211_GENL_NAME, &g_wifiFamily, NL80211_MULTICAST_GROUP_MLME, &mlmeGroup) ||
+      setsockopt(g_wifiEventFd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &configGroup, sizeof(configGroup)) != 0 ||
+      setsockopt(g_wifiEventFd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &mlmeGroup, sizeof(mlmeGroup)) != 0 ||
+      !setNonBlocking(g_wifiFd) || !setNonBlocking(g_wifiEventFd) ||
+      !reactorAdd(g_wifiFd, POLLIN, wifiReceive, NULL) ||
+      !reactorAdd(g_wifiEventFd, POLLIN, wifiEvent, NULL)) {
+      fprintf(stderr, "nl80211 is unavailable; Device.WiFi. rows stay empty\n");
+      wifiStop();
+      return;
+   }
+   printf("Tracking up to %d Wi-Fi access points with %d stations each, swept every %u s\n",
+      WIFI_MAX_INTERFACES, WIFI_MAX_STATIONS, g_wifiIntervalSec);
+   wifiSweepStart();
+}
+#endif
+
+#ifdef __linux__
+// Sampler sweeps read whole files from offset 0, one slot per file. The reads
+// of a sweep are queued and run together: with io_uring as one batch of
+// fixed-buffer reads into the registered g_sweepBuffers, submitted and reaped
+// with a single io_uring_enter(), and otherwise as one pread() each. The ring
+// is only used when it measured cheaper at startup (see cgroupChooseSweep()).
+static char g_sweepBuffers[SWEEP_MAX_READS][SWEEP_READ_SIZE];
+static ssize_t g_sweepResults[SWEEP_MAX_READS];
+static int g_sweepFds[SWEEP_MAX_READS];
+static int g_sweepSlots[SWEEP_MAX_READS];
+static int g_numSweepReads = 0;
+static uint64_t g_sweepSyscalls = 0;
+static bool g_sweepUseRing = false;
+
+#ifdef HAVE_IO_URING
+typedef struct {
+   int fd;
+   void *sqRing;
+   size_t sqRingSize;
+   void *cqRing;
+   size_t cqRingSize;
+   struct io_uring_sqe *sqes;
+   size_t sqesSize;
+   unsigned *sqTail;
+   unsigned *sqArray;
+   unsigned sqMask;
+   unsigned *cqHead;
+   unsigned *cqTail;
+   unsigned cqMask;
+   struct io_uring_cqe *cqes;
+} SweepRing;
+
+static SweepRing g_sweepRing = {.fd = -1, .sqRing = MAP_FAILED, .cqRing = MAP_FAILED, .sqes = MAP_FAILED};
+
+static void sweepRingClose(void) {
+   SweepRing *ring = &g_sweepRing;
+   if (ring->sqes != MAP_FAILED) {
+      munmap(ring->sqes, ring->sqesSize);
+   }
+   if (ring->cqRing != MAP_FAILED) {
+      munmap(ring->cqRing, ring->cqRingSize);
+   }
+   if (ring->sqRing != MAP_FAILED) {
+      munmap(ring->sqRing, ring->sqRingSize);
+   }
+   if (ring->fd >= 0) {
+      close(ring->fd);
+   }
+   *ring = (SweepRing){.fd = -1, .sqRing = MAP_FAILED, .cqRing = MAP_FAILED, .sqes = MAP_FAILED};
+}
+
+// Set up a ring with g_sweepBuffers registered. Fails on kernels without
+// io_uring, where it is disabled, or when the buffers exceed RLIMIT_MEMLOCK.
+static bool sweepRingOpen(void) {
+   SweepRing *ring = &g_sweepRing;
+   struct io_uring_params params;
+   memset(&params, 0, sizeof(params));
+   ring->fd = (int)syscall(__NR_io_uring_setup, SWEEP_MAX_READS, &params);
+   if (ring->fd < 0) {
+      return false;
+   }
+   ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+   ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+   ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+   ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+   struct iovec iov = {.iov_base = g_sweepBuffers, .iov_len = sizeof(g_sweepBuffers)};
+   if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED ||
+      syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0) {
+      sweepRingClose();
+      return false;
+   }
+   char *sq = ring->sqRing;
+   char *cq = ring->cqRing;
+   ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+   ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+   ring->sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+   ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+   ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+   ring->cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+   ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+   return true;
+}
+
+// Reap count submitted reads, waiting for them. Returns false if the wait
+// failed, when they may still be in flight.
+static bool sweepRingDrain(unsigned count) {
+   SweepRing *ring = &g_sweepRing;
+   while (count > 0) {
+      g_sweepSyscalls++;
+      if (syscall(__NR_io_uring_enter, ring->fd, 0, count, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+         return false;
+      }
+      unsigned head = *ring->cqHead;
+      unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+      for (; head != cqTail && count > 0; head++, count--) {
+         const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+         g_sweepResults[cqe->user_data] = cqe->res;
+      }
+      __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+   }
+   return true;
+}
+
+// Submit every queued read and wait for all of them. If the ring fails it is
+// closed for good and false is returned, leaving the reads to the pread()
+// path, unless some could not be reaped: those just fail for this sweep.
+static bool sweepRunRing(void) {
+   SweepRing *ring = &g_sweepRing;
+   unsigned tail = *ring->sqTail;
+   for (int r = 0; r < g_numSweepReads; r++, tail++) {
+      unsigned index = tail & ring->sqMask;
+      struct io_uring_sqe *sqe = &ring->sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->fd = g_sweepFds[r];
+      sqe->addr = (uintptr_t)g_sweepBuffers[g_sweepSlots[r]];
+      sqe->len = SWEEP_READ_SIZE - 1;
+      sqe->buf_index = 0;
+      sqe->user_data = (uint64_t)g_sweepSlots[r];
+      ring->sqArray[index] = index;
+   }
+   __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+   unsigned toSubmit = (unsigned)g_numSweepReads;
+   unsigned pending = toSubmit;
+   while (pending > 0) {
+      g_sweepSyscalls++;
+      int submitted = (int)syscall(__NR_io_uring_enter, ring->fd, toSubmit, pending, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (submitted < 0 && errno != EINTR) {
+         // Reads already submitted still write into the registered buffers,
+         // so reap them before the ring goes and pread() reuses the buffers
+         unsigned inFlight = pending - toSubmit;
+         bool drained = sweepRingDrain(inFlight);
+         sweepRingClose();
+         g_sweepUseRing = false;
+         return !drained;
+      }
+      toSubmit -= submitted > 0 ? (unsigned)submitted : 0;
+      unsigned head = *ring->cqHead;
+      unsigned cqTail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+      for (; head != cqTail; head++, pending--) {
+         const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+         g_sweepResults[cqe->user_data] = cqe->res;
+      }
+      __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+   }
+   return true;
+}
+#endif
+
+static void sweepStart(void) {
+#ifdef HAVE_IO_URING
+   if (g_sweepRing.fd < 0) {
+      sweepRingOpen();
+   }
+#endif
+}
+
+static void sweepStop(void) {
+#ifdef HAVE_IO_URING
+   sweepRingClose();
+#endif
+}
+
+static bool sweepHasRing(void) {
+#ifdef HAVE_IO_URING
+   return g_sweepRing.fd >= 0;
+#else
+   return false;
+#endif
+}
+
+// Queue a read of fd into g_sweepBuffers[slot]; a negative fd fails the read
+static void sweepQueue(int slot, int fd) {
+   g_sweepResults[slot] = -1;
+   g_sweepBuffers[slot][0] = '\0';
+   if (fd >= 0) {
+      g_sweepFds[g_numSweepReads] = fd;
+      g_sweepSlots[g_numSweepReads] = slot;
+      g_numSweepReads++;
+   }
+}
+
+// Run the queued reads. Each buffer is then NUL-terminated, and
+// g_sweepResults holds its length or a negative value on failure.
+static void sweepRun(void) {
+   bool done = false;
+#ifdef HAVE_IO_URING
+   done = g_sweepUseRing && g_sweepRing.fd >= 0 && sweepRunRing();
+#endif
+   for (int r = 0; r < g_numSweepReads && !done; r++) {
+      g_sweepSyscalls++;
+      g_sweepResults[g_sweepSlots[r]] = pread(g_sweepFds[r], g_sweepBuffers[g_sweepSlots[r]], SWEEP_READ_SIZE - 1, 0);
+   }
+   for (int r = 0; r < g_numSweepReads; r++) {
+      ssize_t n = g_sweepResults[g_sweepSlots[r]];
+      g_sweepBuffers[g_sweepSlots[r]][n > 0 ? n : 0] = '\0';
+   }
+   g_numSweepReads = 0;
+}
+#endif
+
+// Per-service resource usage from cgroup v2. Each directory directly under the
+// --cgroup root (such as the systemd system.slice) is a service and owns a
+// preallocated CGROUP_OBJECT Service.{i}. row while it exists. Its cpu.stat,
+// memory.current and memory.pressure stay open, and every interval one batch
+// of sweep reads refreshes all rows. inotify on the root adds and removes rows.
+static const char *g_cgroupRoot = NULL;
+static uint32_t g_cgroupIntervalSec = CGROUP_DEFAULT_INTERVAL;
+
+#ifdef __linux__
+enum { CGROUP_NAME, CGROUP_CPU_USAGE, CGROUP_CPU_TIME, CGROUP_MEMORY_USED, CGROUP_MEMORY_PRESSURE, NUM_CGROUP_FIELDS };
+static const StoreField g_cgroupFields[NUM_CGROUP_FIELDS] = {
+   {"Name", TYPE_STRING},
+   {"CPUUsage", TYPE_UINT},          // Percent of one CPU over the last interval
+   {"CPUTime", TYPE_ULONG},          // Milliseconds since the cgroup was created
+   {"MemoryUsed", TYPE_UINT},        // KiB
+   {"MemoryPressure", TYPE_DOUBLE},  // "some" avg10: percent of time stalled on memory
+};
+
+typedef struct {
+   bool present;
+   char name[NAME_MAX + 1];
+   int cpuFd;
+   int memoryFd;                     // -1 without the memory controller
+   int pressureFd;                   // -1 without PSI
+   uint64_t usageUsec;               // cpu.stat usage_usec of the last sweep
+   uint64_t sampledNs;
+   uint32_t cpuUsage;                // Values last written to the store
+   uint64_t cpuTime;
+   uint32_t memoryUsed;
+   double memoryPressure;
+   int fields[NUM_CGROUP_FIELDS];
+} CgroupService;
+
+static CgroupService g_cgroupServices[CGROUP_MAX_SERVICES];
+static StoreBatch g_cgroupBatch;       // Main loop updates
+static StoreBatch g_cgroupSweepBatch;  // Sweeps
+static int g_cgroupCountIndex = -1;  // ServiceNumberOfEntries
+static uint32_t g_numCgroupServices = 0;
+static int g_cgroupDirFd = -1;
+static int g_cgroupInotifyFd = -1;
+static SchedTask g_cgroupTask;
+// Held by sweeps on scheduler workers and by inotify updates on the main loop
+// while they sample and write the store, but not while they publish, so a
+// sweep's events may follow those of a later update; the store itself is
+// always written in order
+static pthread_mutex_t g_cgroupLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Add the service rows to the store, unless the JSON file defines them. Must
+// run before buildNameDictionary().
+static bool addCgroupParameters(void) {
+   if (!reserveStoreParameters(1 + CGROUP_MAX_SERVICES * NUM_CGROUP_FIELDS) ||
+      !appendStoreParameter(CGROUP_OBJECT "ServiceNumberOfEntries", TYPE_UINT, "")) {
+      return false;
+   }
+   char name[MAX_NAME_LEN];
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      for (int f = 0; f < NUM_CGROUP_FIELDS; f++) {
+         snprintf(name, sizeof(name), CGROUP_OBJECT "Service.%d.%s", s + 1, g_cgroupFields[f].name);
+         if (!appendStoreParameter(name, g_cgroupFields[f].type, "")) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+// Queue the reads of a service's files into its three sweep slots. cgroup
+// files are regenerated on every read, so one read per file per sweep is all
+// it takes.
+static void cgroupQueue(CgroupService *svc) {
+   int slot = (int)(svc - g_cgroupServices) * 3;
+   sweepQueue(slot, svc->cpuFd);
+   sweepQueue(slot + 1, svc->memoryFd);
+   sweepQueue(slot + 2, svc->pressureFd);
+}
+
+static void cgroupUpdateCount(StoreBatch *batch) {
+   uint32_t count = 0;
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      count += g_cgroupServices[s].present;
+   }
+   if (count != g_numCgroupServices) {
+      g_numCgroupServices = count;
+      storeBatchNumber(batch, g_cgroupCountIndex, count);
+   }
+}
+
+static void cgroupStoreDouble(StoreBatch *batch, int index, double d) {
+   rbusValue_t value;
+   rbusValue_Init(&value);
+   rbusValue_SetDouble(value, d);
+   storeBatchAdd(batch, index, value);
+}
+
+// Parse one service's swept files and queue the fields that changed
+static void cgroupSample(StoreBatch *batch, CgroupService *svc, uint64_t nowNs) {
+   int slot = (int)(svc - g_cgroupServices) * 3;
+   uint64_t usageUsec = svc->usageUsec;
+   if (g_sweepResults[slot] > 0) {
+      const char *usage = strstr(g_sweepBuffers[slot], "usage_usec ");
+      usageUsec = usage ? strtoull(usage + strlen("usage_usec "), NULL, 10) : usageUsec;
+   }
+   uint32_t cpuUsage = svc->cpuUsage;
+   if (svc->sampledNs && nowNs > svc->sampledNs && usageUsec >= svc->usageUsec) {
+      cpuUsage = (uint32_t)((usageUsec - svc->usageUsec) * 100000 / (nowNs - svc->sampledNs));
+   }
+   svc->usageUsec = usageUsec;
+   svc->sampledNs = nowNs;
+   uint32_t memoryUsed = g_sweepResults[slot + 1] > 0 ? (uint32_t)(strtoull(g_sweepBuffers[slot + 1], NULL, 10) / 1024) : 0;
+   double memoryPressure = 0;
+   if (g_sweepResults[slot + 2] > 0) {
+      const char *avg10 = strstr(g_sweepBuffers[slot + 2], "avg10=");
+      memoryPressure = avg10 ? strtod(avg10 + strlen("avg10="), NULL) : 0;
+   }
+
+   if (cpuUsage != svc->cpuUsage) {
+      svc->cpuUsage = cpuUsage;
+      storeBatchNumber(batch, svc->fields[CGROUP_CPU_USAGE], cpuUsage);
+   }
+   if (usageUsec / 1000 != svc->cpuTime) {
+      svc->cpuTime = usageUsec / 1000;
+      storeBatchNumber(batch, svc->fields[CGROUP_CPU_TIME], (int64_t)svc->cpuTime);
+   }
+   if (memoryUsed != svc->memoryUsed) {
+      svc->memoryUsed = memoryUsed;
+      storeBatchNumber(batch, svc->fields[CGROUP_MEMORY_USED], memoryUsed);
+   }
+   if (memoryPressure != svc->memoryPressure) {
+      svc->memoryPressure = memoryPressure;
+      cgroupStoreDouble(batch, svc->fields[CGROUP_MEMORY_PRESSURE], memoryPressure);
+   }
+}
+
+static int cgroupOpenFile(const char *service, const char *file) {
+   char path[NAME_MAX + 32];
+   snprintf(path, sizeof(path), "%s/%s", service, file);
+   return openat(g_cgroupDirFd, path, O_RDONLY | O_CLOEXEC);
+}
+
+static CgroupService *cgroupFindService(const char *name) {
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      if (g_cgroupServices[s].present && strcmp(g_cgroupServices[s].name, name) == 0) {
+         return &g_cgroupServices[s];
+      }
+   }
+   return NULL;
+}
+
+// Take a row for the cgroup directory name, unless it has one or has no
+// cpu.stat (not a cgroup v2 directory)
+static void cgroupAddService(StoreBatch *batch, const char *name) {
+   if (name[0] == '.' || cgroupFindService(name)) {
+      return;
+   }
+   CgroupService *svc = NULL;
+   for (int s = 0; s < CGROUP_MAX_SERVICES && !svc; s++) {
+      svc = g_cgroupServices[s].present ? NULL : &g_cgroupServices[s];
+   }
+   if (!svc) {
+      return;
+   }
+   svc->cpuFd = cgroupOpenFile(name, "cpu.stat");
+   if (svc->cpuFd < 0) {
+      return;
+   }
+   svc->memoryFd = cgroupOpenFile(name, "memory.current");
+   svc->pressureFd = cgroupOpenFile(name, "memory.pressure");
+   svc->present = true;
+   snprintf(svc->name, sizeof(svc->name), "%s", name);
+   svc->sampledNs = 0;
+   storeBatchString(batch, svc->fields[CGROUP_NAME], name);
+   cgroupQueue(svc);
+   sweepRun();
+   cgroupSample(batch, svc, monotonicNs());
+   cgroupUpdateCount(batch);
+}
+
+static void cgroupCloseService(CgroupService *svc) {
+   int *fds[] = {&svc->cpuFd, &svc->memoryFd, &svc->pressureFd};
+   for (int f = 0; f < 3; f++) {
+      if (*fds[f] >= 0) {
+         close(*fds[f]);
+      }
+      *fds[f] = -1;
+   }
+   svc->present = false;
+}
+
+static void cgroupRemoveService(StoreBatch *batch, CgroupService *svc) {
+   cgroupCloseService(svc);
+   svc->name[0] = '\0';
+   svc->cpuUsage = 0;
+   svc->cpuTime = 0;
+   svc->memoryUsed = 0;
+   svc->memoryPressure = 0;
+   storeBatchString(batch, svc->fields[CGROUP_NAME], "");
+   storeBatchNumber(batch, svc->fields[CGROUP_CPU_USAGE], 0);
+   storeBatchNumber(batch, svc->fields[CGROUP_CPU_TIME], 0);
+   storeBatchNumber(batch, svc->fields[CGROUP_MEMORY_USED], 0);
+   cgroupStoreDouble(batch, svc->fields[CGROUP_MEMORY_PRESSURE], 0);
+   cgroupUpdateCount(batch);
+}
+
+// Walk the root once: add rows for new directories and free the rows of
+// directories that are gone
+static void cgroupScan(StoreBatch *batch) {
+   int fd = openat(g_cgroupDirFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+   if (!dir) {
+      if (fd >= 0) {
+         close(fd);
+      }
+      return;
+   }
+   bool found[CGROUP_MAX_SERVICES] = {false};
+   struct dirent *entry;
+   while ((entry = readdir(dir))) {
+      if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) {
+         continue;
+      }
+      cgroupAddService(batch, entry->d_name);
+      CgroupService *svc = cgroupFindService(entry->d_name);
+      if (svc) {
+         found[svc - g_cgroupServices] = true;
+      }
+   }
+   closedir(dir);
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      if (g_cgroupServices[s].present && !found[s]) {
+         cgroupRemoveService(batch, &g_cgroupServices[s]);
+      }
+   }
+}
+
+// Read the files of every service in one sweep, then write their rows to the
+// store. The caller publishes the batch.
+static void cgroupSampleAll(StoreBatch *batch) {
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      if (g_cgroupServices[s].present) {
+         cgroupQueue(&g_cgroupServices[s]);
+      }
+   }
+   sweepRun();
+   uint64_t nowNs = monotonicNs();
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      if (g_cgroupServices[s].present) {
+         cgroupSample(batch, &g_cgroupServices[s], nowNs);
+      }
+   }
+   storeBatchApply(batch);
+}
+
+// Periodic task: one sweep over every service
+static void cgroupSweep(void *arg) {
+   (void)arg;
+   pthread_mutex_lock(&g_cgroupLock);
+   cgroupSampleAll(&g_cgroupSweepBatch);
+   pthread_mutex_unlock(&g_cgroupLock);
+   storeBatchFlush(&g_cgroupSweepBatch);
+   schedAfter(&g_cgroupTask, g_cgroupIntervalSec * 1000ULL);
+}
+
+// Reactor callback for inotify on the cgroup root
+static void cgroupInotify(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+   StoreBatch *batch = &g_cgroupBatch;
+   bool rescan = false;
+   ssize_t n;
+   pthread_mutex_lock(&g_cgroupLock);
+   while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+         const struct inotify_event *event = (const struct inotify_event *)p;
+         if (event->mask & IN_Q_OVERFLOW) {
+            rescan = true;
+         } else if (!(event->mask & IN_ISDIR) || event->len == 0) {
+            continue;
+         } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            cgroupAddService(batch, event->name);
+         } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            CgroupService *svc = cgroupFindService(event->name);
+            if (svc) {
+               cgroupRemoveService(batch, svc);
+            }
+         }
+      }
+   }
+   if (rescan) {
+      cgroupScan(batch);
+   }
+   storeBatchApply(batch);
+   pthread_mutex_unlock(&g_cgroupLock);
+   storeBatchFlush(batch);
+}
+
+static void cgroupStop(void) {
+   timerCancel(&g_cgroupTask.timer);
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      if (g_cgroupServices[s].present) {
+         cgroupCloseService(&g_cgroupServices[s]);
+      }
+   }
+   if (g_cgroupInotifyFd >= 0) {
+      reactorRemove(g_cgroupInotifyFd);
+      close(g_cgroupInotifyFd);
+      g_cgroupInotifyFd = -1;
+   }
+   if (g_cgroupDirFd >= 0) {
+      close(g_cgroupDirFd);
+      g_cgroupDirFd = -1;
+   }
+   sweepStop();
+}
+
+static uint64_t processCpuNs(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Read the open files of every service a few times each way and keep the way
+// that cost less process CPU time, io_uring worker threads included. cgroup
+// files cannot be read without blocking, so io_uring hands the reads to its
+// workers and is not always the cheaper one.
+static void cgroupChooseSweep(void) {
+   uint64_t cpuNs[2] = {0, 0};
+   for (int mode = 0; mode < 2 && sweepHasRing() && g_numCgroupServices > 0; mode++) {
+      g_sweepUseRing = mode == 0;
+      uint64_t startNs = processCpuNs();
+      for (int n = 0; n < CGROUP_PROBE_SWEEPS; n++) {
+         for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+            if (g_cgroupServices[s].present) {
+               cgroupQueue(&g_cgroupServices[s]);
+            }
+         }
+         sweepRun();
+      }
+      cpuNs[mode] = processCpuNs() - startNs;
+   }
+   g_sweepUseRing = sweepHasRing() && cpuNs[0] < cpuNs[1];
+}
+
+static bool cgroupStart(void) {
+   g_cgroupCountIndex = findDataModel(CGROUP_OBJECT "ServiceNumberOfEntries");
+   char name[MAX_NAME_LEN];
+   for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+      CgroupService *svc = &g_cgroupServices[s];
+      svc->cpuFd = svc->memoryFd = svc->pressureFd = -1;
+      for (int f = 0; f < NUM_CGROUP_FIELDS; f++) {
+         snprintf(name, sizeof(name), CGROUP_OBJECT "Service.%d.%s", s + 1, g_cgroupFields[f].name);
+         svc->fields[f] = findDataModel(name);
+      }
+   }
+
+   g_cgroupDirFd = open(g_cgroupRoot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   g_cgroupInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (g_cgroupDirFd < 0 || g_cgroupInotifyFd < 0 ||
+      inotify_add_watch(g_cgroupInotifyFd, g_cgroupRoot, IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_ONLYDIR) < 0 ||
+      !reactorAdd(g_cgroupInotifyFd, POLLIN, cgroupInotify, NULL)) {
+      fprintf(stderr, "Failed to watch cgroup root %s: %s\n", g_cgroupRoot, strerror(errno));
+      cgroupStop();
+      return false;
+   }
+   sweepStart();
+   cgroupScan(&g_cgroupBatch);
+   storeBatchFlush(&g_cgroupBatch);
+   cgroupChooseSweep();
+   printf("Sampling %u services under %s every %u s with %s\n", g_numCgroupServices, g_cgroupRoot,
+      g_cgroupIntervalSec, g_sweepUseRing ? "io_uring" : "pread");
+   schedInit(&g_cgroupTask, SCHED_PERIODIC, cgroupSweep, NULL);
+   schedAfter(&g_cgroupTask, g_cgroupIntervalSec * 1000ULL);
+   return true;
+}
+
+// Time count cgroup sweeps with io_uring and with pread. CPU time is that of
+// the whole process, so it includes io_uring worker threads.
+static int benchSweeps(int count) {
+   if (!g_cgroupRoot) {
+      fprintf(stderr, "--bench-sweep needs --cgroup\n");
+      return 1;
+   }
+   if (!cgroupStart()) {
+      return 1;
+   }
+   bool useRing = g_sweepUseRing;
+   printf("%-9s %6s %10s %10s %10s\n", "reads", "files", "syscalls", "cpu_us", "wall_us");
+   for (int mode = 0; mode < 2; mode++) {
+      g_sweepUseRing = mode == 0;
+      if (g_sweepUseRing && !sweepHasRing()) {
+         printf("%-9s unavailable\n", "io_uring");
+         continue;
+      }
+      int files = 0;
+      for (int s = 0; s < CGROUP_MAX_SERVICES; s++) {
+         CgroupService *svc = &g_cgroupServices[s];
+         files += svc->present ? (svc->cpuFd >= 0) + (svc->memoryFd >= 0) + (svc->pressureFd >= 0) : 0;
+      }
+      uint64_t syscalls = g_sweepSyscalls;
+      uint64_t cpuNs = processCpuNs();
+      uint64_t wallNs = realMonotonicNs();
+      for (int n = 0; n < count; n++) {
+         cgroupSampleAll(&g_cgroupSweepBatch);
+         storeBatchFlush(&g_cgroupSweepBatch);
+      }
+      printf("%-9s %6d %10.1f %10.1f %10.1f\n", g_sweepUseRing ? "io_uring" : "pread", files,
+         (double)(g_sweepSyscalls - syscalls) / count, (processCpuNs() - cpuNs) / 1e3 / count,
+         (realMonotonicNs() - wallNs) / 1e3 / count);
+   }
+   g_sweepUseRing = useRing;
+   return 0;
+}
+#endif
+
+// Clock synchronization from adjtimex(), only with --clock-sync so that the
+// provider leaves a Device.Time.Status owned by another component alone
+static bool g_timeEnabled = false;
+
+#ifdef __linux__
+// Clock synchronization from adjtimex(): Device.Time.Status and the kernel
+// clock's offset, frequency and error estimates, sampled by a periodic task.
+// A change of Status, as when NTP gains or loses sync, is published as a
+// value-change event like every other change.
+enum { TIME_STATUS, TIME_OFFSET, TIME_FREQUENCY, TIME_MAX_ERROR, TIME_ESTIMATED_ERROR, NUM_TIME_FIELDS };
+static const StoreField g_timeFields[NUM_TIME_FIELDS] = {
+   {"Status", TYPE_STRING},
+   {"X_RDK_ClockOffset", TYPE_LONG},         // Microseconds
+   {"X_RDK_ClockFrequency", TYPE_LONG},      // Parts per billion
+   {"X_RDK_ClockMaxError", TYPE_ULONG},      // Microseconds
+   {"X_RDK_ClockEstimatedError", TYPE_ULONG},
+};
+
+static int g_timeFieldIndexes[NUM_TIME_FIELDS];
+static const char *g_timeStatus = NULL;  // Values last written to the store
+static StoreBatch g_timeBatch;
+static int64_t g_timeValues[NUM_TIME_FIELDS];
+static SchedTask g_timeTask;
+
+// Add the clock parameters to the store, unless the JSON file defines them.
+// Must run before buildNameDictionary().
+static bool addTimeParameters(void) {
+   if (!reserveStoreParameters(NUM_TIME_FIELDS)) {
+      return false;
+   }
+   char name[MAX_NAME_LEN];
+   for (int f = 0; f < NUM_TIME_FIELDS; f++) {
+      snprintf(name, sizeof(name), TIME_OBJECT "%s", g_timeFields[f].name);
+      if (!appendStoreParameter(name, g_timeFields[f].type, "Unsynchronized")) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Periodic task
+static void timeSample(void *arg) {
+   (void)arg;
+   struct timex tx;
+   memset(&tx, 0, sizeof(tx));
+   int state = adjtimex(&tx);
+   const char *status = state < 0 ? "Error" :
+      (state == TIME_ERROR || (tx.status & STA_UNSYNC)) ? "Unsynchronized" : "Synchronized";
+   if (status != g_timeStatus) {
+      g_timeStatus = status;
+      storeBatchString(&g_timeBatch, g_timeFieldIndexes[TIME_STATUS], status);
+   }
+
+   int64_t values[NUM_TIME_FIELDS] = {0};
+   if (state >= 0) {
+      values[TIME_OFFSET] = (tx.status & STA_NANO) ? tx.offset / 1000 : tx.offset;
+      values[TIME_FREQUENCY] = (int64_t)tx.freq * 1000 / 65536;  // freq is ppm with a 16-bit fraction
+      values[TIME_MAX_ERROR] = tx.maxerror;
+      values[TIME_ESTIMATED_ERROR] = tx.esterror;
+   }
+   for (int f = TIME_OFFSET; f < NUM_TIME_FIELDS; f++) {
+      if (values[f] != g_timeValues[f]) {
+         g_timeValues[f] = values[f];
+         storeBatchNumber(&g_timeBatch, g_timeFieldIndexes[f], values[f]);
+      }
+   }
+   storeBatchFlush(&g_timeBatch);
+   schedAfter(&g_timeTask, TIME_SAMPLE_INTERVAL_MS);
+}
+
+static void timeStart(void) {
+   char name[MAX_NAME_LEN];
+   for (int f = 0; f < NUM_TIME_FIELDS; f++) {
+      snprintf(name, sizeof(name), TIME_OBJECT "%s", g_timeFields[f].name);
+      g_timeFieldIndexes[f] = findDataModel(name);
+      g_timeValues[f] = 0;
+   }
+   g_timeStatus = NULL;
+   schedInit(&g_timeTask, SCHED_PERIODIC, timeSample, NULL);
+   timeSample(NULL);
+}
+
+static void timeStop(void) {
+   timerCancel(&g_timeTask.timer);
+}
+#endif
+
+// DNS client servers mirrored from resolv.conf. Row i of DNS_OBJECT Server.{i}.
+// holds the i-th nameserver line; the file is re-parsed only when inotify
+// reports that it changed, and only the fields that differ are written. Only
+// with --dns-servers.
+static bool g_dnsEnabled = false;
+static const char *g_resolvConfPath = DNS_DEFAULT_RESOLV_CONF;
+
+#ifdef __linux__
+enum { DNS_ENABLE, DNS_STATUS, DNS_SERVER, DNS_ORDER, NUM_DNS_FIELDS };
+static const StoreField g_dnsFields[NUM_DNS_FIELDS] = {
+   {"Enable", TYPE_BOOL},
+   {"Status", TYPE_STRING},
+   {"DNSServer", TYPE_STRING},
+   {"X_CISCO_COM_Order", TYPE_UINT},
+};
+
+static int g_dnsFieldIndexes[DNS_MAX_SERVERS][NUM_DNS_FIELDS];
+static int g_dnsCountIndex = -1;            // ServerNumberOfEntries
+static StoreBatch g_dnsBatch;
+static char g_dnsServers[DNS_MAX_SERVERS][DNS_MAX_ADDRESS];
+static int g_numDnsServers = -1;            // -1 until the first parse
+static int g_dnsInotifyFd = -1;
+static char g_dnsNames[2][NAME_MAX + 1];    // The file's name and, for a symlink, its target's
+
+// Add the server rows to the store, unless the JSON file defines them. Must
+// run before buildNameDictionary().
+static bool addDnsParameters(void) {
+   if (!reserveStoreParameters(1 + DNS_MAX_SERVERS * NUM_DNS_FIELDS) ||
+      !appendStoreParameter(DNS_OBJECT "ServerNumberOfEntries", TYPE_UINT, "")) {
+      return false;
+   }
+   char name[MAX_NAME_LEN];
+   for (int s = 0; s < DNS_MAX_SERVERS; s++) {
+      for (int f = 0; f < NUM_DNS_FIELDS; f++) {
+         snprintf(name, sizeof(name), DNS_OBJECT "Server.%d.%s", s + 1, g_dnsFields[f].name);
+         if (!appendStoreParameter(name, g_dnsFields[f].type, f == DNS_STATUS ? "Disabled" : "")) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+// Parse the nameserver lines and queue the rows that changed. A missing file
+// leaves no servers.
+static void dnsReload(void) {
+   char servers[DNS_MAX_SERVERS][DNS_MAX_ADDRESS];
+   int numServers = 0;
+   FILE *f = fopen(g_resolvConfPath, "r");
+   if (f) {
+      char line[512];
+      while (fgets(line, sizeof(line), f) && numServers < DNS_MAX_SERVERS) {
+         char keyword[16];
+         char address[DNS_MAX_ADDRESS];
+         if (sscanf(line, " %15s %63s", keyword, address) == 2 && strcmp(keyword, "nameserver") == 0) {
+            snprintf(servers[numServers++], sizeof(servers[0]), "%s", address);
+         }
+      }
+      fclose(f);
+   }
+
+   for (int s = 0; s < DNS_MAX_SERVERS; s++) {
+      bool used = s < numServers;
+      bool wasUsed = s < g_numDnsServers;
+      const int *fields = g_dnsFieldIndexes[s];
+      if (g_numDnsServers < 0 || used != wasUsed) {
+         storeBatchBool(&g_dnsBatch, fields[DNS_ENABLE], used);
+         storeBatchString(&g_dnsBatch, fields[DNS_STATUS], used ? "Enabled" : "Disabled");
+         storeBatchNumber(&g_dnsBatch, fields[DNS_ORDER], used ? s + 1 : 0);
+      }
+      const char *server = used ? servers[s] : "";
+      if (g_numDnsServers < 0 || strcmp(server, g_dnsServers[s]) != 0) {
+         snprintf(g_dnsServers[s], sizeof(g_dnsServers[s]), "%s", server);
+         storeBatchString(&g_dnsBatch, fields[DNS_SERVER], server);
+      }
+   }
+   if (numServers != g_numDnsServers) {
+      g_numDnsServers = numServers;
+      storeBatchNumber(&g_dnsBatch, g_dnsCountIndex, numServers);
+   }
+   storeBatchFlush(&g_dnsBatch);
+}
+
+// Reactor callback for inotify on the directories holding the file
+static void dnsInotify(int fd, short revents, void *arg) {
+   (void)revents;
+   (void)arg;
+   char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+   bool changed = false;
+   ssize_t n;
+   while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+         const struct inotify_event *event = (const struct inotify_event *)p;
+         changed = changed || (event->mask & IN_Q_OVERFLOW) ||
+            (event->len && (strcmp(event->name, g_dnsNames[0]) == 0 || strcmp(event->name, g_dnsNames[1]) == 0));
+      }
+   }
+   if (changed) {
+      dnsReload();
+   }
+}
+
+// Watch the directory of path for its name being written, replaced or removed
+static bool dnsWatch(const char *path, char *name) {
+   char dir[PATH_MAX];
+   size_t len = strlen(path);
+   if (len >= sizeof(dir)) {
+      return false;
+   }
+   memcpy(dir, path, len + 1);
+   char *slash = strrchr(dir, '/');
+   const char *base = slash ? slash + 1 : dir;
+   len = strlen(base);
+   if (len > NAME_MAX) {
+      return false;
+   }
+   memcpy(name, base, len + 1);
+   if (slash == dir) {
+      dir[1] = '\0';
+   } else if (slash) {
+      *slash = '\0';
+   } else {
+      snprintf(dir, sizeof(dir), ".");
+   }
+   return inotify_add_watch(g_dnsInotifyFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM) >= 0;
+}
+
+static void dnsStop(void) {
+   if (g_dnsInotifyFd >= 0) {
+      reactorRemove(g_dnsInotifyFd);
+      close(g_dnsInotifyFd);
+      g_dnsInotifyFd = -1;
+   }
+}
+
+// Resolvers such as systemd-resolved make resolv.conf a symlink into /run and
+// rewrite the target, so the target's directory is watched as well
+static bool dnsStart(void) {
+   g_dnsCountIndex = findDataModel(DNS_OBJECT "ServerNumberOfEntries");
+   char name[MAX_NAME_LEN];
+   for (int s = 0; s < DNS_MAX_SERVERS; s++) {
+      g_dnsServers[s][0] = '\0';
+      for (int f = 0; f < NUM_DNS_FIELDS; f++) {
+         snprintf(name, sizeof(name), DNS_OBJECT "Server.%d.%s", s + 1, g_dnsFields[f].name);
+         g_dnsFieldIndexes[s][f] = findDataModel(name);
+      }
+   }
+   g_numDnsServers = -1;
+   g_dnsNames[1][0] = '\0';
+
+   char target[PATH_MAX];
+   g_dnsInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (g_dnsInotifyFd < 0 || !dnsWatch(g_resolvConfPath, g_dnsNames[0]) ||
+      (realpath(g_resolvConfPath, target) && strcmp(target, g_resolvConfPath) != 0 && !dnsWatch(target, g_dnsNames[1])) ||
+      !reactorAdd(g_dnsInotifyFd, POLLIN, dnsInotify, NULL)) {
+      fprintf(stderr, "Failed to watch %s: %s\n", g_resolvConfPath, strerror(errno));
+      dnsStop();
+      return false;
+   }
+   dnsReload();
+   return true;
+}
+#endif
+
+// Cleanup function to free resources
+static void cleanup(void) {
+   // Stop rbus calling the handlers before the scheduler goes, so that none
+   // of them submits a task to it while it stops
+   if (g_rbusHandle && g_methodsRegistered) {
+      rbus_unregDataElements(g_rbusHandle, NUM_METHOD_ELEMENTS, g_methodElements);
+      g_methodsRegistered = false;
+   }
+   if (g_rbusHandle && g_dataElements && g_dataModels) {
+      for (int i = 0; i < g_totalDataModels; i++) {
+         if (!g_dataElements[i].name) {
+            char buf[MAX_NAME_LEN];
+            g_dataElements[i].name = strdup(dataModelName(i, buf));
+         }
+      }
+      rbus_unregDataElements(g_rbusHandle, g_totalDataModels, g_dataElements);
+   }
+   // Nor may a timer submit one
+   timerCancel(&g_promTask.timer);
+   for (int r = 0; r < REPORT_MAX_PROFILES; r++) {
+      timerCancel(&g_reportProfiles[r].timer);
+   }
+#ifdef __linux__
+   timerCancel(&g_cgroupTask.timer);
+   timerCancel(&g_timeTask.timer);
+#endif
+   schedStop();
+   faultStop();
+   httpStop();
+   promStop();
+   diagStop();
+   xferStop();
+#ifdef SIMULATED_CLOCK
+   clockStop();
+#endif
+#ifdef HAVE_ETHTOOL_NETLINK
+   ethStop();
+#endif
+#ifdef HAVE_NL80211
+   wifiStop();
+#endif
+#ifdef __linux__
+   cgroupStop();
+   timeStop();
+   dnsStop();
+#endif
+   for (int r = 0; r < REPORT_MAX_PROFILES; r++) {
+      if (g_reportProfiles[r].inUse) {
+         reportProfileFree(&g_reportProfiles[r]);
+      }
+   }
+   if (g_rbusHandle && g_dataElements && g_dataModels) {
+      for (int i = 0; i < g_totalDataModels; i++) {
+         rbusEvent_Unsubscribe(g_rbusHandle, g_dataElements[i].name);
+         clearTtl(i);
+         if (g_dataModels[i].proxy) {
+            if (g_dataModels[i].proxy->subscribed) {
+               char buf[MAX_NAME_LEN];
+               rbusEvent_Unsubscribe(g_rbusHandle, proxyRemoteName(i, buf));
+            }
+            free(g_dataModels[i].proxy);
+         }
+         if (g_dataModels[i].type == TYPE_STRING ||
+            g_dataModels[i].type == TYPE_DATETIME ||
+            g_dataModels[i].type == TYPE_BASE64) {
+            free(g_dataModels[i].value.strVal);
+         }
+         free(g_dataElements[i].name);
+      }
+      free(g_dataElements);
+      g_dataElements = NULL;
+   }
+   if (g_dataModels) {
+      free(g_dataModels);
+      g_dataModels = NULL;
+   }
+   nameDictFree(&g_nameDict);
+   if (g_subTrie) {
+      subTrieFreeNode(g_subTrie);
+      g_subTrie = NULL;
+   }
+   if (g_rbusHandle) {
+      rbus_close(g_rbusHandle);
+      g_rbusHandle = NULL;
+   }
+}
+
+static int g_loadGenEvents = 0;
+
+static void loadGenEventHandler(rbusHandle_t handle, rbusEvent_t const *event, rbusEventSubscription_t *subscription) {
+   (void)handle;
+   (void)event;
+   (void)subscription;
+   __atomic_add_fetch(&g_loadGenEvents, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef HAVE_RBUS_RAWDATA
+static void loadGenRawDataHandler(rbusHandle_t handle, rbusEventRawData_t const *event, rbusEventSubscription_t *subscription) {
+   (void)handle;
+   (void)event;
+   (void)subscription;
+   __atomic_add_fetch(&g_loadGenEvents, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+// Time count gets of name over handle and print the rate
+static int loadGenGets(rbusHandle_t handle, const char *label, const char *name, int count) {
+   uint64_t start = realMonotonicNs();
+   for (int k = 0; k < count; k++) {
+      rbusValue_t value;
+      rbusError_t rc = rbus_get(handle, name, &value);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "%s get of %s failed: %d\n", label, name, rc);
+         return 1;
+      }
+      rbusValue_Release(value);
+   }
+   uint64_t elapsed = realMonotonicNs() - start;
+   fprintf(stdout, "  %-10s gets:   %9.0f/s, %8.1f us avg\n", label,
+      count * 1e9 / elapsed, elapsed / 1e3 / count);
+   return 0;
+}
+
+// Set name count times to distinct values of type and time how long the
+// subscribed events take to arrive
+static int loadGenEvents(rbusHandle_t handle, const char *label, const char *name, rbusValueType_t type, int count) {
+   __atomic_store_n(&g_loadGenEvents, 0, __ATOMIC_RELAXED);
+   uint64_t start = realMonotonicNs();
+   for (int k = 0; k < count; k++) {
+      char str[32];
+      if (type == RBUS_BOOLEAN) {
+         snprintf(str, sizeof(str), "%s", k % 2 ? "false" : "true");
+      } else if (type == RBUS_STRING) {
+         snprintf(str, sizeof(str), "loadgen-%d", k);
+      } else {
+         snprintf(str, sizeof(str), "%d", (k % 200) + 1);
+      }
+      rbusValue_t value;
+      rbusValue_Init(&value);
+      if (!rbusValue_SetFromString(value, type, str)) {
+         fprintf(stderr, "%s events: cannot make a value of type %d for %s from \"%s\"\n", label, (int)type, name, str);
+         rbusValue_Release(value);
+         return 1;
+      }
+      rbusError_t rc = rbus_set(handle, name, value, NULL);
+      rbusValue_Release(value);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "%s set of %s failed: %d\n", label, name, rc);
+         return 1;
+      }
+   }
+   // Allow up to 5 s for the remaining events to drain
+   uint64_t deadline = realMonotonicNs() + 5000000000ULL;
+   while (__atomic_load_n(&g_loadGenEvents, __ATOMIC_RELAXED) < count && realMonotonicNs() < deadline) {
+      poll(NULL, 0, 1);
+   }
+   uint64_t elapsed = realMonotonicNs() - start;
+   int received = __atomic_load_n(&g_loadGenEvents, __ATOMIC_RELAXED);
+   fprintf(stdout, "  %-10s events: %9.0f/s, %d of %d received\n", label,
+      received * 1e9 / elapsed, received, count);
+   return 0;
+}
+
+// Consumer-side load generator: measure gets of name over the brokered path
+// and a direct connection, then value-change events delivered as objects and
+// as raw data. Runs against an already running provider.
+static int runLoadGenerator(const char *name, int count) {
+   rbusHandle_t handle;
+   rbusError_t rc = rbus_open(&handle, "rbus-datamodels-loadgen");
+   if (rc != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Failed to open rbus: %d\n", rc);
+      return 1;
+   }
+
+   rbusValue_t current;
+   rc = rbus_get(handle, name, &current);
+   if (rc != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Failed to get %s: %d\n", name, rc);
+      rbus_close(handle);
+      return 1;
+   }
+   rbusValueType_t type = rbusValue_GetType(current);
+
+   fprintf(stdout, "Load generator: %d operations on %s\n", count, name);
+   int result = loadGenGets(handle, "brokered", name, count);
+#ifdef HAVE_RBUS_DIRECT
+   rbusHandle_t direct;
+   if (result == 0 && rbus_openDirect(handle, &direct, name) == RBUS_ERROR_SUCCESS) {
+      result = loadGenGets(direct, "direct", name, count);
+      rbus_closeDirect(direct);
+   } else if (result == 0) {
+      fprintf(stderr, "Failed to open a direct connection for %s\n", name);
+   }
+#else
+   fprintf(stdout, "  direct connections are not supported by this rbus\n");
+#endif
+
+   if (result == 0 && rbusEvent_Subscribe(handle, name, loadGenEventHandler, NULL, 0) == RBUS_ERROR_SUCCESS) {
+      result = loadGenEvents(handle, "object", name, type, count);
+      rbusEvent_Unsubscribe(handle, name);
+   }
+#ifdef HAVE_RBUS_RAWDATA
+   if (result == 0 && rbusEvent_SubscribeRawData(handle, name, loadGenRawDataHandler, NULL, 0) == RBUS_ERROR_SUCCESS) {
+      result = loadGenEvents(handle, "raw", name, type, count);
+      rbusEvent_UnsubscribeRawData(handle, name);
+   }
+#else
+   fprintf(stdout, "  raw-data events are not supported by this rbus\n");
+#endif
+
+   // Put the original value back
+   rbus_set(handle, name, current, NULL);
+   rbusValue_Release(current);
+   rbus_close(handle);
+   return result;
+}
+
+#ifdef __linux__
+// Soak test: a mixed get/set/subscribe workload from a client handle against
+// this provider, for a span of provider time, watching for memory growth and
+// latency drift. Latencies are measured on the real clock even when the
+// provider runs on the simulated one.
+enum { SOAK_GET, SOAK_SET, SOAK_SUBSCRIBE, NUM_SOAK_OPS };
+static const char *const g_soakOpNames[NUM_SOAK_OPS] = {"get", "set", "sub"};
+
+// Latency histogram: 1 us buckets below 64 us, then 32 buckets per power of two
+typedef struct {
+   uint64_t count;
+   uint64_t maxUs;
+   uint32_t buckets[SOAK_BUCKETS];
+} SoakHistogram;
+
+typedef struct {
+   uint64_t seconds;
+   uint64_t rssKb;
+   uint64_t heapKb;          // Allocated from the heap
+   uint64_t heapFreeKb;      // Held by the allocator but free
+   uint64_t p50Us[NUM_SOAK_OPS];
+   uint64_t p99Us[NUM_SOAK_OPS];
+} SoakSample;
+
+static SoakHistogram g_soakHistograms[NUM_SOAK_OPS];
+static int g_soakEvents = 0;
+
+static void soakRecord(int op, uint64_t ns) {
+   SoakHistogram *h = &g_soakHistograms[op];
+   uint64_t us = ns / 1000;
+   int bucket = (int)us;
+   if (us >= 64) {
+      int shift = 63 - __builtin_clzll(us) - 5;
+      bucket = 64 + (shift - 1) * 32 + (int)(us >> shift) - 32;
+   }
+   h->buckets[bucket < SOAK_BUCKETS ? bucket : SOAK_BUCKETS - 1]++;
+   h->count++;
+   if (us > h->maxUs) {
+      h->maxUs = us;
+   }
+}
+
+// Lower bound, in us, of the bucket holding the given fraction of latencies
+static uint64_t soakPercentile(const SoakHistogram *h, double fraction) {
+   uint64_t rank = (uint64_t)(h->count * fraction);
+   uint64_t seen = 0;
+   for (int b = 0; b < SOAK_BUCKETS; b++) {
+      seen += h->buckets[b];
+      if (seen > rank) {
+         return b < 64 ? (uint64_t)b : (uint64_t)((b - 64) % 32 + 32) << ((b - 64) / 32 + 1);
+      }
+   }
+   return h->maxUs;
+}
+
+static uint64_t soakRssKb(void) {
+   FILE *f = fopen("/proc/self/status", "r");
+   if (!f) {
+      return 0;
+   }
+   char line[128];
+   unsigned long long kb = 0;
+   while (fgets(line, sizeof(line), f) && sscanf(line, "VmRSS: %llu", &kb) != 1) {
+   }
+   fclose(f);
+   return kb;
+}
+
+static void soakHeap(SoakSample *sample) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+   struct mallinfo2 mi = mallinfo2();
+   sample->heapKb = (mi.uordblks + mi.hblkhd) / 1024;
+   sample->heapFreeKb = mi.fordblks / 1024;
+#elif defined(__GLIBC__)
+   struct mallinfo mi = mallinfo();
+   sample->heapKb = ((size_t)(unsigned)mi.uordblks + (size_t)(unsigned)mi.hblkhd) / 1024;
+   sample->heapFreeKb = (size_t)(unsigned)mi.fordblks / 1024;
+#else
+   sample->heapKb = 0;
+   sample->heapFreeKb = 0;
+#endif
+}
+
+// Print and return a sample, and start new latency histograms
+static SoakSample soakSample(uint64_t seconds, uint64_t ops, uint64_t errors) {
+   SoakSample sample;
+   memset(&sample, 0, sizeof(sample));
+   sample.seconds = seconds;
+   sample.rssKb = soakRssKb();
+   soakHeap(&sample);
+   printf("%8" PRIu64 " %9" PRIu64 " %6" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64, seconds, ops, errors,
+      sample.rssKb, sample.heapKb, sample.heapFreeKb);
+   for (int op = 0; op < NUM_SOAK_OPS; op++) {
+      sample.p50Us[op] = soakPercentile(&g_soakHistograms[op], 0.5);
+      sample.p99Us[op] = soakPercentile(&g_soakHistograms[op], 0.99);
+      printf(" %7" PRIu64 " %7" PRIu64 " %7" PRIu64, sample.p50Us[op], sample.p99Us[op], g_soakHistograms[op].maxUs);
+      memset(&g_soakHistograms[op], 0, sizeof(g_soakHistograms[op]));
+   }
+   printf(" %8d\n", __atomic_load_n(&g_soakEvents, __ATOMIC_RELAXED));
+   fflush(stdout);
+   return sample;
+}
+
+static void soakEventHandler(rbusHandle_t handle, rbusEvent_t const *event, rbusEventSubscription_t *subscription) {
+   (void)handle;
+   (void)event;
+   (void)subscription;
+   __atomic_add_fetch(&g_soakEvents, 1, __ATOMIC_RELAXED);
+}
+
+static uint32_t soakRandom(uint64_t *state) {
+   *state ^= *state << 13;
+   *state ^= *state >> 7;
+   *state ^= *state << 17;
+   return (uint32_t)(*state >> 32);
+}
+
+// One operation of the workload: 60% gets of any parameter, 35% sets of a
+// stored string to a value of random length, and 5% subscription toggles on
+// a stored string. Returns false if it failed.
+static bool soakOperation(rbusHandle_t handle, uint64_t *random, const int *strings, int numStrings, bool *subscribed) {
+   char buf[MAX_NAME_LEN];
+   uint32_t roll = soakRandom(random) % 100;
+   int op = roll < 60 ? SOAK_GET : roll < 95 ? SOAK_SET : SOAK_SUBSCRIBE;
+   int s = (int)(soakRandom(random) % numStrings);
+   const char *name = dataModelName(op == SOAK_GET ? (int)(soakRandom(random) % g_totalDataModels) : strings[s], buf);
+
+   rbusError_t rc;
+   uint64_t start = realMonotonicNs();
+   if (op == SOAK_GET) {
+      rbusValue_t value;
+      rc = rbus_get(handle, name, &value);
+      if (rc == RBUS_ERROR_SUCCESS) {
+         rbusValue_Release(value);
+      }
+   } else if (op == SOAK_SET) {
+      char str[SOAK_MAX_STRING + 1];
+      int len = (int)(soakRandom(random) % (SOAK_MAX_STRING + 1));
+      for (int c = 0; c < len; c++) {
+         str[c] = 'a' + soakRandom(random) % 26;
+      }
+      str[len] = '\0';
+      rbusValue_t value;
+      rbusValue_Init(&value);
+      rbusValue_SetString(value, str);
+      rc = rbus_set(handle, name, value, NULL);
+      rbusValue_Release(value);
+   } else if (subscribed[s]) {
+      rc = rbusEvent_Unsubscribe(handle, name);
+      subscribed[s] = false;
+   } else {
+      rc = rbusEvent_Subscribe(handle, name, soakEventHandler, NULL, 0);
+      subscribed[s] = rc == RBUS_ERROR_SUCCESS;
+   }
+   soakRecord(op, realMonotonicNs() - start);
+   if (rc != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Soak: %s of %s failed: %d\n", g_soakOpNames[op], name, rc);
+   }
+   return rc == RBUS_ERROR_SUCCESS;
+}
+
+// Let a second of provider time pass: on the simulated clock by advancing it,
+// otherwise by running the main loop until the second is over
+static void soakWait(uint64_t untilMs) {
+#ifdef SIMULATED_CLOCK
+   if (clockSimulated()) {
+      reactorRun(0);
+      clockAdvance(untilMs - monotonicMs());
+      return;
+   }
+#endif
+   for (uint64_t now = monotonicMs(); g_running && now < untilMs; now = monotonicMs()) {
+      reactorRun((int)(untilMs - now < TIMER_TICK_MS ? untilMs - now : TIMER_TICK_MS));
+      timerAdvance(monotonicMs());
+   }
+}
+
+// Run the workload at rate operations per second for seconds of provider
+// time, sampling SOAK_SAMPLES times. The first sample is the baseline: the
+// run fails if any operation fails, if RSS or heap use grow by more than
+// maxGrowth percent, or if a p99 latency rises by more than maxDrift percent
+// and SOAK_MIN_DRIFT_US.
+static int runSoak(uint32_t seconds, uint32_t rate, uint32_t maxGrowth, uint32_t maxDrift) {
+   int *strings = malloc(g_totalDataModels * sizeof(int));
+   bool *subscribed = calloc(g_totalDataModels, sizeof(bool));
+   int numStrings = 0;
+   for (int i = 0; strings && i < g_totalDataModels; i++) {
+      if (g_dataModels[i].type == TYPE_STRING && !g_dataModels[i].getHandler && !g_dataModels[i].setHandler) {
+         strings[numStrings++] = i;
+      }
+   }
+   rbusHandle_t handle;
+   if (!strings || !subscribed || numStrings == 0 || rbus_open(&handle, "rbus-datamodels-soak") != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Soak: failed to start\n");
+      free(strings);
+      free(subscribed);
+      return 1;
+   }
+
+   uint32_t sampleSec = seconds / SOAK_SAMPLES > 0 ? seconds / SOAK_SAMPLES : 1;
+   printf("Soak: %u s at %u operations/s over %d parameters, %s clock\n", seconds, rate, numStrings,
+      clockSimulated() ? "simulated" : "real");
+   printf("%8s %9s %6s %8s %8s %8s", "seconds", "ops", "errors", "rss_kb", "heap_kb", "free_kb");
+   for (int op = 0; op < NUM_SOAK_OPS; op++) {
+      printf("  %s_p50 %s_p99 %s_max", g_soakOpNames[op], g_soakOpNames[op], g_soakOpNames[op]);
+   }
+   printf("   events\n");
+
+   uint64_t random = 0x9E3779B97F4A7C15ULL;
+   uint64_t ops = 0;
+   uint64_t errors = 0;
+   SoakSample first;
+   SoakSample last;
+   memset(&first, 0, sizeof(first));
+   memset(&last, 0, sizeof(last));
+   uint64_t startMs = monotonicMs();
+   uint32_t elapsed = 0;
+   while (g_running && elapsed < seconds) {
+      for (uint32_t k = 0; k < rate; k++) {
+         errors += !soakOperation(handle, &random, strings, numStrings, subscribed);
+         ops++;
+      }
+      elapsed++;
+      soakWait(startMs + elapsed * 1000ULL);
+      if (elapsed % sampleSec == 0) {
+         last = soakSample(elapsed, ops, errors);
+         if (elapsed == sampleSec) {
+            first = last;
+         }
+      }
+   }
+
+   for (int s = 0; s < numStrings; s++) {
+      if (subscribed[s]) {
+         char buf[MAX_NAME_LEN];
+         rbusEvent_Unsubscribe(handle, dataModelName(strings[s], buf));
+      }
+   }
+   rbus_close(handle);
+   free(strings);
+   free(subscribed);
+
+   bool failed = errors > 0;
+   if (last.seconds > first.seconds) {
+      if ((last.rssKb - first.rssKb) * 100 > first.rssKb * maxGrowth && last.rssKb > first.rssKb) {
+         printf("Soak: RSS grew from %" PRIu64 " to %" PRIu64 " kB\n", first.rssKb, last.rssKb);
+         failed = true;
+      }
+      if ((last.heapKb - first.heapKb) * 100 > first.heapKb * maxGrowth && last.heapKb > first.heapKb) {
+         printf("Soak: heap use grew from %" PRIu64 " to %" PRIu64 " kB\n", first.heapKb, last.heapKb);
+         failed = true;
+      }
+      for (int op = 0; op < NUM_SOAK_OPS; op++) {
+         if (last.p99Us[op] > first.p99Us[op] + SOAK_MIN_DRIFT_US &&
+            (last.p99Us[op] - first.p99Us[op]) * 100 > first.p99Us[op] * maxDrift) {
+            printf("Soak: %s p99 latency rose from %" PRIu64 " to %" PRIu64 " us\n", g_soakOpNames[op],
+               first.p99Us[op], last.p99Us[op]);
+            failed = true;
+         }
+      }
+   } else {
+      printf("Soak: too short to compare samples\n");
+   }
+   printf("Soak: %s, %" PRIu64 " operations, %" PRIu64 " errors\n", failed ? "FAILED" : "passed", ops, errors);
+   return failed ? 1 : 0;
+}
+#endif
+
+#ifdef SIMULATED_CLOCK
+#define USAGE_SIMULATED_CLOCK "      --simulated-clock                Stop the clocks until AdvanceClock() moves them, for tests and benchmarks\n"
+#else
+#define USAGE_SIMULATED_CLOCK ""
+#endif
+
+static void usage(const char *prog) {
+   fprintf(stderr,
+      "Usage: %s [options] [datamodels.json]\n"
+      "  -d, --name-dict <plain|front-coded>  Name dictionary used by the store (default: plain)\n"
+      "      --bench-names <count>            Benchmark the name dictionaries on count names and exit\n"
+      "      --load-gen <name>                Measure gets and events of name on a running provider and exit\n"
+      "      --load-count <count>             Operations per load generator measurement (default: 10000)\n"
+      "      --proxy <subtree>                Cache a remote subtree (e.g. Device.WiFi.) under " PROXY_PREFIX "\n"
+      "      --proxy-ttl <seconds>            Refetch unsubscribed cached values older than this (default: 30)\n"
+      "      --http <socket>                  Serve batched JSON get/set/search over HTTP on a Unix socket\n"
+      "      --http-bench <socket>            Measure batched gets against a running HTTP gateway and exit\n"
+      "      --prometheus <file>              Export numeric parameters to a Prometheus textfile\n"
+      "      --prometheus-subtree <prefix>    Subtree to export; repeatable (default: Device.)\n"
+      "      --prometheus-interval <seconds>  Seconds between textfile exports (default: 15)\n"
+      "      --udp-echo <port>                Answer UDP echo diagnostics on port\n"
+      "      --throughput-server <port>       Serve download and upload diagnostics over HTTP on port\n"
+      "      --wifi                           Track Wi-Fi access points and associated stations from nl80211\n"
+      "      --wifi-interval <seconds>        Seconds between Wi-Fi station sweeps (default: 10)\n"
+      "      --cgroup <dir>                   Publish per-service CPU and memory of the cgroup v2 directories under dir\n"
+      "      --cgroup-interval <seconds>      Seconds between service samples (default: 5)\n"
+      "      --bench-sweep <count>            Time count --cgroup sweeps with io_uring and with pread and exit\n"
+      "      --workers <count>                Scheduler worker threads, at most one per CPU (default: 4)\n"
+      "      --clock-sync                     Publish the kernel clock synchronization status under " TIME_OBJECT "\n"
+      "      --dns-servers                    Mirror the resolver configuration's name servers into " DNS_OBJECT "\n"
+      "      --resolv-conf <file>             Resolver configuration read by --dns-servers (default: " DNS_DEFAULT_RESOLV_CONF ")\n"
+      "      --flight-dump <file>             Where SIGUSR1 and latency SLO breaches dump the flight recorder (default: " FLIGHT_DEFAULT_PATH ")\n"
+      "      --slo-ms <ms>                    Get, set and publish latency SLO; 0 disables automatic dumps (default: 100)\n"
+      "      --fault-injection                Allow InjectFault() to slow down or fail requests, for client testing\n"
+      USAGE_SIMULATED_CLOCK
+      "      --soak <seconds>                 Run a get/set/subscribe workload against this provider and exit, failing on growth or drift\n"
+      "      --soak-rate <ops>                Soak operations per second of provider time (default: 1000)\n"
+      "      --soak-max-growth <percent>      Allowed RSS and heap growth over a soak (default: 10)\n"
+      "      --soak-max-drift <percent>       Allowed p99 latency rise over a soak (default: 50)\n",
+      prog);
+}
+
+int main(int argc, char *argv[]) {
+   enum { OPT_BENCH_NAMES = 256, OPT_LOAD_GEN, OPT_LOAD_COUNT, OPT_PROXY, OPT_PROXY_TTL, OPT_HTTP, OPT_HTTP_BENCH,
+      OPT_PROMETHEUS, OPT_PROMETHEUS_SUBTREE, OPT_PROMETHEUS_INTERVAL, OPT_UDP_ECHO,
+      OPT_THROUGHPUT_SERVER, OPT_WIFI, OPT_WIFI_INTERVAL, OPT_CGROUP, OPT_CGROUP_INTERVAL, OPT_BENCH_SWEEP,
+      OPT_WORKERS, OPT_CLOCK_SYNC, OPT_DNS_SERVERS, OPT_RESOLV_CONF, OPT_FLIGHT_DUMP, OPT_SLO_MS,
+      OPT_FAULT_INJECTION, OPT_SIMULATED_CLOCK, OPT_SOAK, OPT_SOAK_RATE, OPT_SOAK_MAX_GROWTH, OPT_SOAK_MAX_DRIFT };
+   static const struct option longOptions[] = {
+      {"name-dict", required_argument, NULL, 'd'},
+      {"bench-names", required_argument, NULL, OPT_BENCH_NAMES},
+      {"load-gen", required_argument, NULL, OPT_LOAD_GEN},
+      {"load-count", required_argument, NULL, OPT_LOAD_COUNT},
+      {"proxy", required_argument, NULL, OPT_PROXY},
+      {"proxy-ttl", required_argument, NULL, OPT_PROXY_TTL},
+      {"http", required_argument, NULL, OPT_HTTP},
+      {"http-bench", required_argument, NULL, OPT_HTTP_BENCH},
+      {"prometheus", required_argument, NULL, OPT_PROMETHEUS},
+      {"prometheus-subtree", required_argument, NULL, OPT_PROMETHEUS_SUBTREE},
+      {"prometheus-interval", required_argument, NULL, OPT_PROMETHEUS_INTERVAL},
+      {"udp-echo", required_argument, NULL, OPT_UDP_ECHO},
+      {"throughput-server", required_argument, NULL, OPT_THROUGHPUT_SERVER},
+      {"wifi", no_argument, NULL, OPT_WIFI},
+      {"wifi-interval", required_argument, NULL, OPT_WIFI_INTERVAL},
+      {"cgroup", required_argument, NULL, OPT_CGROUP},
+      {"cgroup-interval", required_argument, NULL, OPT_CGROUP_INTERVAL},
+      {"bench-sweep", required_argument, NULL, OPT_BENCH_SWEEP},
+      {"workers", required_argument, NULL, OPT_WORKERS},
+      {"clock-sync", no_argument, NULL, OPT_CLOCK_SYNC},
+      {"dns-servers", no_argument, NULL, OPT_DNS_SERVERS},
+      {"resolv-conf", required_argument, NULL, OPT_RESOLV_CONF},
+      {"flight-dump", required_argument, NULL, OPT_FLIGHT_DUMP},
+      {"slo-ms", required_argument, NULL, OPT_SLO_MS},
+      {"fault-injection", no_argument, NULL, OPT_FAULT_INJECTION},
+#ifdef SIMULATED_CLOCK
+      {"simulated-clock", no_argument, NULL, OPT_SIMULATED_CLOCK},
+#endif
+      {"soak", required_argument, NULL, OPT_SOAK},
+      {"soak-rate", required_argument, NULL, OPT_SOAK_RATE},
+      {"soak-max-growth", required_argument, NULL, OPT_SOAK_MAX_GROWTH},
+      {"soak-max-drift", required_argument, NULL, OPT_SOAK_MAX_DRIFT},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}
+   };
+   int benchNames = 0;
+   int benchSweepCount = 0;
+   const char *loadGenName = NULL;
+   int loadCount = 10000;
+   const char *httpPath = NULL;
+   const char *httpBenchPath = NULL;
+   int udpEchoPort = 0;
+   int throughputPort = 0;
+   int soakSeconds = 0;
+   int soakRate = SOAK_DEFAULT_RATE;
+   int soakMaxGrowth = SOAK_DEFAULT_MAX_GROWTH;
+   int soakMaxDrift = SOAK_DEFAULT_MAX_DRIFT;
+   int opt;
+   while ((opt = getopt_long(argc, argv, "d:h", longOptions, NULL)) != -1) {
+      switch (opt) {
+      case 'd':
+         if (strcmp(optarg, "plain") == 0) {
+            g_nameDictMode = NAME_DICT_PLAIN;
+         } else if (strcmp(optarg, "front-coded") == 0) {
+            g_nameDictMode = NAME_DICT_FRONT_CODED;
+         } else {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_BENCH_NAMES:
+         benchNames = atoi(optarg);
+         if (benchNames <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_LOAD_GEN:
+         loadGenName = optarg;
+         break;
+      case OPT_LOAD_COUNT:
+         loadCount = atoi(optarg);
+         if (loadCount <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_PROXY:
+         if (g_numProxySubtrees == PROXY_MAX_SUBTREES || strncmp(optarg, "Device.", 7) != 0 ||
+            optarg[strlen(optarg) - 1] != '.' || strncmp(optarg, PROXY_PREFIX, strlen(PROXY_PREFIX)) == 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_proxySubtrees[g_numProxySubtrees++] = optarg;
+         break;
+      case OPT_PROXY_TTL:
+         if (atoi(optarg) <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_proxyTtlMs = atoi(optarg) * 1000ULL;
+         break;
+      case OPT_HTTP:
+         httpPath = optarg;
+         break;
+      case OPT_HTTP_BENCH:
+         httpBenchPath = optarg;
+         break;
+      case OPT_PROMETHEUS:
+         if (strlen(optarg) >= MAX_NAME_LEN) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_promPath = optarg;
+         break;
+      case OPT_PROMETHEUS_SUBTREE:
+         if (g_numPromSubtrees == PROM_MAX_SUBTREES) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_promSubtrees[g_numPromSubtrees++] = optarg;
+         break;
+      case OPT_PROMETHEUS_INTERVAL:
+         if (atoi(optarg) <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_promIntervalSec = atoi(optarg);
+         break;
+      case OPT_UDP_ECHO:
+         udpEchoPort = atoi(optarg);
+         if (udpEchoPort <= 0 || udpEchoPort > 65535) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_THROUGHPUT_SERVER:
+         throughputPort = atoi(optarg);
+         if (throughputPort <= 0 || throughputPort > 65535) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_WIFI:
+         g_wifiEnabled = true;
+         break;
+      case OPT_WIFI_INTERVAL:
+         if (atoi(optarg) <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_wifiIntervalSec = atoi(optarg);
+         break;
+      case OPT_CGROUP:
+         g_cgroupRoot = optarg;
+         break;
+      case OPT_CGROUP_INTERVAL:
+         if (atoi(optarg) <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_cgroupIntervalSec = atoi(optarg);
+         break;
+      case OPT_BENCH_SWEEP:
+         benchSweepCount = atoi(optarg);
+         if (benchSweepCount <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_WORKERS:
+         if (atoi(optarg) <= 0 || atoi(optarg) > SCHED_MAX_WORKERS) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_schedWorkerCount = atoi(optarg);
+         break;
+      case OPT_CLOCK_SYNC:
+         g_timeEnabled = true;
+         break;
+      case OPT_DNS_SERVERS:
+         g_dnsEnabled = true;
+         break;
+      case OPT_RESOLV_CONF:
+         g_resolvConfPath = optarg;
+         break;
+      case OPT_FLIGHT_DUMP:
+         if (strlen(optarg) >= MAX_NAME_LEN) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_flightPath = optarg;
+         break;
+      case OPT_SLO_MS:
+         if (atoi(optarg) < 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         g_flightSloNs = atoi(optarg) * 1000000ULL;
+         break;
+      case OPT_FAULT_INJECTION:
+         g_faultEnabled = true;
+         break;
+#ifdef SIMULATED_CLOCK
+      case OPT_SIMULATED_CLOCK:
+         clockSimulate();
+         break;
+#endif
+      case OPT_SOAK:
+         soakSeconds = atoi(optarg);
+         if (soakSeconds <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_SOAK_RATE:
+         soakRate = atoi(optarg);
+         if (soakRate <= 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_SOAK_MAX_GROWTH:
+         soakMaxGrowth = atoi(optarg);
+         if (soakMaxGrowth < 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      case OPT_SOAK_MAX_DRIFT:
+         soakMaxDrift = atoi(optarg);
+         if (soakMaxDrift < 0) {
+            usage(argv[0]);
+            return 1;
+         }
+         break;
+      default:
+         usage(argv[0]);
+         return opt == 'h' ? 0 : 1;
+      }
+   }
+   if (argc - optind > 1) {
+      usage(argv[0]);
+      return 1;
+   }
+   // Remote values are refetched by tasks that would run inline in get handlers
+   if (clockSimulated() && g_numProxySubtrees > 0) {
+      fprintf(stderr, "--proxy cannot be used with the simulated clock\n");
+      return 1;
+   }
+   const char *jsonPath = optind < argc ? argv[optind] : JSON_FILE;
+
+   // A peer that closes a socket early, such as an HTTP client or a
+   // throughput test server, must fail the write rather than kill the
+   // provider; sendfile() has no MSG_NOSIGNAL
+   signal(SIGPIPE, SIG_IGN);
+
+   if (loadGenName) {
+      return runLoadGenerator(loadGenName, loadCount);
+   }
+   if (httpBenchPath) {
+      return runHttpBenchmark(httpBenchPath, loadCount);
+   }
+
+   // Set up signal handlers
+   signal(SIGINT, signal_handler);
+   signal(SIGTERM, signal_handler);
+   schedInit(&g_flightDumpTask, SCHED_BACKGROUND, flightDump, NULL);
+   signal(SIGUSR1, flightSignalHandler);
+
+   // Load data models from JSON
+   if (!loadDataModelsFromJson(jsonPath)) {
+      fprintf(stderr, "Failed to load data models from %s\n", jsonPath);
+      return 1;
+   }
+
+   rbusError_t rc;
+   if (g_numProxySubtrees > 0) {
+      rc = rbus_open(&g_rbusHandle, "rbus-datamodels");
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "Failed to open rbus: %d\n", rc);
+         cleanup();
+         return 1;
+      }
+      if (!loadProxySubtrees()) {
+         cleanup();
+         return 1;
+      }
+   }
+
+#ifdef HAVE_NL80211
+   if (g_wifiEnabled && !addWifiParameters()) {
+      cleanup();
+      return 1;
+   }
+#endif
+#ifdef __linux__
+   if ((g_cgroupRoot && !addCgroupParameters()) || (g_timeEnabled && !addTimeParameters()) ||
+      (g_dnsEnabled && !addDnsParameters())) {
+      cleanup();
+      return 1;
+   }
+#endif
+   if (!addDiagnosticsParameters() || !addSchedParameters() || !buildNameDictionary()) {
+      cleanup();
+      return 1;
+   }
+
+   if (benchNames > 0) {
+      int benchRc = benchNameDictionaries(benchNames);
+      cleanup();
+      return benchRc;
+   }
+
+   timerWheelInit();
+
+   if (benchSweepCount > 0) {
+#ifdef __linux__
+      int benchRc = benchSweeps(benchSweepCount);
+#else
+      fprintf(stderr, "Sweep benchmarks need Linux\n");
+      int benchRc = 1;
+#endif
+      cleanup();
+      return benchRc;
+   }
+
+   if (!schedStart()) {
+      cleanup();
+      return 1;
+   }
+
+   if (!g_rbusHandle) {
+      rc = rbus_open(&g_rbusHandle, "rbus-datamodels");
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "Failed to open rbus: %d\n", rc);
+         cleanup();
+         return 1;
+      }
+   }
+
+   // Dynamically allocate memory for dataElements
+   g_dataElements = (rbusDataElement_t *)malloc(g_totalDataModels * sizeof(rbusDataElement_t));
+   if (!g_dataElements) {
+      fprintf(stderr, "Failed to allocate memory for data elements\n");
+      cleanup();
+      return 1;
+   }
+
+   for (int i = 0; i < g_totalDataModels; i++) {
+      char buf[MAX_NAME_LEN];
+      g_dataElements[i].name = strdup(dataModelName(i, buf));
+      if (!g_dataElements[i].name) {
+         fprintf(stderr, "Failed to allocate memory for data element name\n");
+         cleanup();
+         return 1;
+      }
+      g_dataElements[i].type = RBUS_ELEMENT_TYPE_PROPERTY;
+      if (!g_dataModels[i].getHandler) {
+         g_dataElements[i].cbTable.getHandler = getHandler;
+      } else if (g_dataModels[i].proxy) {
+         g_dataElements[i].cbTable.getHandler = g_dataModels[i].getHandler;
+      } else {
+         g_dataElements[i].cbTable.getHandler = recordedLiveGetHandler;
+      }
+      g_dataElements[i].cbTable.setHandler = g_dataModels[i].setHandler ? g_dataModels[i].setHandler : setHandler;
+      g_dataElements[i].cbTable.eventSubHandler = eventSubHandler;
+   }
+
+   rc = rbus_regDataElements(g_rbusHandle, g_totalDataModels, g_dataElements);
+   if (rc != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Failed to register data elements: %d\n", rc);
+      cleanup();
+      return 1;
+   }
+
+   if (g_faultEnabled) {
+      faultWrapMethods();
+      printf("Fault injection enabled\n");
+   }
+   rc = rbus_regDataElements(g_rbusHandle, NUM_METHOD_ELEMENTS, g_methodElements);
+   if (rc != RBUS_ERROR_SUCCESS) {
+      fprintf(stderr, "Failed to register methods: %d\n", rc);
+      cleanup();
+      return 1;
+   }
+   g_methodsRegistered = true;
+
+   printf("Successfully registered %d data models\n", g_totalDataModels);
+
+   if (g_numProxySubtrees > 0) {
+      subscribeProxySubtrees();
+   }
+
+   if (httpPath && !httpStart(httpPath)) {
+      cleanup();
+      return 1;
+   }
+
+   if (!diagStart(udpEchoPort) || !xferStart(throughputPort)) {
+      cleanup();
+      return 1;
+   }
+#ifdef SIMULATED_CLOCK
+   if (!clockStart()) {
+      cleanup();
+      return 1;
+   }
+#endif
+#ifdef HAVE_ETHTOOL_NETLINK
+   ethStart();
+#endif
+#ifdef HAVE_NL80211
+   if (g_wifiEnabled) {
+      wifiStart();
+   }
+#else
+   if (g_wifiEnabled) {
+      fprintf(stderr, "Wi-Fi rows need nl80211, which this build does not have\n");
+   }
+#endif
+#ifdef __linux__
+   if (g_cgroupRoot && !cgroupStart()) {
+      cleanup();
+      return 1;
+   }
+   if (g_timeEnabled) {
+      timeStart();
+   }
+   if (g_dnsEnabled && !dnsStart()) {
+      cleanup();
+      return 1;
+   }
+#else
+   if (g_cgroupRoot) {
+      fprintf(stderr, "Service metrics need cgroup v2, which this platform does not have\n");
+   }
+   if (g_timeEnabled || g_dnsEnabled) {
+      fprintf(stderr, "Clock synchronization and DNS servers need Linux, which this platform is not\n");
+   }
+#endif
+
+   if (g_promPath && !promStart()) {
+      fprintf(stderr, "Failed to set up the Prometheus export\n");
+      cleanup();
+      return 1;
+   }
+
+   // Set each data model's value
+   for (int i = 0; i < g_totalDataModels; i++) {
+      if (g_dataModels[i].proxy) {
+         continue;
+      }
+      rbusValue_t value;
+      rbusValue_Init(&value);
+      dataModelToValue(&g_dataModels[i], value);
+
+      rbusSetOptions_t opts = {.commit = true};
+      rc = rbus_set(g_rbusHandle, g_dataElements[i].name, value, &opts);
+      if (rc != RBUS_ERROR_SUCCESS) {
+         fprintf(stderr, "Failed to set %s: %d\n", g_dataElements[i].name, rc);
+      }
+      rbusValue_Release(value);
+   }
+
+   // rbus keeps its own copy of each registered name, so with the front-coded
+   // dictionary don't hold a second full copy; cleanup() decodes them again.
+   if (g_nameDictMode == NAME_DICT_FRONT_CODED) {
+      for (int i = 0; i < g_totalDataModels; i++) {
+         free(g_dataElements[i].name);
+         g_dataElements[i].name = NULL;
+      }
+   }
+
+   if (soakSeconds > 0) {
+#ifdef __linux__
+      int soakRc = runSoak(soakSeconds, soakRate, soakMaxGrowth, soakMaxDrift);
+#else
+      fprintf(stderr, "Soak runs need Linux\n");
+      int soakRc = 1;
+#endif
+      cleanup();
+      return soakRc;
+   }
+
+   // Main loop: serve watched descriptors, waking at least once per tick to
+   // expire timers
+   while (g_running) {
+      reactorRun(TIMER_TICK_MS);
+      timerAdvance(monotonicMs());
+      if (g_flightDumpRequested) {
+         g_flightDumpRequested = 0;
+         schedSubmit(&g_flightDumpTask);
+      }
    }
 
    fprintf(stdout, "Shutting down...\n");